@@ -0,0 +1,394 @@
+/*
+ * file: bench_cjson.c
+ * date: 10/17/2026 (mm/dd/yyyy)
+ * version: 0.0.1
+ * _____________________________
+ * Standalone microbenchmark for the vendored cJSON.
+ *
+ * Times cJSON_Parse, cJSON_PrintUnformatted, cJSON_Print, cJSON_Minify, cJSON_Duplicate
+ * and cJSON_Compare over a set of corpora. JSON files named on the command line are
+ * benchmarked as-is (e.g. the usual twitter.json, canada.json, citm_catalog.json). With
+ * no files, synthetic stand-ins of the same shape are generated in memory (string-heavy
+ * tweets, float-heavy GeoJSON coordinates, integer-heavy catalog objects), plus a deep
+ * and a wide document to stress nesting and long child lists.
+ *
+ * Run with: gcc -O2 bench_cjson.c cJSON.c -o bench_cjson -lm
+ * Then: ./bench_cjson [-t seconds_per_case] [file.json ...] > bench_output.txt
+ *
+ * Output is one JSON object per line (corpus, op, bytes, iterations, ns_per_op, mb_per_s,
+ * allocs_per_op, alloc_bytes_per_op, peak_rss_kb) so runs can be diffed against a baseline.
+ * MB/s is measured against the input document size for every op. Timing uses the default
+ * hooks: custom cJSON_InitHooks turn off cJSON's realloc path, so allocations are counted
+ * through them in a separate, untimed pass (a buffer growth is one malloc there, as it is
+ * one realloc in the default path). peak_rss_kb is the process high-water mark so far.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // For clock_gettime
+
+// Includes
+#include "cJSON.h"
+#include <stdio.h>         // For printf, fopen
+#include <stdarg.h>        // For va_list in text_printf
+#include <stdlib.h>        // For malloc, free, strtod
+#include <string.h>        // For memcpy, strlen, strcmp
+#include <time.h>          // For clock_gettime
+#include <sys/resource.h>  // For getrusage (peak RSS)
+
+// Allocation accounting, fed by the cJSON hooks below during the counting pass
+static size_t alloc_count = 0;
+static size_t alloc_bytes = 0;
+
+static void *counting_malloc(size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    return malloc(size);
+}
+
+static void counting_free(void *pointer) {
+    free(pointer);
+}
+
+// Growable text buffer used by the corpus generators
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} TextBuffer;
+
+static void text_append(TextBuffer *buffer, const char *text, size_t length) {
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (buffer->length + length + 1 > capacity) {
+            capacity *= 2;
+        }
+        buffer->data = realloc(buffer->data, capacity);
+        if (!buffer->data) {
+            fprintf(stderr, "Out of memory generating corpus\n");
+            exit(1);
+        }
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+static void text_puts(TextBuffer *buffer, const char *text) {
+    text_append(buffer, text, strlen(text));
+}
+
+static void text_printf(TextBuffer *buffer, const char *format, ...) {
+    char scratch[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(scratch, sizeof(scratch), format, args);
+    va_end(args);
+    if (length > 0) {
+        text_append(buffer, scratch, (size_t)length < sizeof(scratch) ? (size_t)length : sizeof(scratch) - 1);
+    }
+}
+
+// Deterministic xorshift so every run benchmarks the same documents
+static unsigned long long rng_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned long long rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void text_word(TextBuffer *buffer) {
+    static const char *words[] = {
+        "the", "kernel", "module", "loaded", "video", "camera", "sound", "network",
+        "\\u3053\\u3093\\u306b\\u3061\\u306f", "caf\\u00e9", "line\\nbreak", "\\\"quoted\\\"", "https:\\/\\/t.co\\/x"
+    };
+    text_puts(buffer, words[rng_next() % (sizeof(words) / sizeof(words[0]))]);
+}
+
+// twitter.json style: string heavy, many small nested objects, 64-bit ids
+static char *generate_twitter(void) {
+    TextBuffer buffer = {0};
+    text_puts(&buffer, "{\"statuses\": [\n");
+    for (int i = 0; i < 1500; i++) {
+        unsigned long long id = 505874924095815681ULL + (rng_next() % 1000000ULL);
+        text_printf(&buffer, "  {\"created_at\": \"Sun Aug 31 00:29:15 +0000 2014\", \"id\": %llu, \"id_str\": \"%llu\", \"text\": \"", id, id);
+        for (int w = 0; w < 12; w++) {
+            text_word(&buffer);
+            text_puts(&buffer, " ");
+        }
+        text_printf(&buffer, "\", \"truncated\": false, \"in_reply_to_status_id\": null, \"user\": {\"id\": %llu, \"name\": \"user%d\", "
+                    "\"screen_name\": \"u%d\", \"followers_count\": %llu, \"verified\": %s, \"lang\": \"ja\"}, "
+                    "\"entities\": {\"hashtags\": [], \"urls\": [{\"url\": \"http:\\/\\/t.co\\/%d\", \"indices\": [%d, %d]}]}, "
+                    "\"retweet_count\": %llu, \"favorited\": false}%s\n",
+                    rng_next() % 3000000000ULL, i, i, rng_next() % 100000ULL, (i % 7) ? "false" : "true",
+                    i, i % 140, i % 140 + 22, rng_next() % 1000ULL, (i + 1 < 1500) ? "," : "");
+    }
+    text_puts(&buffer, "], \"search_metadata\": {\"completed_in\": 0.087, \"count\": 1500}}\n");
+    return buffer.data;
+}
+
+// canada.json style: a polygon made of long arrays of [lon, lat] floats
+static char *generate_canada(void) {
+    TextBuffer buffer = {0};
+    text_puts(&buffer, "{\"type\": \"FeatureCollection\", \"features\": [{\"type\": \"Feature\", \"properties\": {\"name\": \"Canada\"}, "
+              "\"geometry\": {\"type\": \"Polygon\", \"coordinates\": [\n");
+    for (int ring = 0; ring < 120; ring++) {
+        text_puts(&buffer, ring ? ",[" : "[");
+        for (int point = 0; point < 500; point++) {
+            double lon = -141.0 + (double)(rng_next() % 8000000000ULL) / 1e8;
+            double lat = 41.0 + (double)(rng_next() % 4200000000ULL) / 1e8;
+            text_printf(&buffer, "%s[%.15g,%.15g]", point ? "," : "", lon, lat);
+        }
+        text_puts(&buffer, "]\n");
+    }
+    text_puts(&buffer, "]}}]}\n");
+    return buffer.data;
+}
+
+// citm_catalog.json style: an id-keyed object of events plus a performance list, integer heavy
+static char *generate_citm(void) {
+    TextBuffer buffer = {0};
+    text_puts(&buffer, "{\"events\": {\n");
+    for (int i = 0; i < 2000; i++) {
+        int id = 138586341 + i * 7;
+        text_printf(&buffer, "%s\"%d\": {\"description\": null, \"id\": %d, \"logo\": \"/images/UE0AAAAACEKo6QAAAAZDSVRN\", "
+                    "\"name\": \"Event %d\", \"subTopicIds\": [337184269, 337184283, %d], \"subjectCode\": null, "
+                    "\"subtitle\": null, \"topicIds\": [324846099, %d]}\n",
+                    i ? "," : "", id, id, i, 337184262 + i % 50, 107888604 + i % 13);
+    }
+    text_puts(&buffer, "}, \"performances\": [\n");
+    for (int i = 0; i < 2000; i++) {
+        text_printf(&buffer, "%s{\"eventId\": %d, \"id\": %d, \"prices\": [{\"amount\": %d, \"audienceSubCategoryId\": 337100890, "
+                    "\"seatCategoryId\": %d}], \"seatCategories\": [{\"areas\": [{\"areaId\": 205705999, \"blockIds\": []}], "
+                    "\"seatCategoryId\": %d}], \"start\": %llu, \"venueCode\": \"PLEYEL_PLEYEL\"}\n",
+                    i ? "," : "", 138586341 + i * 7, 339887544 + i, 28000 + (i % 40) * 500, 338937295 + i % 9,
+                    338937295 + i % 9, 1372701600000ULL + (unsigned long long)i * 86400000ULL);
+    }
+    text_puts(&buffer, "]}\n");
+    return buffer.data;
+}
+
+// Deep: many array chains nested close to CJSON_NESTING_LIMIT with an object at the bottom.
+// Objects stay shallow on purpose: cJSON_Compare checks objects in both directions, so its
+// cost doubles with every level of object nesting.
+static char *generate_deep(void) {
+    TextBuffer buffer = {0};
+    const int chains = 200;
+    const int depth = 900;
+    text_puts(&buffer, "[");
+    for (int chain = 0; chain < chains; chain++) {
+        text_puts(&buffer, chain ? ",\n" : "\n");
+        for (int level = 0; level < depth; level++) {
+            text_puts(&buffer, "[");
+        }
+        text_printf(&buffer, "{\"chain\": %d, \"leaf\": {\"value\": true}}", chain);
+        for (int level = 0; level < depth; level++) {
+            text_puts(&buffer, "]");
+        }
+    }
+    text_puts(&buffer, "]\n");
+    return buffer.data;
+}
+
+// Wide: one object with thousands of keys and one very long flat array
+static char *generate_wide(void) {
+    TextBuffer buffer = {0};
+    text_puts(&buffer, "{\"keys\": {");
+    for (int i = 0; i < 5000; i++) {
+        text_printf(&buffer, "%s\"key_%05d\": %d", i ? ", " : "", i, i);
+    }
+    text_puts(&buffer, "}, \"values\": [");
+    for (int i = 0; i < 100000; i++) {
+        text_printf(&buffer, "%s%llu", i ? "," : "", rng_next() % 100000ULL);
+    }
+    text_puts(&buffer, "]}\n");
+    return buffer.data;
+}
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    TextBuffer buffer = {0};
+    char chunk[65536];
+    size_t read_length;
+    while ((read_length = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        text_append(&buffer, chunk, read_length);
+    }
+    fclose(file);
+    return buffer.data;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return usage.ru_maxrss;  // kilobytes on Linux
+}
+
+// Everything one timed operation needs
+typedef enum { OP_PARSE, OP_PRINT_UNFORMATTED, OP_PRINT, OP_MINIFY, OP_DUPLICATE, OP_COMPARE } Operation;
+
+static const char *operation_names[] = {
+    "parse", "print_unformatted", "print", "minify", "duplicate", "compare"
+};
+
+typedef struct {
+    const char *text;
+    size_t length;
+    char *scratch;     // writable copy for cJSON_Minify
+    cJSON *tree;
+    cJSON *copy;       // equal tree for cJSON_Compare
+} Corpus;
+
+// Run the operation once; returns 0 on failure so broken corpora are reported, not timed
+static int run_once(Operation op, Corpus *corpus) {
+    switch (op) {
+        case OP_PARSE: {
+            cJSON *tree = cJSON_ParseWithLength(corpus->text, corpus->length);
+            if (!tree) return 0;
+            cJSON_Delete(tree);
+            return 1;
+        }
+        case OP_PRINT_UNFORMATTED: {
+            char *text = cJSON_PrintUnformatted(corpus->tree);
+            if (!text) return 0;
+            cJSON_free(text);
+            return 1;
+        }
+        case OP_PRINT: {
+            char *text = cJSON_Print(corpus->tree);
+            if (!text) return 0;
+            cJSON_free(text);
+            return 1;
+        }
+        case OP_MINIFY:
+            // Minify into a separate buffer so the input stays intact between iterations
+            cJSON_MinifyWithLength(corpus->text, corpus->length, corpus->scratch);
+            return 1;
+        case OP_DUPLICATE: {
+            cJSON *copy = cJSON_Duplicate(corpus->tree, 1);
+            if (!copy) return 0;
+            cJSON_Delete(copy);
+            return 1;
+        }
+        case OP_COMPARE:
+            return cJSON_Compare(corpus->tree, corpus->copy, 1) ? 1 : 0;
+    }
+    return 0;
+}
+
+static void bench_case(const char *name, Operation op, Corpus *corpus, double min_seconds) {
+    // Warm up caches and the allocator, and catch failures before timing
+    if (!run_once(op, corpus)) {
+        printf("{\"corpus\": \"%s\", \"op\": \"%s\", \"error\": \"operation failed\"}\n", name, operation_names[op]);
+        return;
+    }
+
+    size_t iterations = 0;
+    size_t batch = 1;
+    double start = now_ns();
+    double elapsed = 0;
+    // Grow the batch so the clock is read rarely for fast cases
+    while (elapsed < min_seconds * 1e9) {
+        for (size_t i = 0; i < batch; i++) {
+            run_once(op, corpus);
+        }
+        iterations += batch;
+        elapsed = now_ns() - start;
+        if (batch < 1024) {
+            batch *= 2;
+        }
+    }
+
+    // Allocations per op, counted outside the timing with the default hooks restored afterwards
+    size_t counted = (iterations < 16) ? iterations : 16;
+    cJSON_Hooks hooks = { counting_malloc, counting_free };
+    cJSON_InitHooks(&hooks);
+    alloc_count = 0;
+    alloc_bytes = 0;
+    for (size_t i = 0; i < counted; i++) {
+        run_once(op, corpus);
+    }
+    cJSON_InitHooks(NULL);
+
+    double ns_per_op = elapsed / (double)iterations;
+    double mb_per_s = ((double)corpus->length / (1024.0 * 1024.0)) / (ns_per_op / 1e9);
+    printf("{\"corpus\": \"%s\", \"op\": \"%s\", \"bytes\": %zu, \"iterations\": %zu, \"ns_per_op\": %.1f, "
+           "\"mb_per_s\": %.2f, \"allocs_per_op\": %.2f, \"alloc_bytes_per_op\": %.1f, \"peak_rss_kb\": %ld}\n",
+           name, operation_names[op], corpus->length, iterations, ns_per_op, mb_per_s,
+           (double)alloc_count / (double)counted, (double)alloc_bytes / (double)counted, peak_rss_kb());
+    fflush(stdout);
+}
+
+static void bench_corpus(const char *name, const char *text, double min_seconds) {
+    Corpus corpus = {0};
+    corpus.text = text;
+    corpus.length = strlen(text);
+    corpus.scratch = malloc(corpus.length + 1);
+    corpus.tree = cJSON_ParseWithLength(text, corpus.length);
+    corpus.copy = cJSON_ParseWithLength(text, corpus.length);
+    if (!corpus.scratch || !corpus.tree || !corpus.copy) {
+        printf("{\"corpus\": \"%s\", \"error\": \"could not parse\"}\n", name);
+    } else {
+        for (int op = OP_PARSE; op <= OP_COMPARE; op++) {
+            bench_case(name, (Operation)op, &corpus, min_seconds);
+        }
+    }
+    cJSON_Delete(corpus.tree);
+    cJSON_Delete(corpus.copy);
+    free(corpus.scratch);
+}
+
+int main(int argc, char *argv[]) {
+    double min_seconds = 0.5;
+    int first_file = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        min_seconds = strtod(argv[2], NULL);
+        if (min_seconds <= 0) {
+            fprintf(stderr, "Usage: %s [-t seconds_per_case] [file.json ...]\n", argv[0]);
+            return 1;
+        }
+        first_file = 3;
+    }
+
+    if (first_file < argc) {
+        for (int i = first_file; i < argc; i++) {
+            char *text = read_file(argv[i]);
+            if (!text) {
+                fprintf(stderr, "Cannot read %s\n", argv[i]);
+                continue;
+            }
+            bench_corpus(argv[i], text, min_seconds);
+            free(text);
+        }
+        return 0;
+    }
+
+    struct {
+        const char *name;
+        char *(*generate)(void);
+    } synthetic[] = {
+        { "twitter", generate_twitter },
+        { "canada", generate_canada },
+        { "citm_catalog", generate_citm },
+        { "deep", generate_deep },
+        { "wide", generate_wide },
+    };
+    for (size_t i = 0; i < sizeof(synthetic) / sizeof(synthetic[0]); i++) {
+        char *text = synthetic[i].generate();
+        bench_corpus(synthetic[i].name, text, min_seconds);
+        free(text);
+    }
+    return 0;
+}
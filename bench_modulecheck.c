@@ -0,0 +1,462 @@
+/*
+ * file: bench_modulecheck.c
+ * date: 10/17/2026 (mm/dd/yyyy)
+ * version: 0.0.1
+ * _____________________________
+ * Offline benchmark for the module checker.
+ *
+ * Generates synthetic system trees with 5k-50k modules and points the checker at them
+ * with module_check_set_root(), so results don't depend on the machine's /lib/modules
+ * or on what happens to be loaded. Each tree has:
+ *   proc/sys/kernel/osrelease, proc/modules, proc/cmdline
+ *   sys/module/<name>/[initstate]              (loaded modules and some built-ins)
+ *   lib/modules/<version>/kernel/.../<name>.ko (minimal ELF files with a .modinfo section)
+ *   lib/modules/<version>/modules.{dep,builtin,alias,symbols}
+ *   etc/modprobe.d/bench.conf                 (a few blacklist/install/alias rules)
+ * About 10% of the modules are built in, 2% loaded, the rest available as files; a third
+ * of the file names use hyphens. There are no kmod .bin indexes, so the text-file paths
+ * are measured.
+ *
+ * For every tree, check_modules_from_json() is timed on batches of 1, 10, 100 and 1000
+ * names drawn from it: plain names, hyphen spellings, aliases (from the config and from
+ * modules.alias, like char-major-10-3) and family patterns, all of which the indexes
+ * answer ("case": "found"). Missing names fall through to running the
+ * host's modinfo, so they are timed separately on a batch of 10 ("case": "missing") and
+ * that line depends on the machine; the "found" lines don't. The first run of each batch
+ * starts with empty caches (cold_ms), the rest are averaged.
+ *
+ * Run with: gcc -O2 -DMODULECHECK_NO_MAIN bench_modulecheck.c modulecheck.c cJSON.c -o bench_modulecheck -lpthread
+ * Then: ./bench_modulecheck [-t seconds_per_case] [-d tree_dir] [module_count ...] > bench_output.txt
+ *
+ * Output is one JSON object per line: a "generate" line per tree (modules, files, bytes,
+ * ms), then one line per batch (modules, case, batch, iterations, cold_ms, ms_per_batch,
+ * us_per_module, peak_rss_kb). Trees go to a temporary directory that is removed
+ * afterwards, unless -d names one to keep.
+ */
+
+#define _XOPEN_SOURCE 700  // For nftw, mkdtemp, clock_gettime
+
+// Includes
+#include "cJSON.h"
+#include "modulecheck.h"
+#include <stdio.h>         // For printf, fopen
+#include <stdlib.h>        // For malloc, free, strtod
+#include <string.h>        // For memcpy, strlen, strcmp
+#include <time.h>          // For clock_gettime
+#include <errno.h>         // For EEXIST
+#include <fcntl.h>         // For open
+#include <ftw.h>           // For nftw (tree removal)
+#include <unistd.h>        // For dup, dup2
+#include <sys/stat.h>      // For mkdir
+#include <sys/resource.h>  // For getrusage (peak RSS)
+
+// Deterministic xorshift so every run generates the same trees and batches
+static unsigned long long rng_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned long long rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Module families and where their files live in the tree
+static const struct {
+    const char *prefix;
+    const char *dir;
+} families[] = {
+    { "snd_hda_codec", "sound/pci/hda" },
+    { "v4l2", "drivers/media/v4l2-core" },
+    { "drm", "drivers/gpu/drm" },
+    { "usb", "drivers/usb/misc" },
+    { "net", "drivers/net/ethernet" },
+    { "hid", "drivers/hid" },
+    { "i2c", "drivers/i2c/busses" },
+    { "nf", "net/netfilter" },
+};
+
+#define FAMILY_COUNT (sizeof(families) / sizeof(families[0]))
+
+// What module i of a tree is
+#define MODULE_IS_BUILTIN(i) ((i) % 10 == 1)
+#define MODULE_IS_LOADED(i) ((i) % 50 == 2)
+
+static void module_name(size_t i, char *name, size_t size) {
+    snprintf(name, size, "%s_%05zu", families[i % FAMILY_COUNT].prefix, i);
+}
+
+// File name spelling: every third module uses hyphens, as many real ones do
+static void module_file(size_t i, char *file, size_t size) {
+    module_name(i, file, size);
+    if (i % 3 == 0) {
+        for (char *p = file; *p; p++) {
+            if (*p == '_') *p = '-';
+        }
+    }
+}
+
+// Tree statistics for the "generate" line
+static size_t files_written = 0;
+static size_t bytes_written = 0;
+
+static int make_dirs(const char *path) {
+    char buffer[8192];
+    snprintf(buffer, sizeof(buffer), "%s", path);
+    for (char *p = buffer + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buffer, 0755) != 0 && errno != EEXIST) return 0;
+            *p = '/';
+        }
+    }
+    return mkdir(buffer, 0755) == 0 || errno == EEXIST;
+}
+
+static int make_dirs_below(const char *root, const char *relative) {
+    char path[8192];
+    snprintf(path, sizeof(path), "%s/%s", root, relative);
+    return make_dirs(path);
+}
+
+static FILE *create_file(const char *root, const char *relative) {
+    char path[8192];
+    snprintf(path, sizeof(path), "%s/%s", root, relative);
+    char *slash = strrchr(path, '/');
+    *slash = '\0';
+    if (!make_dirs(path)) return NULL;
+    *slash = '/';
+    files_written++;
+    return fopen(path, "w");
+}
+
+static void put_le(unsigned char *at, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        at[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+// Smallest ELF64 file module_info_read() accepts: header, .modinfo, .shstrtab, section headers
+static void write_module(FILE *fp, const char *name, size_t i) {
+    char modinfo[512];
+    int modinfo_size = snprintf(modinfo, sizeof(modinfo),
+                                "license=GPL%cdescription=Synthetic module %zu%cauthor=bench%c"
+                                "alias=bench:%s%cdepends=%cname=%s%cvermagic=bench SMP mod_unload%c",
+                                0, i, 0, 0, name, 0, 0, name, 0, 0);
+    static const char shstrtab[] = "\0.modinfo\0.shstrtab";  // names at 1 and 10
+    size_t strtab_offset = 64 + (size_t)modinfo_size;
+    size_t shoff = (strtab_offset + sizeof(shstrtab) + 7) & ~(size_t)7;
+    size_t length = shoff + 3 * 64;
+    unsigned char image[1024];
+    memset(image, 0, length);
+
+    memcpy(image, "\177ELF\2\1\1", 7);   // 64-bit, little endian, version 1
+    put_le(image + 0x10, 1, 2);          // ET_REL
+    put_le(image + 0x12, 62, 2);         // EM_X86_64
+    put_le(image + 0x14, 1, 4);
+    put_le(image + 0x28, shoff, 8);
+    put_le(image + 0x34, 64, 2);         // e_ehsize
+    put_le(image + 0x3a, 64, 2);         // e_shentsize
+    put_le(image + 0x3c, 3, 2);          // e_shnum
+    put_le(image + 0x3e, 2, 2);          // e_shstrndx
+    memcpy(image + 64, modinfo, (size_t)modinfo_size);
+    memcpy(image + strtab_offset, shstrtab, sizeof(shstrtab));
+
+    unsigned char *section = image + shoff + 64;  // [0] stays the null section
+    put_le(section, 1, 4);
+    put_le(section + 4, 1, 4);                    // SHT_PROGBITS
+    put_le(section + 0x18, 64, 8);
+    put_le(section + 0x20, (unsigned long long)modinfo_size, 8);
+    section += 64;
+    put_le(section, 10, 4);
+    put_le(section + 4, 3, 4);                    // SHT_STRTAB
+    put_le(section + 0x18, strtab_offset, 8);
+    put_le(section + 0x20, sizeof(shstrtab), 8);
+
+    fwrite(image, 1, length, fp);
+    bytes_written += length;
+}
+
+static const char *kernel_version_for(size_t count, char *buffer, size_t size) {
+    snprintf(buffer, size, "6.1.0-bench-%zu", count);
+    return buffer;
+}
+
+// Build the whole tree for `count` modules below root; 0 on I/O errors
+static int generate_tree(const char *root, size_t count) {
+    char version[64];
+    char relative[512];
+    char name[64];
+    char file[64];
+    kernel_version_for(count, version, sizeof(version));
+
+    FILE *osrelease = create_file(root, "proc/sys/kernel/osrelease");
+    FILE *cmdline = create_file(root, "proc/cmdline");
+    FILE *proc_modules = create_file(root, "proc/modules");
+    snprintf(relative, sizeof(relative), "lib/modules/%s/modules.dep", version);
+    FILE *dep = create_file(root, relative);
+    snprintf(relative, sizeof(relative), "lib/modules/%s/modules.builtin", version);
+    FILE *builtin = create_file(root, relative);
+    snprintf(relative, sizeof(relative), "lib/modules/%s/modules.alias", version);
+    FILE *alias = create_file(root, relative);
+    snprintf(relative, sizeof(relative), "lib/modules/%s/modules.symbols", version);
+    FILE *symbols = create_file(root, relative);
+    FILE *modprobe = create_file(root, "etc/modprobe.d/bench.conf");
+    int ok = osrelease && cmdline && proc_modules && dep && builtin && alias && symbols && modprobe;
+
+    if (ok) {
+        fprintf(osrelease, "%s\n", version);
+        fprintf(cmdline, "BOOT_IMAGE=/vmlinuz-%s root=/dev/sda1 ro quiet\n", version);
+        fprintf(alias, "# Aliases extracted from modules themselves.\n");
+        fprintf(modprobe, "blacklist %s\ninstall %s /bin/false\nalias bench-sound %s\n",
+                "usb_00003", "net_00004", "snd_hda_codec_00008");
+    }
+
+    for (size_t i = 0; ok && i < count; i++) {
+        const char *dir = families[i % FAMILY_COUNT].dir;
+        module_name(i, name, sizeof(name));
+        module_file(i, file, sizeof(file));
+
+        if (MODULE_IS_BUILTIN(i)) {
+            fprintf(builtin, "kernel/%s/%s.ko\n", dir, file);
+            if (i % 20 == 1) {
+                // Built-ins with parameters show up in sysfs, without initstate
+                snprintf(relative, sizeof(relative), "sys/module/%s", name);
+                ok = make_dirs_below(root, relative);
+            }
+            continue;
+        }
+
+        snprintf(relative, sizeof(relative), "lib/modules/%s/kernel/%s/%s.ko", version, dir, file);
+        FILE *ko = create_file(root, relative);
+        if (ko == NULL) {
+            ok = 0;
+            break;
+        }
+        write_module(ko, name, i);
+        fclose(ko);
+
+        // Depends on the previous file module of the family, if any
+        size_t previous = i - FAMILY_COUNT;
+        if (i >= FAMILY_COUNT && !MODULE_IS_BUILTIN(previous)) {
+            char previous_file[64];
+            module_file(previous, previous_file, sizeof(previous_file));
+            fprintf(dep, "kernel/%s/%s.ko: kernel/%s/%s.ko\n", dir, file, dir, previous_file);
+        } else {
+            fprintf(dep, "kernel/%s/%s.ko:\n", dir, file);
+        }
+        fprintf(alias, "alias pci:v%08zXd*sv*sd*bc*sc*i* %s\n", 0x8086 + (i >> 4), name);
+        fprintf(alias, "alias bench:%s %s\n", name, name);
+        // Written with hyphens as depmod does; looked up normalized
+        fprintf(alias, "alias char-major-%zu-%zu %s\n", 10 + (i >> 8), i & 0xFF, name);
+        for (int s = 0; s < 3; s++) {
+            fprintf(symbols, "alias symbol:%s_export%d %s\n", name, s, name);
+        }
+
+        if (MODULE_IS_LOADED(i)) {
+            fprintf(proc_modules, "%s %zu 0 - Live 0xffffffffc%07zx\n", name, 16384 + (i % 64) * 4096, i * 4096);
+            snprintf(relative, sizeof(relative), "sys/module/%s/initstate", name);
+            FILE *initstate = create_file(root, relative);
+            if (initstate == NULL) {
+                ok = 0;
+                break;
+            }
+            fputs("live\n", initstate);
+            fclose(initstate);
+        }
+    }
+
+    FILE *all[] = { osrelease, cmdline, proc_modules, dep, builtin, alias, symbols, modprobe };
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (all[i] != NULL) {
+            bytes_written += (size_t)ftell(all[i]);
+            if (fclose(all[i]) != 0) ok = 0;
+        }
+    }
+    return ok;
+}
+
+// A batch of `size` names drawn from a tree of `count` modules (or none of them), as a config document
+static char *generate_batch(size_t count, size_t size, int missing) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON *modules = cJSON_AddArrayToObject(root, "modules");
+    char name[64];
+
+    for (size_t n = 0; n < size; n++) {
+        size_t i = (size_t)(rng_next() % count);
+        unsigned kind = (unsigned)(rng_next() % 20);
+        if (missing) {
+            // Falls through every strategy, modinfo included
+            snprintf(name, sizeof(name), "missing_%05zu", n);
+            cJSON_AddItemToArray(modules, cJSON_CreateString(name));
+        } else if (kind == 1) {
+            // Found through its second alias
+            cJSON *entry = cJSON_CreateObject();
+            snprintf(name, sizeof(name), "old_name_%05zu", n);
+            cJSON_AddStringToObject(entry, "name", name);
+            cJSON *aliases = cJSON_AddArrayToObject(entry, "aliases");
+            module_name(i, name, sizeof(name));
+            cJSON_AddItemToArray(aliases, cJSON_CreateString(name));
+            cJSON_AddItemToArray(modules, entry);
+        } else if (kind == 3 && !MODULE_IS_BUILTIN(i)) {
+            // A modules.alias name with hyphens
+            snprintf(name, sizeof(name), "char-major-%zu-%zu", 10 + (i >> 8), i & 0xFF);
+            cJSON_AddItemToArray(modules, cJSON_CreateString(name));
+        } else if (kind == 2) {
+            // A family: any module with the same first three digits
+            module_name(i, name, sizeof(name));
+            strcpy(name + strlen(name) - 2, "*");
+            cJSON_AddItemToArray(modules, cJSON_CreateString(name));
+        } else {
+            // Hyphen or underscore spelling, whichever the file doesn't use
+            module_name(i, name, sizeof(name));
+            if (kind % 2) {
+                for (char *p = name; *p; p++) {
+                    if (*p == '_') *p = '-';
+                }
+            }
+            cJSON_AddItemToArray(modules, cJSON_CreateString(name));
+        }
+    }
+
+    char *text = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return text;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return usage.ru_maxrss;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+// The checker prints a report per call; send it to /dev/null while timing
+static int silence_stdout(void) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    return saved;
+}
+
+static void restore_stdout(int saved) {
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+static void bench_batch(const char *root, size_t count, size_t size, int missing, double min_seconds) {
+    char *config = generate_batch(count, size, missing);
+    size_t iterations = 0;
+
+    // Cold: every index and cache is dropped with the root
+    module_check_set_root(root);
+    int saved = silence_stdout();
+    double start = now_ns();
+    check_modules_from_json(config);
+    double cold = now_ns() - start;
+
+    // Warm: repeat until the case has run long enough
+    double elapsed = 0;
+    start = now_ns();
+    while (iterations == 0 || elapsed < min_seconds * 1e9) {
+        check_modules_from_json(config);
+        iterations++;
+        elapsed = now_ns() - start;
+    }
+    restore_stdout(saved);
+
+    double ns_per_batch = elapsed / (double)iterations;
+    printf("{\"modules\": %zu, \"case\": \"%s\", \"batch\": %zu, \"iterations\": %zu, \"cold_ms\": %.3f, "
+           "\"ms_per_batch\": %.3f, \"us_per_module\": %.2f, \"peak_rss_kb\": %ld}\n",
+           count, missing ? "missing" : "found", size, iterations, cold / 1e6, ns_per_batch / 1e6, ns_per_batch / 1e3 / (double)size, peak_rss_kb());
+    fflush(stdout);
+    free(config);
+}
+
+int main(int argc, char *argv[]) {
+    double min_seconds = 0.5;
+    const char *keep_dir = NULL;
+    int arg = 1;
+
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-t") == 0) {
+            min_seconds = strtod(argv[arg + 1], NULL);
+        } else if (strcmp(argv[arg], "-d") == 0) {
+            keep_dir = argv[arg + 1];
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (min_seconds <= 0 || (arg < argc && argv[arg][0] == '-')) {
+        fprintf(stderr, "Usage: %s [-t seconds_per_case] [-d tree_dir] [module_count ...]\n", argv[0]);
+        return 1;
+    }
+
+    size_t default_counts[] = { 5000, 20000, 50000 };
+    size_t count_total = (arg < argc) ? (size_t)(argc - arg) : sizeof(default_counts) / sizeof(default_counts[0]);
+    size_t batch_sizes[] = { 1, 10, 100, 1000 };
+
+    char temp_dir[] = "/tmp/bench_modulecheck.XXXXXX";
+    const char *base = keep_dir;
+    if (base == NULL) {
+        base = mkdtemp(temp_dir);
+        if (base == NULL) {
+            perror("mkdtemp");
+            return 1;
+        }
+    }
+
+    int status = 0;
+    for (size_t c = 0; c < count_total; c++) {
+        size_t count = (arg < argc) ? (size_t)strtoul(argv[arg + (int)c], NULL, 10) : default_counts[c];
+        if (count == 0) {
+            continue;
+        }
+
+        char root[4096];
+        snprintf(root, sizeof(root), "%s/tree-%zu", base, count);
+        files_written = 0;
+        bytes_written = 0;
+        double start = now_ns();
+        if (!generate_tree(root, count)) {
+            fprintf(stderr, "Cannot generate tree in %s\n", root);
+            status = 1;
+            break;
+        }
+        printf("{\"generate\": \"%s\", \"modules\": %zu, \"files\": %zu, \"bytes\": %zu, \"ms\": %.1f}\n",
+               root, count, files_written, bytes_written, (now_ns() - start) / 1e6);
+        fflush(stdout);
+
+        for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+            bench_batch(root, count, batch_sizes[b], 0, min_seconds);
+        }
+        bench_batch(root, count, 10, 1, min_seconds);
+    }
+
+    module_check_set_root(NULL);
+    if (keep_dir == NULL) {
+        nftw(base, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    return status;
+}
@@ -28,6 +28,11 @@
 #define _CRT_SECURE_NO_DEPRECATE
 #endif
 
+/* clock_gettime for the phase timers of cJSON_SetStats */
+#if defined(CJSON_INSTRUMENTATION) && !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #ifdef __GNUC__
 #pragma GCC visibility push(default)
 #endif
@@ -49,6 +54,15 @@
 #include <locale.h>
 #endif
 
+#ifdef CJSON_INSTRUMENTATION
+#include <time.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define CJSON_SSE2
+#endif
+
 #if defined(_MSC_VER)
 #pragma warning (pop)
 #endif
@@ -85,6 +99,11 @@
 #endif
 #endif
 
+/* limits of the 64 bit integer types, LLONG_MAX is not available in ANSI C */
+#define CJSON_UINT64_MAX (~(cJSON_uint64)0)
+#define CJSON_INT64_MAX ((cJSON_int64)(CJSON_UINT64_MAX >> 1))
+#define CJSON_INT64_MIN (-CJSON_INT64_MAX - 1)
+
 typedef struct {
     const unsigned char *json;
     size_t position;
@@ -116,6 +135,93 @@ CJSON_PUBLIC(double) cJSON_GetNumberValue(const cJSON * const item)
     return item->valuedouble;
 }
 
+/* check if valueint64 holds the exact value of the number.
+ * valuedouble is compared as well, so writes to valuedouble that bypass the API fall back to the double */
+static cJSON_bool number_is_integer(const cJSON * const item)
+{
+    if (!(item->type & cJSON_NumberIsInteger))
+    {
+        return false;
+    }
+
+    if (item->type & cJSON_NumberIsUnsigned)
+    {
+        return item->valuedouble == (double)(cJSON_uint64)item->valueint64;
+    }
+
+    return item->valuedouble == (double)item->valueint64;
+}
+
+CJSON_PUBLIC(cJSON_int64) cJSON_GetInt64Value(const cJSON * const item)
+{
+    double number = 0;
+
+    if (!cJSON_IsNumber(item))
+    {
+        return 0;
+    }
+
+    if (number_is_integer(item))
+    {
+        if (item->type & cJSON_NumberIsUnsigned)
+        {
+            return CJSON_INT64_MAX;
+        }
+
+        return item->valueint64;
+    }
+
+    /* use saturation in case of overflow */
+    number = item->valuedouble;
+    if (isnan(number))
+    {
+        return 0;
+    }
+    if (number >= (double)CJSON_INT64_MAX)
+    {
+        return CJSON_INT64_MAX;
+    }
+    if (number <= (double)CJSON_INT64_MIN)
+    {
+        return CJSON_INT64_MIN;
+    }
+
+    return (cJSON_int64)number;
+}
+
+CJSON_PUBLIC(cJSON_uint64) cJSON_GetUInt64Value(const cJSON * const item)
+{
+    double number = 0;
+
+    if (!cJSON_IsNumber(item))
+    {
+        return 0;
+    }
+
+    if (number_is_integer(item))
+    {
+        if (!(item->type & cJSON_NumberIsUnsigned) && (item->valueint64 < 0))
+        {
+            return 0;
+        }
+
+        return (cJSON_uint64)item->valueint64;
+    }
+
+    /* use saturation in case of overflow */
+    number = item->valuedouble;
+    if (isnan(number) || (number <= 0))
+    {
+        return 0;
+    }
+    if (number >= (double)CJSON_UINT64_MAX)
+    {
+        return CJSON_UINT64_MAX;
+    }
+
+    return (cJSON_uint64)number;
+}
+
 /* This is a safeguard to prevent copy-pasters from using incompatible C and header files */
 #if (CJSON_VERSION_MAJOR != 1) || (CJSON_VERSION_MINOR != 7) || (CJSON_VERSION_PATCH != 19)
     #error cJSON.h and cJSON.c have different versions. Make sure that both have the same.
@@ -183,7 +289,82 @@ static void * CJSON_CDECL internal_realloc(void *pointer, size_t size)
 /* strlen of character literals resolved at compile time */
 #define static_strlen(string_literal) (sizeof(string_literal) - sizeof(""))
 
+#ifdef CJSON_INSTRUMENTATION
+#if defined(_MSC_VER)
+#define CJSON_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define CJSON_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_THREADS__)
+#define CJSON_THREAD_LOCAL _Thread_local
+#else
+#define CJSON_THREAD_LOCAL /* no thread local storage, all threads share one target */
+#endif
+
+static CJSON_THREAD_LOCAL cJSON_Stats *current_stats = NULL;
+
+#define stats_add(field, amount) do { if (current_stats != NULL) { current_stats->field += (amount); } } while (0)
+
+static double stats_now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* the allocator chosen with cJSON_InitHooks, global_hooks counts and forwards to it */
+static internal_hooks counted_hooks = { internal_malloc, internal_free, internal_realloc };
+
+static void * CJSON_CDECL counting_allocate(size_t size)
+{
+    stats_add(allocations, 1);
+    stats_add(allocated_bytes, size);
+    return counted_hooks.allocate(size);
+}
+
+static void CJSON_CDECL counting_deallocate(void *pointer)
+{
+    stats_add(deallocations, 1);
+    counted_hooks.deallocate(pointer);
+}
+
+static void * CJSON_CDECL counting_reallocate(void *pointer, size_t size)
+{
+    stats_add(allocations, 1);
+    stats_add(allocated_bytes, size);
+    return counted_hooks.reallocate(pointer, size);
+}
+
+static internal_hooks global_hooks = { counting_allocate, counting_deallocate, counting_reallocate };
+
+/* route the allocator that was just set up in global_hooks through the counters */
+static void count_global_hooks(void)
+{
+    counted_hooks = global_hooks;
+    global_hooks.allocate = counting_allocate;
+    global_hooks.deallocate = counting_deallocate;
+    global_hooks.reallocate = (counted_hooks.reallocate != NULL) ? counting_reallocate : NULL;
+}
+#else
+#define stats_add(field, amount)
+
 static internal_hooks global_hooks = { internal_malloc, internal_free, internal_realloc };
+#endif
+
+CJSON_PUBLIC(cJSON_Stats *) cJSON_SetStats(cJSON_Stats *stats)
+{
+#ifdef CJSON_INSTRUMENTATION
+    cJSON_Stats *previous = current_stats;
+    current_stats = stats;
+    return previous;
+#else
+    (void)stats;
+    return NULL;
+#endif
+}
 
 static unsigned char* cJSON_strdup(const unsigned char* string, const internal_hooks * const hooks)
 {
@@ -202,6 +383,7 @@ static unsigned char* cJSON_strdup(const unsigned char* string, const internal_h
         return NULL;
     }
     memcpy(copy, string, length);
+    stats_add(strings_copied, 1);
 
     return copy;
 }
@@ -214,6 +396,9 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
         global_hooks.allocate = malloc;
         global_hooks.deallocate = free;
         global_hooks.reallocate = realloc;
+#ifdef CJSON_INSTRUMENTATION
+        count_global_hooks();
+#endif
         return;
     }
 
@@ -235,6 +420,9 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
     {
         global_hooks.reallocate = realloc;
     }
+#ifdef CJSON_INSTRUMENTATION
+    count_global_hooks();
+#endif
 }
 
 /* Internal constructor. */
@@ -244,11 +432,39 @@ static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
     if (node)
     {
         memset(node, '\0', sizeof(cJSON));
+        stats_add(nodes_created, 1);
     }
 
     return node;
 }
 
+/* Flag an item and all its parents as changed for cJSON_PrintIncremental.
+ * Parents of a dirty item are always dirty, so the walk can stop at the first one that already is. */
+static void mark_dirty(cJSON *item)
+{
+    while ((item != NULL) && !(item->type & cJSON_PrintIsDirty))
+    {
+        item->type |= cJSON_PrintIsDirty;
+        item = item->parent;
+    }
+}
+
+/* link item into parent, its previous print span is meaningless there */
+static void adopt_item(cJSON * const parent, cJSON * const item)
+{
+    item->parent = parent;
+    item->type &= ~cJSON_PrintIsCached;
+    mark_dirty(parent);
+}
+
+CJSON_PUBLIC(void) cJSON_MarkDirty(cJSON *item)
+{
+    if ((item != NULL) && !(item->type & cJSON_TreeIsFrozen))
+    {
+        mark_dirty(item);
+    }
+}
+
 /* Delete a cJSON structure. */
 CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
 {
@@ -270,6 +486,10 @@ CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
             global_hooks.deallocate(item->string);
             item->string = NULL;
         }
+        if (item->index != NULL)
+        {
+            global_hooks.deallocate(item->index);
+        }
         global_hooks.deallocate(item);
         item = next;
     }
@@ -293,6 +513,8 @@ typedef struct
     size_t offset;
     size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
     internal_hooks hooks;
+    cJSON_bool validate_utf8; /* reject strings that aren't valid UTF-8 */
+    cJSON *recycled; /* nodes of a previous tree handed to cJSON_ParseInto, in allocation order */
 } parse_buffer;
 
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
@@ -303,12 +525,175 @@ typedef struct
 /* get a pointer to the buffer at the position */
 #define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
+/* Take apart a tree for cJSON_ParseInto. The nodes are returned in pre-order, which is the order
+ * the parser allocates them in, so a message of the same shape gets each node (and its name and
+ * string buffers) back in the same place. Buffers the tree doesn't own are dropped. */
+static cJSON *flatten_for_recycling(cJSON *root)
+{
+    cJSON *pending = root;
+    cJSON *head = NULL;
+    cJSON *tail = NULL;
+
+    root->next = NULL;
+    while (pending != NULL)
+    {
+        cJSON *node = pending;
+        char *spare_string = NULL;
+        char *spare_valuestring = NULL;
+        pending = node->next;
+
+        if (!(node->type & cJSON_IsReference))
+        {
+            if (node->child != NULL)
+            {
+                /* visit the children before the rest of the pending nodes */
+                cJSON *last_child = node->child;
+                while (last_child->next != NULL)
+                {
+                    last_child = last_child->next;
+                }
+                last_child->next = pending;
+                pending = node->child;
+            }
+            spare_valuestring = node->valuestring;
+        }
+        if (!(node->type & cJSON_StringIsConst))
+        {
+            spare_string = node->string;
+        }
+        if (node->index != NULL)
+        {
+            global_hooks.deallocate(node->index);
+        }
+
+        memset(node, '\0', sizeof(cJSON));
+        node->string = spare_string;
+        node->valuestring = spare_valuestring;
+
+        if (tail == NULL)
+        {
+            head = node;
+        }
+        else
+        {
+            tail->next = node;
+        }
+        tail = node;
+    }
+
+    return head;
+}
+
+/* get a node for the parser, from the recycled tree if there is one left */
+static cJSON *new_parse_item(parse_buffer * const input_buffer)
+{
+    cJSON *node = input_buffer->recycled;
+    if (node == NULL)
+    {
+        return cJSON_New_Item(&(input_buffer->hooks));
+    }
+
+    input_buffer->recycled = node->next;
+    node->next = NULL;
+
+    return node;
+}
+
+/* store an exact integer in item, valuedouble and the saturated valueint are derived from it */
+static void set_integer(cJSON * const item, const cJSON_int64 value, const cJSON_bool is_unsigned)
+{
+    item->valueint64 = value;
+    item->type &= ~(cJSON_NumberIsInteger | cJSON_NumberIsUnsigned);
+    item->type |= cJSON_NumberIsInteger;
+
+    if (is_unsigned)
+    {
+        item->type |= cJSON_NumberIsUnsigned;
+        item->valuedouble = (double)(cJSON_uint64)value;
+        item->valueint = INT_MAX;
+        return;
+    }
+
+    item->valuedouble = (double)value;
+
+    /* use saturation in case of overflow */
+    if (value >= INT_MAX)
+    {
+        item->valueint = INT_MAX;
+    }
+    else if (value <= INT_MIN)
+    {
+        item->valueint = INT_MIN;
+    }
+    else
+    {
+        item->valueint = (int)value;
+    }
+}
+
+/* Fast path for numbers without fraction or exponent that fit into 64 bits.
+ * Returns false without consuming input if the number has to go through strtod. */
+static cJSON_bool parse_integer(cJSON * const item, parse_buffer * const input_buffer)
+{
+    const unsigned char *number = buffer_at_offset(input_buffer);
+    size_t length = input_buffer->length - input_buffer->offset;
+    cJSON_uint64 value = 0;
+    cJSON_bool negative = false;
+    size_t i = 0;
+
+    if ((length > 0) && (number[0] == '-'))
+    {
+        negative = true;
+        i++;
+    }
+
+    if ((i >= length) || (number[i] < '0') || (number[i] > '9'))
+    {
+        return false;
+    }
+
+    for (; (i < length) && (number[i] >= '0') && (number[i] <= '9'); i++)
+    {
+        unsigned int digit = (unsigned int)(number[i] - '0');
+        if (value > ((CJSON_UINT64_MAX - digit) / 10))
+        {
+            return false; /* doesn't fit into 64 bits */
+        }
+        value = (value * 10) + digit;
+    }
+
+    if ((i < length) && ((number[i] == '.') || (number[i] == 'e') || (number[i] == 'E')))
+    {
+        return false; /* not an integer */
+    }
+
+    if (negative)
+    {
+        if (value > ((cJSON_uint64)CJSON_INT64_MAX + 1))
+        {
+            return false;
+        }
+        /* avoid overflowing on CJSON_INT64_MIN */
+        set_integer(item, (value == 0) ? 0 : (-(cJSON_int64)(value - 1) - 1), false);
+    }
+    else
+    {
+        set_integer(item, (cJSON_int64)value, value > (cJSON_uint64)CJSON_INT64_MAX);
+    }
+
+    item->type = cJSON_Number | (item->type & (cJSON_NumberIsInteger | cJSON_NumberIsUnsigned));
+    input_buffer->offset += i;
+
+    return true;
+}
+
 /* Parse the input text to generate a number, and populate the result into item. */
 static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
 {
     double number = 0;
     unsigned char *after_end = NULL;
     unsigned char *number_c_string;
+    unsigned char number_stack_buffer[64];
     unsigned char decimal_point = get_decimal_point();
     size_t i = 0;
     size_t number_string_length = 0;
@@ -319,6 +704,11 @@ static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_bu
         return false;
     }
 
+    if (parse_integer(item, input_buffer))
+    {
+        return true;
+    }
+
     /* copy the number into a temporary buffer and replace '.' with the decimal point
      * of the current locale (for strtod)
      * This also takes care of '\0' not necessarily being available for marking the end of the input */
@@ -353,11 +743,18 @@ static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_bu
         }
     }
 loop_end:
-    /* malloc for temporary buffer, add 1 for '\0' */
-    number_c_string = (unsigned char *) input_buffer->hooks.allocate(number_string_length + 1);
-    if (number_c_string == NULL)
+    /* short numbers fit on the stack, otherwise malloc a temporary buffer, add 1 for '\0' */
+    if (number_string_length < sizeof(number_stack_buffer))
+    {
+        number_c_string = number_stack_buffer;
+    }
+    else
     {
-        return false; /* allocation failure */
+        number_c_string = (unsigned char *) input_buffer->hooks.allocate(number_string_length + 1);
+        if (number_c_string == NULL)
+        {
+            return false; /* allocation failure */
+        }
     }
 
     memcpy(number_c_string, buffer_at_offset(input_buffer), number_string_length);
@@ -379,7 +776,10 @@ loop_end:
     if (number_c_string == after_end)
     {
         /* free the temporary buffer */
-        input_buffer->hooks.deallocate(number_c_string);
+        if (number_c_string != number_stack_buffer)
+        {
+            input_buffer->hooks.deallocate(number_c_string);
+        }
         return false; /* parse_error */
     }
 
@@ -403,13 +803,24 @@ loop_end:
 
     input_buffer->offset += (size_t)(after_end - number_c_string);
     /* free the temporary buffer */
-    input_buffer->hooks.deallocate(number_c_string);
+    if (number_c_string != number_stack_buffer)
+    {
+        input_buffer->hooks.deallocate(number_c_string);
+    }
     return true;
 }
 
 /* don't ask me, but the original cJSON_SetNumberValue returns an integer or double */
 CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number)
 {
+    if (object->type & cJSON_TreeIsFrozen)
+    {
+        return object->valuedouble;
+    }
+
+    object->type &= ~(cJSON_NumberIsInteger | cJSON_NumberIsUnsigned);
+    mark_dirty(object);
+
     if (number >= INT_MAX)
     {
         object->valueint = INT_MAX;
@@ -426,6 +837,23 @@ CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number)
     return object->valuedouble = number;
 }
 
+CJSON_PUBLIC(cJSON_int64) cJSON_SetInt64Value(cJSON *object, cJSON_int64 number)
+{
+    if ((object == NULL) || !cJSON_IsNumber(object))
+    {
+        return number;
+    }
+    if (object->type & cJSON_TreeIsFrozen)
+    {
+        return cJSON_GetInt64Value(object);
+    }
+
+    set_integer(object, number, false);
+    mark_dirty(object);
+
+    return number;
+}
+
 /* Note: when passing a NULL valuestring, cJSON_SetValuestring treats this as an error and return NULL */
 CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
 {
@@ -433,7 +861,7 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
     size_t v1_len;
     size_t v2_len;
     /* if object's type is not cJSON_String or is cJSON_IsReference, it should not set valuestring */
-    if ((object == NULL) || !(object->type & cJSON_String) || (object->type & cJSON_IsReference))
+    if ((object == NULL) || !(object->type & cJSON_String) || (object->type & (cJSON_IsReference | cJSON_TreeIsFrozen)))
     {
         return NULL;
     }
@@ -454,6 +882,7 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
             return NULL;
         }
         strcpy(object->valuestring, valuestring);
+        mark_dirty(object);
         return object->valuestring;
     }
     copy = (char*) cJSON_strdup((const unsigned char*)valuestring, &global_hooks);
@@ -466,10 +895,18 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
         cJSON_free(object->valuestring);
     }
     object->valuestring = copy;
+    mark_dirty(object);
 
     return copy;
 }
 
+/* object member waiting to be printed in sorted order */
+typedef struct
+{
+    const cJSON *item;
+    size_t position; /* position in the object, keeps duplicate keys in a stable order */
+} sorted_member;
+
 typedef struct
 {
     unsigned char *buffer;
@@ -479,6 +916,13 @@ typedef struct
     cJSON_bool noalloc;
     cJSON_bool format; /* is this print a formatted print */
     internal_hooks hooks;
+    cJSON_bool canonical; /* sorted keys, shortest numbers and no whitespace */
+    const cJSON_PrintOptions *options; /* layout of a cJSON_PrintWithOptions print, NULL otherwise */
+    size_t line_start; /* offset behind the last newline, to measure lines against options->max_line_width */
+    /* scratch space for sorting object members, shared as a stack by all objects of one print */
+    sorted_member *members;
+    size_t members_length;
+    size_t members_used;
 } printbuffer;
 
 /* realloc printbuffer if necessary to have at least "needed" bytes more */
@@ -532,6 +976,7 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
         newsize = needed * 2;
     }
 
+    stats_add(print_buffer_growths, 1);
     if (p->hooks.reallocate != NULL)
     {
         /* reallocate with realloc if available */
@@ -580,6 +1025,43 @@ static void update_offset(printbuffer * const buffer)
     buffer->offset += strlen((const char*)buffer_pointer);
 }
 
+/* Write count indentation characters. They come from a precomputed run with memcpy instead of being stored one by one. */
+static void copy_indent(unsigned char *output, size_t count, const unsigned char character)
+{
+    static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+    static const char spaces[] = "                                                                ";
+    const char *run = (character == '\t') ? tabs : spaces;
+    const size_t run_length = (character == '\t') ? static_strlen(tabs) : static_strlen(spaces);
+
+    while (count > 0)
+    {
+        size_t chunk = (count < run_length) ? count : run_length;
+        memcpy(output, run, chunk);
+        output += chunk;
+        count -= chunk;
+    }
+}
+
+/* start a new line indented to the given depth, according to the print options */
+static cJSON_bool print_newline(printbuffer * const output_buffer, const size_t depth)
+{
+    const cJSON_PrintOptions *options = output_buffer->options;
+    size_t count = depth * (size_t)((options->indent_width > 0) ? options->indent_width : 0);
+    unsigned char *output_pointer = ensure(output_buffer, count + 1);
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+
+    *output_pointer++ = '\n';
+    copy_indent(output_pointer, count, options->use_tabs ? '\t' : ' ');
+    output_pointer[count] = '\0';
+    output_buffer->offset += count + 1;
+    output_buffer->line_start = output_buffer->offset - count;
+
+    return true;
+}
+
 /* securely comparison of floating-point variables */
 static cJSON_bool compare_double(double a, double b)
 {
@@ -587,18 +1069,161 @@ static cJSON_bool compare_double(double a, double b)
     return (fabs(a - b) <= maxVal * DBL_EPSILON);
 }
 
-/* Render the number nicely from the given item into a string. */
-static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
+/* Render an integer into buffer without going through sprintf. Returns the number of characters written. */
+static int format_integer(unsigned char * const buffer, const cJSON_int64 value, const cJSON_bool is_unsigned)
 {
-    unsigned char *output_pointer = NULL;
-    double d = item->valuedouble;
+    unsigned char digits[20];
+    cJSON_uint64 magnitude = (cJSON_uint64)value;
     int length = 0;
-    size_t i = 0;
-    unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
-    unsigned char decimal_point = get_decimal_point();
-    double test = 0.0;
+    int count = 0;
 
-    if (output_buffer == NULL)
+    if (!is_unsigned && (value < 0))
+    {
+        buffer[length++] = '-';
+        magnitude = (cJSON_uint64)0 - magnitude;
+    }
+
+    do
+    {
+        digits[count++] = (unsigned char)('0' + (magnitude % 10));
+        magnitude /= 10;
+    }
+    while (magnitude > 0);
+
+    while (count > 0)
+    {
+        buffer[length++] = digits[--count];
+    }
+    buffer[length] = '\0';
+
+    return length;
+}
+
+/* Render a double in the shortest form that reads back to the same value,
+ * using the notation of ECMAScript's Number.prototype.toString (RFC 8785). */
+static int format_shortest_double(unsigned char * const buffer, const double d)
+{
+    unsigned char scientific[32];
+    unsigned char digits[18];
+    size_t digit_count = 0;
+    int exponent = 0;
+    int precision = 0;
+    int length = 0;
+    int i = 0;
+    double test = 0.0;
+    const unsigned char *pointer = NULL;
+
+    if (d == 0)
+    {
+        /* this also turns -0 into 0 */
+        buffer[0] = '0';
+        buffer[1] = '\0';
+        return 1;
+    }
+
+    for (precision = 1; precision <= 17; precision++)
+    {
+        sprintf((char*)scientific, "%1.*e", precision - 1, d);
+        if ((sscanf((char*)scientific, "%lg", &test) == 1) && (test == d))
+        {
+            break;
+        }
+    }
+
+    /* split "-d.ddde+xx" into its digits and the decimal exponent */
+    pointer = scientific;
+    if (*pointer == '-')
+    {
+        buffer[length++] = '-';
+        pointer++;
+    }
+    for (; (*pointer != 'e') && (*pointer != '\0'); pointer++)
+    {
+        if ((*pointer >= '0') && (*pointer <= '9') && (digit_count < sizeof(digits)))
+        {
+            digits[digit_count++] = *pointer;
+        }
+    }
+    if (*pointer == 'e')
+    {
+        exponent = atoi((const char*)pointer + 1);
+    }
+    while ((digit_count > 1) && (digits[digit_count - 1] == '0'))
+    {
+        digit_count--;
+    }
+
+    /* position of the decimal point relative to the first digit */
+    exponent++;
+    if (((int)digit_count <= exponent) && (exponent <= 21))
+    {
+        /* integer: digits followed by zeros */
+        for (i = 0; i < (int)digit_count; i++)
+        {
+            buffer[length++] = digits[i];
+        }
+        for (; i < exponent; i++)
+        {
+            buffer[length++] = '0';
+        }
+    }
+    else if ((exponent > 0) && (exponent <= 21))
+    {
+        /* decimal point inside the digits */
+        for (i = 0; i < (int)digit_count; i++)
+        {
+            if (i == exponent)
+            {
+                buffer[length++] = '.';
+            }
+            buffer[length++] = digits[i];
+        }
+    }
+    else if ((exponent > -6) && (exponent <= 0))
+    {
+        /* small number: leading zeros after the decimal point */
+        buffer[length++] = '0';
+        buffer[length++] = '.';
+        for (i = exponent; i < 0; i++)
+        {
+            buffer[length++] = '0';
+        }
+        for (i = 0; i < (int)digit_count; i++)
+        {
+            buffer[length++] = digits[i];
+        }
+    }
+    else
+    {
+        /* exponential notation */
+        buffer[length++] = digits[0];
+        if (digit_count > 1)
+        {
+            buffer[length++] = '.';
+            for (i = 1; i < (int)digit_count; i++)
+            {
+                buffer[length++] = digits[i];
+            }
+        }
+        length += sprintf((char*)buffer + length, "e%c%d", (exponent - 1 < 0) ? '-' : '+', (exponent - 1 < 0) ? (1 - exponent) : (exponent - 1));
+    }
+    buffer[length] = '\0';
+
+    return length;
+}
+
+/* Render the number nicely from the given item into a string. */
+static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output_pointer = NULL;
+    double d = item->valuedouble;
+    int length = 0;
+    size_t i = 0;
+    unsigned char number_buffer[32] = {0}; /* temporary buffer to print the number into */
+    unsigned char decimal_point = get_decimal_point();
+    double test = 0.0;
+
+    if (output_buffer == NULL)
     {
         return false;
     }
@@ -608,9 +1233,18 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     {
         length = sprintf((char*)number_buffer, "null");
     }
+    else if (number_is_integer(item))
+    {
+        /* exact integers don't need the round trip check below */
+        length = format_integer(number_buffer, item->valueint64, (item->type & cJSON_NumberIsUnsigned) != 0);
+    }
+    else if (output_buffer->canonical)
+    {
+        length = format_shortest_double(number_buffer, d);
+    }
     else if(d == (double)item->valueint)
     {
-        length = sprintf((char*)number_buffer, "%d", item->valueint);
+        length = format_integer(number_buffer, (cJSON_int64)item->valueint, false);
     }
     else
     {
@@ -657,40 +1291,37 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     return true;
 }
 
-/* parse 4 digit hexadecimal number */
+/* value of a hexadecimal digit, 16 if it isn't one */
+static unsigned int hex_digit(const unsigned char digit)
+{
+    if ((unsigned int)(digit - '0') < 10)
+    {
+        return (unsigned int)(digit - '0');
+    }
+    /* setting 0x20 maps upper case letters to lower case */
+    if ((unsigned int)((digit | 0x20) - 'a') < 6)
+    {
+        return (unsigned int)((digit | 0x20) - 'a') + 10;
+    }
+
+    return 16;
+}
+
+/* parse 4 digit hexadecimal number, returns a value above 0xFFFF if a digit is invalid */
 static unsigned parse_hex4(const unsigned char * const input)
 {
-    unsigned int h = 0;
-    size_t i = 0;
+    unsigned int digit0 = hex_digit(input[0]);
+    unsigned int digit1 = hex_digit(input[1]);
+    unsigned int digit2 = hex_digit(input[2]);
+    unsigned int digit3 = hex_digit(input[3]);
 
-    for (i = 0; i < 4; i++)
+    /* valid digits never have bit 4 set */
+    if ((digit0 | digit1 | digit2 | digit3) & 16)
     {
-        /* parse digit */
-        if ((input[i] >= '0') && (input[i] <= '9'))
-        {
-            h += (unsigned int) input[i] - '0';
-        }
-        else if ((input[i] >= 'A') && (input[i] <= 'F'))
-        {
-            h += (unsigned int) 10 + input[i] - 'A';
-        }
-        else if ((input[i] >= 'a') && (input[i] <= 'f'))
-        {
-            h += (unsigned int) 10 + input[i] - 'a';
-        }
-        else /* invalid */
-        {
-            return 0;
-        }
-
-        if (i < 3)
-        {
-            /* shift left to make place for the next nibble */
-            h = h << 4;
-        }
+        return 0x10000;
     }
 
-    return h;
+    return (digit0 << 12) | (digit1 << 8) | (digit2 << 4) | digit3;
 }
 
 /* converts a UTF-16 literal to UTF-8
@@ -715,7 +1346,7 @@ static unsigned char utf16_literal_to_utf8(const unsigned char * const input_poi
     first_code = parse_hex4(first_sequence + 2);
 
     /* check that the code is valid */
-    if (((first_code >= 0xDC00) && (first_code <= 0xDFFF)))
+    if ((first_code > 0xFFFF) || ((first_code >= 0xDC00) && (first_code <= 0xDFFF)))
     {
         goto fail;
     }
@@ -815,6 +1446,178 @@ fail:
     return 0;
 }
 
+/* Count the bytes at input that need no attention while looking for the end of a string:
+ * anything but '"', '\\' and, if stop_at_non_ascii is set, bytes of multibyte UTF-8 sequences. */
+static size_t skip_plain_string_bytes(const unsigned char * const input, const size_t length, const cJSON_bool stop_at_non_ascii)
+{
+    size_t i = 0;
+
+#ifdef CJSON_SSE2
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; (i + 16) <= length; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(input + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if (stop_at_non_ascii)
+        {
+            /* the sign bits are the non ASCII bytes */
+            mask |= _mm_movemask_epi8(chunk);
+        }
+        if (mask != 0)
+        {
+            while (!(mask & 1))
+            {
+                mask >>= 1;
+                i++;
+            }
+            return i;
+        }
+    }
+#else
+    /* check eight bytes at a time, a byte is zero after the xor if it matched */
+    const cJSON_uint64 ones = CJSON_UINT64_MAX / 0xFF;
+    const cJSON_uint64 high_bits = ones * 0x80;
+    for (; (i + 8) <= length; i += 8)
+    {
+        cJSON_uint64 chunk = 0;
+        cJSON_uint64 quotes = 0;
+        cJSON_uint64 backslashes = 0;
+        memcpy(&chunk, input + i, sizeof(chunk));
+        quotes = chunk ^ (ones * '\"');
+        backslashes = chunk ^ (ones * '\\');
+        if ((((quotes - ones) & ~quotes) | ((backslashes - ones) & ~backslashes) | (stop_at_non_ascii ? chunk : 0)) & high_bits)
+        {
+            break;
+        }
+    }
+#endif
+
+    for (; i < length; i++)
+    {
+        if ((input[i] == '\"') || (input[i] == '\\') || (stop_at_non_ascii && (input[i] >= 0x80)))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* length of the UTF-8 sequence at input, 0 if it is malformed (RFC 3629: no overlong forms, surrogates or values above U+10FFFF) */
+static size_t utf8_sequence_length(const unsigned char * const input, const size_t available)
+{
+    /* sequence length by the high nibble of the first byte, 0 for continuation bytes */
+    static const unsigned char lengths[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 2, 2, 3, 4 };
+    size_t length = lengths[input[0] >> 4];
+    unsigned char lower = 0x80;
+    unsigned char upper = 0xBF;
+    size_t i = 0;
+
+    if ((length == 0) || (length > available))
+    {
+        return 0;
+    }
+
+    /* the second byte has tighter bounds for some first bytes */
+    switch (input[0])
+    {
+        case 0xC0:
+        case 0xC1:
+            return 0; /* overlong */
+        case 0xE0:
+            lower = 0xA0; /* overlong */
+            break;
+        case 0xED:
+            upper = 0x9F; /* surrogates */
+            break;
+        case 0xF0:
+            lower = 0x90; /* overlong */
+            break;
+        case 0xF4:
+            upper = 0x8F; /* above U+10FFFF */
+            break;
+        default:
+            if (input[0] > 0xF4)
+            {
+                return 0;
+            }
+            break;
+    }
+
+    for (i = 1; i < length; i++)
+    {
+        if ((input[i] < lower) || (input[i] > upper))
+        {
+            return 0;
+        }
+        lower = 0x80;
+        upper = 0xBF;
+    }
+
+    return length;
+}
+
+#ifdef CJSON_SSE2
+/* Count the bytes at input, which starts a UTF-8 sequence, that are valid UTF-8 without '"' or '\\',
+ * checking 16 bytes at a time. Stops before the first block that needs a closer look, so that
+ * utf8_sequence_length() still finds the exact malformed byte. */
+static size_t skip_valid_utf8(const unsigned char * const input, const size_t length)
+{
+    /* compared as signed chars: ASCII is positive and 0x80 .. 0xFF are -128 .. -1 in order */
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    size_t i = 0;
+
+    while ((i + 16) <= length)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(input + i));
+        __m128i previous = _mm_slli_si128(chunk, 1);
+        __m128i non_ascii = _mm_cmplt_epi8(chunk, zero);
+        __m128i continuation = _mm_cmplt_epi8(chunk, _mm_set1_epi8((char)0xC0));
+        /* lead bytes of sequences of at least two, three and four bytes */
+        __m128i lead2 = _mm_andnot_si128(continuation, non_ascii);
+        __m128i lead3 = _mm_and_si128(non_ascii, _mm_cmpgt_epi8(chunk, _mm_set1_epi8((char)0xDF)));
+        __m128i lead4 = _mm_and_si128(non_ascii, _mm_cmpgt_epi8(chunk, _mm_set1_epi8((char)0xEF)));
+        /* a byte has to be a continuation byte exactly when a lead byte before it still needs one */
+        __m128i expected = _mm_or_si128(_mm_slli_si128(lead2, 1), _mm_or_si128(_mm_slli_si128(lead3, 2), _mm_slli_si128(lead4, 3)));
+        __m128i errors = _mm_xor_si128(expected, continuation);
+        int incomplete = 0;
+        int end = 16;
+
+        /* lead bytes that never appear: 0xC0, 0xC1 (overlong) and 0xF5 .. 0xFF (above U+10FFFF) */
+        errors = _mm_or_si128(errors, _mm_and_si128(lead2, _mm_cmplt_epi8(chunk, _mm_set1_epi8((char)0xC2))));
+        errors = _mm_or_si128(errors, _mm_and_si128(non_ascii, _mm_cmpgt_epi8(chunk, _mm_set1_epi8((char)0xF4))));
+        /* tighter bounds for the second byte: overlong after 0xE0 and 0xF0, surrogates after 0xED, above U+10FFFF after 0xF4 */
+        errors = _mm_or_si128(errors, _mm_and_si128(_mm_cmpeq_epi8(previous, _mm_set1_epi8((char)0xE0)), _mm_cmplt_epi8(chunk, _mm_set1_epi8((char)0xA0))));
+        errors = _mm_or_si128(errors, _mm_and_si128(_mm_cmpeq_epi8(previous, _mm_set1_epi8((char)0xED)), _mm_cmpgt_epi8(chunk, _mm_set1_epi8((char)0x9F))));
+        errors = _mm_or_si128(errors, _mm_and_si128(_mm_cmpeq_epi8(previous, _mm_set1_epi8((char)0xF0)), _mm_cmplt_epi8(chunk, _mm_set1_epi8((char)0x90))));
+        errors = _mm_or_si128(errors, _mm_and_si128(_mm_cmpeq_epi8(previous, _mm_set1_epi8((char)0xF4)), _mm_cmpgt_epi8(chunk, _mm_set1_epi8((char)0x8F))));
+        errors = _mm_or_si128(errors, _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+
+        /* valid text has no error bits at all, a sequence that runs past the block is left for the next one */
+        incomplete = (_mm_movemask_epi8(lead2) & 0x8000) | (_mm_movemask_epi8(lead3) & 0x4000) | (_mm_movemask_epi8(lead4) & 0x2000);
+        if (incomplete != 0)
+        {
+            end = 13;
+            while (!(incomplete & (1 << end)))
+            {
+                end++;
+            }
+        }
+
+        if (_mm_movemask_epi8(errors) != 0)
+        {
+            break;
+        }
+        i += (size_t)end;
+    }
+
+    return i;
+}
+#endif
+
 /* Parse the input text into an unescaped cinput, and populate item. */
 static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer)
 {
@@ -822,6 +1625,10 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     const unsigned char *input_end = buffer_at_offset(input_buffer) + 1;
     unsigned char *output_pointer = NULL;
     unsigned char *output = NULL;
+    /* buffer left over from a recycled tree, reused if the result fits */
+    unsigned char *spare = (unsigned char*)item->valuestring;
+
+    item->valuestring = NULL;
 
     /* not a string */
     if (buffer_at_offset(input_buffer)[0] != '\"')
@@ -833,20 +1640,48 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
         /* calculate approximate size of the output (overestimate) */
         size_t allocation_length = 0;
         size_t skipped_bytes = 0;
-        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        const unsigned char *content_end = input_buffer->content + input_buffer->length;
+        while (input_end < content_end)
         {
+            input_end += skip_plain_string_bytes(input_end, (size_t)(content_end - input_end), input_buffer->validate_utf8);
+            if ((input_end >= content_end) || (*input_end == '\"'))
+            {
+                break;
+            }
+
             /* is escape sequence */
             if (input_end[0] == '\\')
             {
-                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
+                if ((input_end + 1) >= content_end)
                 {
                     /* prevent buffer overflow when last input character is a backslash */
                     goto fail;
                 }
                 skipped_bytes++;
-                input_end++;
+                input_end += 2;
+                continue;
+            }
+
+            /* multibyte UTF-8 sequence, only stopped at when validating */
+            {
+                size_t sequence_length = 0;
+#ifdef CJSON_SSE2
+                sequence_length = skip_valid_utf8(input_end, (size_t)(content_end - input_end));
+                if (sequence_length > 0)
+                {
+                    input_end += sequence_length;
+                    continue;
+                }
+#endif
+                sequence_length = utf8_sequence_length(input_end, (size_t)(content_end - input_end));
+                if (sequence_length == 0)
+                {
+                    /* report the malformed byte */
+                    input_pointer = input_end;
+                    goto fail;
+                }
+                input_end += sequence_length;
             }
-            input_end++;
         }
         if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
         {
@@ -855,10 +1690,19 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
 
         /* This is at most how much we need for the output */
         allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
-        if (output == NULL)
+        /* allocation_length counts the opening quote, so it already covers the terminator */
+        if ((spare != NULL) && ((strlen((const char*)spare) + sizeof("")) >= allocation_length))
         {
-            goto fail; /* allocation failure */
+            output = spare;
+            spare = NULL;
+        }
+        else
+        {
+            output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+            if (output == NULL)
+            {
+                goto fail; /* allocation failure */
+            }
         }
     }
 
@@ -866,12 +1710,15 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     /* loop through the string literal */
     while (input_pointer < input_end)
     {
-        if (*input_pointer != '\\')
-        {
-            *output_pointer++ = *input_pointer++;
-        }
+        /* copy everything up to the next escape sequence at once */
+        const unsigned char *escape = (const unsigned char*)memchr(input_pointer, '\\', (size_t)(input_end - input_pointer));
+        size_t plain_length = (size_t)(((escape != NULL) ? escape : input_end) - input_pointer);
+        memcpy(output_pointer, input_pointer, plain_length);
+        output_pointer += plain_length;
+        input_pointer += plain_length;
+
         /* escape sequence */
-        else
+        if (input_pointer < input_end)
         {
             unsigned char sequence_length = 2;
             if ((input_end - input_pointer) < 1)
@@ -922,8 +1769,14 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     /* zero terminate the output */
     *output_pointer = '\0';
 
+    if (spare != NULL)
+    {
+        input_buffer->hooks.deallocate(spare);
+    }
+
     item->type = cJSON_String;
     item->valuestring = (char*)output;
+    stats_add(strings_copied, 1);
 
     input_buffer->offset = (size_t) (input_end - input_buffer->content);
     input_buffer->offset++;
@@ -936,6 +1789,10 @@ fail:
         input_buffer->hooks.deallocate(output);
         output = NULL;
     }
+    if (spare != NULL)
+    {
+        input_buffer->hooks.deallocate(spare);
+    }
 
     if (input_pointer != NULL)
     {
@@ -1080,6 +1937,68 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
 static cJSON_bool print_array(const cJSON * const item, printbuffer * const output_buffer);
 static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_buffer);
 static cJSON_bool print_object(const cJSON * const item, printbuffer * const output_buffer);
+static cJSON_bool print_incremental(cJSON * const item, const unsigned char * const previous, printbuffer * const output_buffer, cJSON_bool * const cacheable);
+
+/* Entry points for a whole document, timed for cJSON_SetStats. */
+#ifdef CJSON_INSTRUMENTATION
+static cJSON_bool parse_root_value(cJSON * const item, parse_buffer * const input_buffer)
+{
+    cJSON_bool parsed = false;
+    double started = 0;
+
+    if (current_stats == NULL)
+    {
+        return parse_value(item, input_buffer);
+    }
+
+    started = stats_now();
+    parsed = parse_value(item, input_buffer);
+    current_stats->parses++;
+    current_stats->parse_seconds += stats_now() - started;
+
+    return parsed;
+}
+
+static cJSON_bool print_root_value(const cJSON * const item, printbuffer * const output_buffer)
+{
+    cJSON_bool printed = false;
+    double started = 0;
+
+    if (current_stats == NULL)
+    {
+        return print_value(item, output_buffer);
+    }
+
+    started = stats_now();
+    printed = print_value(item, output_buffer);
+    current_stats->prints++;
+    current_stats->print_seconds += stats_now() - started;
+
+    return printed;
+}
+
+static cJSON_bool print_root_incremental(cJSON * const item, const unsigned char * const previous, printbuffer * const output_buffer, cJSON_bool * const cacheable)
+{
+    cJSON_bool printed = false;
+    double started = 0;
+
+    if (current_stats == NULL)
+    {
+        return print_incremental(item, previous, output_buffer, cacheable);
+    }
+
+    started = stats_now();
+    printed = print_incremental(item, previous, output_buffer, cacheable);
+    current_stats->prints++;
+    current_stats->print_seconds += stats_now() - started;
+
+    return printed;
+}
+#else
+#define parse_root_value(item, input_buffer) parse_value(item, input_buffer)
+#define print_root_value(item, output_buffer) print_value(item, output_buffer)
+#define print_root_incremental(item, previous, output_buffer, cacheable) print_incremental(item, previous, output_buffer, cacheable)
+#endif
 
 /* Utility to jump whitespace and cr/lf */
 static parse_buffer *buffer_skip_whitespace(parse_buffer * const buffer)
@@ -1141,13 +2060,29 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
 /* Parse an object - create a new root, and populate. */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
 {
-    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
+    return cJSON_ParseWithFlags(value, buffer_length, return_parse_end, require_null_terminated ? cJSON_ParseRequireNullTerminated : 0);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithFlags(const char *value, size_t buffer_length, const char **return_parse_end, int flags)
+{
+    return cJSON_ParseInto(NULL, value, buffer_length, return_parse_end, flags);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseInto(cJSON *recycle, const char *value, size_t buffer_length, const char **return_parse_end, int flags)
+{
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 }, 0, 0 };
+    cJSON_bool require_null_terminated = (flags & cJSON_ParseRequireNullTerminated) != 0;
     cJSON *item = NULL;
 
     /* reset error position */
     global_error.json = NULL;
     global_error.position = 0;
 
+    if (recycle != NULL)
+    {
+        buffer.recycled = flatten_for_recycling(recycle);
+    }
+
     if (value == NULL || 0 == buffer_length)
     {
         goto fail;
@@ -1157,14 +2092,21 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
     buffer.length = buffer_length;
     buffer.offset = 0;
     buffer.hooks = global_hooks;
+    buffer.validate_utf8 = (flags & cJSON_ParseValidateUTF8) != 0;
 
-    item = cJSON_New_Item(&global_hooks);
+    item = new_parse_item(&buffer);
     if (item == NULL) /* memory fail */
     {
         goto fail;
     }
+    /* the root has no name */
+    if (item->string != NULL)
+    {
+        global_hooks.deallocate(item->string);
+        item->string = NULL;
+    }
 
-    if (!parse_value(item, buffer_skip_whitespace(skip_utf8_bom(&buffer))))
+    if (!parse_root_value(item, buffer_skip_whitespace(skip_utf8_bom(&buffer))))
     {
         /* parse failure. ep is set. */
         goto fail;
@@ -1184,9 +2126,13 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
         *return_parse_end = (const char*)buffer_at_offset(&buffer);
     }
 
+    /* the new message was smaller than the old one */
+    cJSON_Delete(buffer.recycled);
+
     return item;
 
 fail:
+    cJSON_Delete(buffer.recycled);
     if (item != NULL)
     {
         cJSON_Delete(item);
@@ -1231,7 +2177,7 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 
 #define cjson_min(a, b) (((a) < (b)) ? (a) : (b))
 
-static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
+static unsigned char *print(const cJSON * const item, cJSON_bool format, cJSON_bool canonical, const cJSON_PrintOptions * const options, const internal_hooks * const hooks)
 {
     static const size_t default_buffer_size = 256;
     printbuffer buffer[1];
@@ -1242,7 +2188,9 @@ static unsigned char *print(const cJSON * const item, cJSON_bool format, const i
     /* create buffer */
     buffer->buffer = (unsigned char*) hooks->allocate(default_buffer_size);
     buffer->length = default_buffer_size;
-    buffer->format = format;
+    buffer->format = format && !canonical;
+    buffer->canonical = canonical;
+    buffer->options = options;
     buffer->hooks = *hooks;
     if (buffer->buffer == NULL)
     {
@@ -1250,12 +2198,18 @@ static unsigned char *print(const cJSON * const item, cJSON_bool format, const i
     }
 
     /* print the value */
-    if (!print_value(item, buffer))
+    if (!print_root_value(item, buffer))
     {
         goto fail;
     }
     update_offset(buffer);
 
+    if (buffer->members != NULL)
+    {
+        hooks->deallocate(buffer->members);
+        buffer->members = NULL;
+    }
+
     /* check if reallocate is available */
     if (hooks->reallocate != NULL)
     {
@@ -1289,6 +2243,12 @@ fail:
         buffer->buffer = NULL;
     }
 
+    if (buffer->members != NULL)
+    {
+        hooks->deallocate(buffer->members);
+        buffer->members = NULL;
+    }
+
     if (printed != NULL)
     {
         hooks->deallocate(printed);
@@ -1301,28 +2261,99 @@ fail:
 /* Render a cJSON item/entity/structure to text. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item)
 {
-    return (char*)print(item, true, &global_hooks);
+    return (char*)print(item, true, false, NULL, &global_hooks);
 }
 
 CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item)
 {
-    return (char*)print(item, false, &global_hooks);
+    return (char*)print(item, false, false, NULL, &global_hooks);
 }
 
-CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
+CJSON_PUBLIC(char *) cJSON_PrintCanonical(const cJSON *item)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    return (char*)print(item, false, true, NULL, &global_hooks);
+}
 
-    if (prebuffer < 0)
+CJSON_PUBLIC(char *) cJSON_PrintWithOptions(const cJSON *item, const cJSON_PrintOptions *options)
+{
+    if (options == NULL)
     {
-        return NULL;
+        return cJSON_Print(item);
     }
 
-    p.buffer = (unsigned char*)global_hooks.allocate((size_t)prebuffer);
-    if (!p.buffer)
-    {
-        return NULL;
-    }
+    return (char*)print(item, true, false, options, &global_hooks);
+}
+
+CJSON_PUBLIC(char *) cJSON_PrintIncremental(cJSON *item, char *previous)
+{
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0, 0 };
+    const unsigned char *previous_root = NULL;
+    cJSON_bool cacheable = true;
+
+    if ((item == NULL) || (item->parent != NULL) || (item->type & cJSON_TreeIsFrozen))
+    {
+        /* the span of a child is relative to its parent, and a frozen tree must not be written to */
+        if (previous != NULL)
+        {
+            global_hooks.deallocate(previous);
+        }
+        return cJSON_PrintUnformatted(item);
+    }
+
+    if ((previous != NULL) && (item->type & cJSON_PrintIsCached) && (strlen(previous) == item->print_length))
+    {
+        previous_root = (const unsigned char*)previous;
+    }
+
+    p.length = (previous_root != NULL) ? ((size_t)item->print_length + 1) : 256;
+    p.buffer = (unsigned char*)global_hooks.allocate(p.length);
+    p.hooks = global_hooks;
+    if (p.buffer == NULL)
+    {
+        goto fail;
+    }
+
+    if (!print_root_incremental(item, previous_root, &p, &cacheable))
+    {
+        goto fail;
+    }
+
+    if (previous != NULL)
+    {
+        global_hooks.deallocate(previous);
+    }
+
+    return (char*)p.buffer;
+
+fail:
+    if (p.buffer != NULL)
+    {
+        global_hooks.deallocate(p.buffer);
+    }
+    if (previous != NULL)
+    {
+        global_hooks.deallocate(previous);
+    }
+    /* the spans may be half updated, start from scratch next time */
+    item->type &= ~cJSON_PrintIsCached;
+
+    return NULL;
+}
+
+CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
+{
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0, 0 };
+
+    if (prebuffer < 0)
+    {
+        return NULL;
+    }
+
+    p.buffer = (unsigned char*)global_hooks.allocate((size_t)prebuffer);
+    if (!p.buffer)
+    {
+        return NULL;
+    }
 
     p.length = (size_t)prebuffer;
     p.offset = 0;
@@ -1330,7 +2361,7 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
     p.format = fmt;
     p.hooks = global_hooks;
 
-    if (!print_value(item, &p))
+    if (!print_root_value(item, &p))
     {
         global_hooks.deallocate(p.buffer);
         p.buffer = NULL;
@@ -1342,7 +2373,7 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0, 0 };
 
     if ((length < 0) || (buffer == NULL))
     {
@@ -1356,7 +2387,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, cons
     p.format = format;
     p.hooks = global_hooks;
 
-    return print_value(item, &p);
+    return print_root_value(item, &p);
 }
 
 /* Parser core - when encountering text, process appropriately. */
@@ -1367,6 +2398,13 @@ static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buf
         return false; /* no input */
     }
 
+    /* a recycled node only keeps its old string buffer if it becomes a string again */
+    if ((item->valuestring != NULL) && (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != '\"')))
+    {
+        input_buffer->hooks.deallocate(item->valuestring);
+        item->valuestring = NULL;
+    }
+
     /* parse the different types of values */
     /* null */
     if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "null", 4) == 0))
@@ -1527,11 +2565,18 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
     do
     {
         /* allocate next item */
-        cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
+        cJSON *new_item = new_parse_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
         }
+        new_item->parent = item;
+        /* array elements have no name */
+        if (new_item->string != NULL)
+        {
+            input_buffer->hooks.deallocate(new_item->string);
+            new_item->string = NULL;
+        }
 
         /* attach next item to list */
         if (head == NULL)
@@ -1586,6 +2631,174 @@ fail:
     return false;
 }
 
+/* arrays without nested arrays or objects can be kept on one line */
+static cJSON_bool array_is_flat(const cJSON * const item)
+{
+    const cJSON *current_element = NULL;
+
+    for (current_element = item->child; current_element != NULL; current_element = current_element->next)
+    {
+        if ((current_element->type & (cJSON_Array | cJSON_Object)) && (current_element->child != NULL))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Render a flat array on as few lines as fit into options->max_line_width. */
+static cJSON_bool print_array_compact(const cJSON * const item, printbuffer * const output_buffer)
+{
+    const size_t max_line_width = (size_t)((output_buffer->options->max_line_width > 0) ? output_buffer->options->max_line_width : 0);
+    const cJSON *current_element = NULL;
+    unsigned char *output_pointer = NULL;
+    size_t element_start = 0;
+
+    output_pointer = ensure(output_buffer, 1);
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+    *output_pointer = '[';
+    output_buffer->offset++;
+
+    for (current_element = item->child; current_element != NULL; current_element = current_element->next)
+    {
+        if (current_element != item->child)
+        {
+            output_pointer = ensure(output_buffer, 2);
+            if (output_pointer == NULL)
+            {
+                return false;
+            }
+            output_pointer[0] = ',';
+            output_pointer[1] = ' ';
+            output_buffer->offset += 2;
+        }
+
+        element_start = output_buffer->offset;
+        if (!print_value(current_element, output_buffer))
+        {
+            return false;
+        }
+        update_offset(output_buffer);
+
+        /* +1 for the ',' or ']' that follows */
+        if ((max_line_width > 0) && (current_element != item->child) && ((output_buffer->offset + 1 - output_buffer->line_start) > max_line_width))
+        {
+            /* move the element to a new line: replace the space in front of it with a newline and indentation */
+            size_t element_length = output_buffer->offset - element_start;
+            size_t indent = (output_buffer->depth + 1) * (size_t)((output_buffer->options->indent_width > 0) ? output_buffer->options->indent_width : 0);
+            if (ensure(output_buffer, indent + 1) == NULL)
+            {
+                return false;
+            }
+            memmove(output_buffer->buffer + element_start + indent, output_buffer->buffer + element_start, element_length);
+            output_buffer->buffer[element_start - 1] = '\n';
+            copy_indent(output_buffer->buffer + element_start, indent, output_buffer->options->use_tabs ? '\t' : ' ');
+            output_buffer->line_start = element_start;
+            output_buffer->offset += indent;
+        }
+    }
+
+    output_pointer = ensure(output_buffer, 2);
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+    output_pointer[0] = ']';
+    output_pointer[1] = '\0';
+    output_buffer->offset++;
+
+    return true;
+}
+
+/* Render an array or object following the print options, one element per line. */
+static cJSON_bool print_container_pretty(const cJSON * const item, printbuffer * const output_buffer)
+{
+    const cJSON_bool is_object = (item->type & cJSON_Object) != 0;
+    const cJSON *current_element = item->child;
+    unsigned char *output_pointer = NULL;
+
+    if (!is_object && output_buffer->options->compact_arrays && array_is_flat(item))
+    {
+        return print_array_compact(item, output_buffer);
+    }
+
+    output_pointer = ensure(output_buffer, 2);
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+    *output_pointer = is_object ? '{' : '[';
+    output_buffer->offset++;
+
+    if (current_element != NULL)
+    {
+        output_buffer->depth++;
+        for (; current_element != NULL; current_element = current_element->next)
+        {
+            if (!print_newline(output_buffer, output_buffer->depth))
+            {
+                return false;
+            }
+
+            if (is_object)
+            {
+                if (!print_string_ptr((unsigned char*)current_element->string, output_buffer))
+                {
+                    return false;
+                }
+                update_offset(output_buffer);
+
+                output_pointer = ensure(output_buffer, 2);
+                if (output_pointer == NULL)
+                {
+                    return false;
+                }
+                output_pointer[0] = ':';
+                output_pointer[1] = ' ';
+                output_buffer->offset += 2;
+            }
+
+            if (!print_value(current_element, output_buffer))
+            {
+                return false;
+            }
+            update_offset(output_buffer);
+
+            if (current_element->next != NULL)
+            {
+                output_pointer = ensure(output_buffer, 1);
+                if (output_pointer == NULL)
+                {
+                    return false;
+                }
+                *output_pointer = ',';
+                output_buffer->offset++;
+            }
+        }
+        output_buffer->depth--;
+
+        if (!print_newline(output_buffer, output_buffer->depth))
+        {
+            return false;
+        }
+    }
+
+    output_pointer = ensure(output_buffer, 2);
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+    output_pointer[0] = is_object ? '}' : ']';
+    output_pointer[1] = '\0';
+    output_buffer->offset++;
+
+    return true;
+}
+
 /* Render an array to text */
 static cJSON_bool print_array(const cJSON * const item, printbuffer * const output_buffer)
 {
@@ -1598,6 +2811,11 @@ static cJSON_bool print_array(const cJSON * const item, printbuffer * const outp
         return false;
     }
 
+    if (output_buffer->options != NULL)
+    {
+        return print_container_pretty(item, output_buffer);
+    }
+
     /* Compose the output array. */
     /* opening square bracket */
     output_pointer = ensure(output_buffer, 1);
@@ -1685,11 +2903,13 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
     do
     {
         /* allocate next item */
-        cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
+        cJSON *new_item = new_parse_item(input_buffer);
+        char *spare_value = NULL;
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
         }
+        new_item->parent = item;
 
         /* attach next item to list */
         if (head == NULL)
@@ -1710,18 +2930,22 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
             goto fail; /* nothing comes after the comma */
         }
 
-        /* parse the name of the child */
+        /* parse the name of the child, into the old name's buffer if it was recycled */
         input_buffer->offset++;
         buffer_skip_whitespace(input_buffer);
+        spare_value = current_item->valuestring;
+        current_item->valuestring = current_item->string;
+        current_item->string = NULL;
         if (!parse_string(current_item, input_buffer))
         {
+            current_item->valuestring = spare_value;
             goto fail; /* failed to parse name */
         }
         buffer_skip_whitespace(input_buffer);
 
         /* swap valuestring and string, because we parsed the name */
         current_item->string = current_item->valuestring;
-        current_item->valuestring = NULL;
+        current_item->valuestring = spare_value;
 
         if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != ':'))
         {
@@ -1766,6 +2990,226 @@ fail:
     return false;
 }
 
+/* first UTF-16 code unit of the UTF-8 sequence starting at string */
+static unsigned long utf16_sort_key(const unsigned char * const string)
+{
+    unsigned long codepoint = 0;
+
+    if (string[0] < 0xE0)
+    {
+        /* one and two byte sequences are below the surrogate range, their bytes already sort correctly */
+        return string[0];
+    }
+
+    if (string[0] < 0xF0)
+    {
+        return ((unsigned long)(string[0] & 0x0F) << 12) | ((unsigned long)(string[1] & 0x3F) << 6) | (unsigned long)(string[2] & 0x3F);
+    }
+
+    codepoint = ((unsigned long)(string[0] & 0x07) << 18) | ((unsigned long)(string[1] & 0x3F) << 12) | ((unsigned long)(string[2] & 0x3F) << 6) | (unsigned long)(string[3] & 0x3F);
+    /* high surrogate */
+    return 0xD800 + ((codepoint - 0x10000) >> 10);
+}
+
+/* Compare keys by their UTF-16 code units as required by RFC 8785.
+ * This only differs from plain byte order when characters above U+FFFF meet U+E000..U+FFFF. */
+static int canonical_key_compare(const unsigned char *key1, const unsigned char *key2)
+{
+    const unsigned char *start1 = NULL;
+    const unsigned char *start2 = NULL;
+    unsigned long unit1 = 0;
+    unsigned long unit2 = 0;
+    size_t common = 0;
+
+    if (key1 == NULL)
+    {
+        key1 = (const unsigned char*)"";
+    }
+    if (key2 == NULL)
+    {
+        key2 = (const unsigned char*)"";
+    }
+
+    for (common = 0; (key1[common] == key2[common]) && (key1[common] != '\0'); common++)
+    {
+        /* skip the common prefix */
+    }
+
+    if ((key1[common] < 0x80) || (key2[common] < 0x80))
+    {
+        return (int)key1[common] - (int)key2[common];
+    }
+
+    /* both differ inside a multibyte sequence, go back to its lead byte */
+    while ((common > 0) && ((key1[common] & 0xC0) == 0x80))
+    {
+        common--;
+    }
+    start1 = key1 + common;
+    start2 = key2 + common;
+
+    unit1 = utf16_sort_key(start1);
+    unit2 = utf16_sort_key(start2);
+    if (unit1 != unit2)
+    {
+        return (unit1 < unit2) ? -1 : 1;
+    }
+
+    /* same high surrogate, the low surrogates sort like the bytes */
+    return strcmp((const char*)start1, (const char*)start2);
+}
+
+static int CJSON_CDECL compare_sorted_members(const void *a, const void *b)
+{
+    const sorted_member *member1 = (const sorted_member*)a;
+    const sorted_member *member2 = (const sorted_member*)b;
+    int result = canonical_key_compare((const unsigned char*)member1->item->string, (const unsigned char*)member2->item->string);
+
+    if (result != 0)
+    {
+        return result;
+    }
+
+    return (member1->position < member2->position) ? -1 : (member1->position > member2->position);
+}
+
+/* make room for count more members in the sorting scratch space of a printbuffer */
+static cJSON_bool reserve_members(printbuffer * const p, size_t count)
+{
+    sorted_member *new_members = NULL;
+    size_t new_length = 0;
+
+    if ((p->members_used + count) <= p->members_length)
+    {
+        return true;
+    }
+
+    new_length = (p->members_used + count) * 2;
+    if (new_length > ((size_t)-1 / sizeof(sorted_member)))
+    {
+        return false;
+    }
+
+    if (p->hooks.reallocate != NULL)
+    {
+        new_members = (sorted_member*)p->hooks.reallocate(p->members, new_length * sizeof(sorted_member));
+        if (new_members == NULL)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        new_members = (sorted_member*)p->hooks.allocate(new_length * sizeof(sorted_member));
+        if (new_members == NULL)
+        {
+            return false;
+        }
+        if (p->members != NULL)
+        {
+            memcpy(new_members, p->members, p->members_used * sizeof(sorted_member));
+            p->hooks.deallocate(p->members);
+        }
+    }
+
+    p->members = new_members;
+    p->members_length = new_length;
+
+    return true;
+}
+
+/* Render an object with its keys sorted and without whitespace. */
+static cJSON_bool print_object_sorted(const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output_pointer = NULL;
+    const cJSON *current_item = NULL;
+    size_t base = output_buffer->members_used;
+    size_t count = 0;
+    size_t i = 0;
+    cJSON_bool success = false;
+
+    for (current_item = item->child; current_item != NULL; current_item = current_item->next)
+    {
+        count++;
+    }
+
+    if (!reserve_members(output_buffer, count))
+    {
+        return false;
+    }
+    for (current_item = item->child, i = 0; current_item != NULL; current_item = current_item->next, i++)
+    {
+        output_buffer->members[base + i].item = current_item;
+        output_buffer->members[base + i].position = i;
+    }
+    output_buffer->members_used += count;
+    if (count > 1)
+    {
+        qsort(output_buffer->members + base, count, sizeof(sorted_member), compare_sorted_members);
+    }
+
+    output_pointer = ensure(output_buffer, 1);
+    if (output_pointer == NULL)
+    {
+        goto end;
+    }
+    *output_pointer = '{';
+    output_buffer->offset++;
+    output_buffer->depth++;
+
+    for (i = 0; i < count; i++)
+    {
+        /* nested objects may move the scratch space, so index it every time */
+        current_item = output_buffer->members[base + i].item;
+
+        if (i > 0)
+        {
+            output_pointer = ensure(output_buffer, 1);
+            if (output_pointer == NULL)
+            {
+                goto end;
+            }
+            *output_pointer = ',';
+            output_buffer->offset++;
+        }
+
+        if (!print_string_ptr((unsigned char*)current_item->string, output_buffer))
+        {
+            goto end;
+        }
+        update_offset(output_buffer);
+
+        output_pointer = ensure(output_buffer, 1);
+        if (output_pointer == NULL)
+        {
+            goto end;
+        }
+        *output_pointer = ':';
+        output_buffer->offset++;
+
+        if (!print_value(current_item, output_buffer))
+        {
+            goto end;
+        }
+        update_offset(output_buffer);
+    }
+
+    output_pointer = ensure(output_buffer, 2);
+    if (output_pointer == NULL)
+    {
+        goto end;
+    }
+    *output_pointer++ = '}';
+    *output_pointer = '\0';
+    output_buffer->depth--;
+    success = true;
+
+end:
+    output_buffer->members_used = base;
+
+    return success;
+}
+
 /* Render an object to text. */
 static cJSON_bool print_object(const cJSON * const item, printbuffer * const output_buffer)
 {
@@ -1778,6 +3222,16 @@ static cJSON_bool print_object(const cJSON * const item, printbuffer * const out
         return false;
     }
 
+    if (output_buffer->canonical)
+    {
+        return print_object_sorted(item, output_buffer);
+    }
+
+    if (output_buffer->options != NULL)
+    {
+        return print_container_pretty(item, output_buffer);
+    }
+
     /* Compose the output: */
     length = (size_t) (output_buffer->format ? 2 : 1); /* fmt: {\n */
     output_pointer = ensure(output_buffer, length + 1);
@@ -1798,16 +3252,12 @@ static cJSON_bool print_object(const cJSON * const item, printbuffer * const out
     {
         if (output_buffer->format)
         {
-            size_t i;
             output_pointer = ensure(output_buffer, output_buffer->depth);
             if (output_pointer == NULL)
             {
                 return false;
             }
-            for (i = 0; i < output_buffer->depth; i++)
-            {
-                *output_pointer++ = '\t';
-            }
+            copy_indent(output_pointer, output_buffer->depth, '\t');
             output_buffer->offset += output_buffer->depth;
         }
 
@@ -1836,51 +3286,207 @@ static cJSON_bool print_object(const cJSON * const item, printbuffer * const out
         {
             return false;
         }
-        update_offset(output_buffer);
+        update_offset(output_buffer);
+
+        /* print comma if not last */
+        length = ((size_t)(output_buffer->format ? 1 : 0) + (size_t)(current_item->next ? 1 : 0));
+        output_pointer = ensure(output_buffer, length + 1);
+        if (output_pointer == NULL)
+        {
+            return false;
+        }
+        if (current_item->next)
+        {
+            *output_pointer++ = ',';
+        }
+
+        if (output_buffer->format)
+        {
+            *output_pointer++ = '\n';
+        }
+        *output_pointer = '\0';
+        output_buffer->offset += length;
+
+        current_item = current_item->next;
+    }
+
+    output_pointer = ensure(output_buffer, output_buffer->format ? (output_buffer->depth + 1) : 2);
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+    if (output_buffer->format)
+    {
+        copy_indent(output_pointer, output_buffer->depth - 1, '\t');
+        output_pointer += output_buffer->depth - 1;
+    }
+    *output_pointer++ = '}';
+    *output_pointer = '\0';
+    output_buffer->depth--;
+
+    return true;
+}
+
+/* Render item for cJSON_PrintIncremental.
+ * previous points to the item's text in the previous output, or is NULL if it isn't known.
+ * cacheable is cleared if the rendering depends on something dirty tracking can't see (references). */
+static cJSON_bool print_incremental(cJSON * const item, const unsigned char * const previous, printbuffer * const output_buffer, cJSON_bool * const cacheable)
+{
+    unsigned char *output_pointer = NULL;
+    cJSON *current_element = NULL;
+    size_t start = output_buffer->offset;
+    size_t length = 0;
+    cJSON_bool children_cacheable = true;
+
+    if ((previous != NULL) && ((item->type & (cJSON_PrintIsCached | cJSON_PrintIsDirty)) == cJSON_PrintIsCached))
+    {
+        /* unchanged since the last print, copy it over */
+        output_pointer = ensure(output_buffer, (size_t)item->print_length + 1);
+        if (output_pointer == NULL)
+        {
+            return false;
+        }
+        memcpy(output_pointer, previous, item->print_length);
+        output_pointer[item->print_length] = '\0';
+        output_buffer->offset += item->print_length;
+
+        return true;
+    }
+
+    if ((item->type & cJSON_IsReference) || !(item->type & (cJSON_Array | cJSON_Object)))
+    {
+        if (!print_value(item, output_buffer))
+        {
+            return false;
+        }
+        update_offset(output_buffer);
+
+        /* references can change without us noticing */
+        children_cacheable = !(item->type & cJSON_IsReference);
+    }
+    else
+    {
+        output_pointer = ensure(output_buffer, 1);
+        if (output_pointer == NULL)
+        {
+            return false;
+        }
+        *output_pointer = (item->type & cJSON_Array) ? '[' : '{';
+        output_buffer->offset++;
+
+        for (current_element = item->child; current_element != NULL; current_element = current_element->next)
+        {
+            const unsigned char *previous_element = NULL;
+            size_t element_start = 0;
+
+            if (item->type & cJSON_Object)
+            {
+                if (!print_string_ptr((unsigned char*)current_element->string, output_buffer))
+                {
+                    return false;
+                }
+                update_offset(output_buffer);
+
+                output_pointer = ensure(output_buffer, 1);
+                if (output_pointer == NULL)
+                {
+                    return false;
+                }
+                *output_pointer = ':';
+                output_buffer->offset++;
+            }
+
+            if ((previous != NULL) && (item->type & cJSON_PrintIsCached) && (current_element->type & cJSON_PrintIsCached))
+            {
+                previous_element = previous + current_element->print_offset;
+            }
+
+            element_start = output_buffer->offset;
+            if (!print_incremental(current_element, previous_element, output_buffer, &children_cacheable))
+            {
+                return false;
+            }
+            current_element->print_offset = (unsigned int)(element_start - start);
+
+            if (current_element->next != NULL)
+            {
+                output_pointer = ensure(output_buffer, 1);
+                if (output_pointer == NULL)
+                {
+                    return false;
+                }
+                *output_pointer = ',';
+                output_buffer->offset++;
+            }
+        }
 
-        /* print comma if not last */
-        length = ((size_t)(output_buffer->format ? 1 : 0) + (size_t)(current_item->next ? 1 : 0));
-        output_pointer = ensure(output_buffer, length + 1);
+        output_pointer = ensure(output_buffer, 2);
         if (output_pointer == NULL)
         {
             return false;
         }
-        if (current_item->next)
-        {
-            *output_pointer++ = ',';
-        }
-
-        if (output_buffer->format)
-        {
-            *output_pointer++ = '\n';
-        }
+        *output_pointer++ = (item->type & cJSON_Array) ? ']' : '}';
         *output_pointer = '\0';
-        output_buffer->offset += length;
+        output_buffer->offset++;
+    }
 
-        current_item = current_item->next;
+    length = output_buffer->offset - start;
+    item->print_length = (unsigned int)length;
+    item->type |= cJSON_PrintIsCached;
+    if (children_cacheable)
+    {
+        item->type &= ~cJSON_PrintIsDirty;
+    }
+    else
+    {
+        /* keep the span for the children, but always render this item again */
+        item->type |= cJSON_PrintIsDirty;
+        *cacheable = false;
     }
 
-    output_pointer = ensure(output_buffer, output_buffer->format ? (output_buffer->depth + 1) : 2);
-    if (output_pointer == NULL)
+    return true;
+}
+
+/* Get Array size/item / object item. */
+/* Children of a frozen array/object, in order, followed by slot_count hash slots for objects.
+ * The slots are filled by linear probing in child order, so the first match found is also the first in the list. */
+struct cJSON_Index
+{
+    size_t count;
+    size_t slot_count; /* a power of two, 0 if there is no hash table */
+    cJSON *items[1];
+};
+
+/* keys that only differ in case hash the same, so case insensitive lookups can use the table as well */
+static size_t hash_key(const unsigned char *key)
+{
+    size_t hash = 5381;
+    for (; *key != '\0'; key++)
     {
-        return false;
+        hash = (hash * 33) ^ (size_t)tolower(*key);
     }
-    if (output_buffer->format)
+
+    return hash ^ (hash >> 15);
+}
+
+static cJSON *index_lookup(const struct cJSON_Index * const index, const char * const name, const cJSON_bool case_sensitive)
+{
+    cJSON * const *slots = index->items + index->count;
+    size_t mask = index->slot_count - 1;
+    size_t slot = hash_key((const unsigned char*)name) & mask;
+
+    while (slots[slot] != NULL)
     {
-        size_t i;
-        for (i = 0; i < (output_buffer->depth - 1); i++)
+        if (case_sensitive ? (strcmp(name, slots[slot]->string) == 0) : (case_insensitive_strcmp((const unsigned char*)name, (const unsigned char*)slots[slot]->string) == 0))
         {
-            *output_pointer++ = '\t';
+            return slots[slot];
         }
+        slot = (slot + 1) & mask;
     }
-    *output_pointer++ = '}';
-    *output_pointer = '\0';
-    output_buffer->depth--;
 
-    return true;
+    return NULL;
 }
 
-/* Get Array size/item / object item. */
 CJSON_PUBLIC(int) cJSON_GetArraySize(const cJSON *array)
 {
     cJSON *child = NULL;
@@ -1891,6 +3497,11 @@ CJSON_PUBLIC(int) cJSON_GetArraySize(const cJSON *array)
         return 0;
     }
 
+    if (array->index != NULL)
+    {
+        return (int)array->index->count;
+    }
+
     child = array->child;
 
     while(child != NULL)
@@ -1913,6 +3524,11 @@ static cJSON* get_array_item(const cJSON *array, size_t index)
         return NULL;
     }
 
+    if (array->index != NULL)
+    {
+        return (index < array->index->count) ? array->index->items[index] : NULL;
+    }
+
     current_child = array->child;
     while ((current_child != NULL) && (index > 0))
     {
@@ -1942,6 +3558,11 @@ static cJSON *get_object_item(const cJSON * const object, const char * const nam
         return NULL;
     }
 
+    if ((object->index != NULL) && (object->index->slot_count != 0))
+    {
+        return index_lookup(object->index, name, case_sensitive);
+    }
+
     current_element = object->child;
     if (case_sensitive)
     {
@@ -1980,6 +3601,154 @@ CJSON_PUBLIC(cJSON_bool) cJSON_HasObjectItem(const cJSON *object, const char *st
     return cJSON_GetObjectItem(object, string) ? 1 : 0;
 }
 
+static cJSON_bool build_index(cJSON * const item)
+{
+    struct cJSON_Index *index = NULL;
+    cJSON *child = NULL;
+    size_t count = 0;
+    size_t slot_count = 0;
+    size_t position = 0;
+
+    for (child = item->child; child != NULL; child = child->next)
+    {
+        count++;
+    }
+
+    /* objects get a hash table at most half full, unless a nameless child makes the lookup semantics differ */
+    if (cJSON_IsObject(item))
+    {
+        slot_count = 8;
+        while (slot_count < (count * 2))
+        {
+            slot_count *= 2;
+        }
+        for (child = item->child; child != NULL; child = child->next)
+        {
+            if (child->string == NULL)
+            {
+                slot_count = 0;
+                break;
+            }
+        }
+    }
+
+    index = (struct cJSON_Index*)global_hooks.allocate(sizeof(struct cJSON_Index) + ((count + slot_count) * sizeof(cJSON*)));
+    if (index == NULL)
+    {
+        return false;
+    }
+    index->count = count;
+    index->slot_count = slot_count;
+
+    for (child = item->child; child != NULL; child = child->next)
+    {
+        index->items[position++] = child;
+    }
+
+    if (slot_count != 0)
+    {
+        cJSON **slots = index->items + count;
+        memset(slots, '\0', slot_count * sizeof(cJSON*));
+        for (position = 0; position < count; position++)
+        {
+            size_t slot = hash_key((const unsigned char*)index->items[position]->string) & (slot_count - 1);
+            while (slots[slot] != NULL)
+            {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            slots[slot] = index->items[position];
+        }
+    }
+
+    item->index = index;
+
+    return true;
+}
+
+/* undo a partial freeze_item */
+static void thaw_item(cJSON * const item)
+{
+    cJSON *child = NULL;
+
+    if (!(item->type & cJSON_TreeIsFrozen))
+    {
+        return;
+    }
+    item->type &= ~cJSON_TreeIsFrozen;
+
+    if (item->index != NULL)
+    {
+        global_hooks.deallocate(item->index);
+        item->index = NULL;
+    }
+    if (!(item->type & cJSON_IsReference))
+    {
+        for (child = item->child; child != NULL; child = child->next)
+        {
+            thaw_item(child);
+        }
+    }
+}
+
+static cJSON_bool freeze_item(cJSON * const item)
+{
+    cJSON *child = NULL;
+
+    item->type |= cJSON_TreeIsFrozen;
+
+    /* the children of a reference belong to another tree */
+    if ((item->type & cJSON_IsReference) || (item->child == NULL))
+    {
+        return true;
+    }
+
+    if (!build_index(item))
+    {
+        return false;
+    }
+
+    for (child = item->child; child != NULL; child = child->next)
+    {
+        if (!freeze_item(child))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_Freeze(cJSON *item)
+{
+    if ((item == NULL) || (item->parent != NULL))
+    {
+        return false;
+    }
+
+    if (item->type & cJSON_TreeIsFrozen)
+    {
+        return true;
+    }
+
+    if (!freeze_item(item))
+    {
+        thaw_item(item);
+        return false;
+    }
+
+    return true;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_IsFrozen(const cJSON * const item)
+{
+    if (item == NULL)
+    {
+        return false;
+    }
+
+    return (item->type & cJSON_TreeIsFrozen) != 0;
+}
+
 /* Utility for array list handling. */
 static void suffix_object(cJSON *prev, cJSON *item)
 {
@@ -2005,7 +3774,10 @@ static cJSON *create_reference(const cJSON *item, const internal_hooks * const h
     memcpy(reference, item, sizeof(cJSON));
     reference->string = NULL;
     reference->type |= cJSON_IsReference;
+    reference->type &= ~(cJSON_PrintIsCached | cJSON_PrintIsDirty | cJSON_TreeIsFrozen);
     reference->next = reference->prev = NULL;
+    reference->parent = NULL;
+    reference->index = NULL;
     return reference;
 }
 
@@ -2013,7 +3785,7 @@ static cJSON_bool add_item_to_array(cJSON *array, cJSON *item)
 {
     cJSON *child = NULL;
 
-    if ((item == NULL) || (array == NULL) || (array == item))
+    if ((item == NULL) || (array == NULL) || (array == item) || ((array->type | item->type) & cJSON_TreeIsFrozen))
     {
         return false;
     }
@@ -2039,6 +3811,8 @@ static cJSON_bool add_item_to_array(cJSON *array, cJSON *item)
         }
     }
 
+    adopt_item(array, item);
+
     return true;
 }
 
@@ -2069,7 +3843,7 @@ static cJSON_bool add_item_to_object(cJSON * const object, const char * const st
     char *new_key = NULL;
     int new_type = cJSON_Invalid;
 
-    if ((object == NULL) || (string == NULL) || (item == NULL) || (object == item))
+    if ((object == NULL) || (string == NULL) || (item == NULL) || (object == item) || ((object->type | item->type) & cJSON_TreeIsFrozen))
     {
         return false;
     }
@@ -2242,7 +4016,7 @@ CJSON_PUBLIC(cJSON*) cJSON_AddArrayToObject(cJSON * const object, const char * c
 
 CJSON_PUBLIC(cJSON *) cJSON_DetachItemViaPointer(cJSON *parent, cJSON * const item)
 {
-    if ((parent == NULL) || (item == NULL) || (item != parent->child && item->prev == NULL))
+    if ((parent == NULL) || (item == NULL) || (parent->type & cJSON_TreeIsFrozen) || (item != parent->child && item->prev == NULL))
     {
         return NULL;
     }
@@ -2272,6 +4046,9 @@ CJSON_PUBLIC(cJSON *) cJSON_DetachItemViaPointer(cJSON *parent, cJSON * const it
     /* make sure the detached item doesn't point anywhere anymore */
     item->prev = NULL;
     item->next = NULL;
+    item->parent = NULL;
+    item->type &= ~cJSON_PrintIsCached;
+    mark_dirty(parent);
 
     return item;
 }
@@ -2320,7 +4097,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_InsertItemInArray(cJSON *array, int which, cJSON
 {
     cJSON *after_inserted = NULL;
 
-    if (which < 0 || newitem == NULL)
+    if (which < 0 || newitem == NULL || (array == NULL) || ((array->type | newitem->type) & cJSON_TreeIsFrozen))
     {
         return false;
     }
@@ -2347,12 +4124,13 @@ CJSON_PUBLIC(cJSON_bool) cJSON_InsertItemInArray(cJSON *array, int which, cJSON
     {
         newitem->prev->next = newitem;
     }
+    adopt_item(array, newitem);
     return true;
 }
 
 CJSON_PUBLIC(cJSON_bool) cJSON_ReplaceItemViaPointer(cJSON * const parent, cJSON * const item, cJSON * replacement)
 {
-    if ((parent == NULL) || (parent->child == NULL) || (replacement == NULL) || (item == NULL))
+    if ((parent == NULL) || (parent->child == NULL) || (replacement == NULL) || (item == NULL) || ((parent->type | replacement->type) & cJSON_TreeIsFrozen))
     {
         return false;
     }
@@ -2392,6 +4170,8 @@ CJSON_PUBLIC(cJSON_bool) cJSON_ReplaceItemViaPointer(cJSON * const parent, cJSON
         }
     }
 
+    adopt_item(parent, replacement);
+
     item->next = NULL;
     item->prev = NULL;
     cJSON_Delete(item);
@@ -2411,7 +4191,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_ReplaceItemInArray(cJSON *array, int which, cJSON
 
 static cJSON_bool replace_item_in_object(cJSON *object, const char *string, cJSON *replacement, cJSON_bool case_sensitive)
 {
-    if ((replacement == NULL) || (string == NULL))
+    if ((replacement == NULL) || (string == NULL) || (replacement->type & cJSON_TreeIsFrozen) || ((object != NULL) && (object->type & cJSON_TreeIsFrozen)))
     {
         return false;
     }
@@ -2513,6 +4293,30 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateNumber(double num)
     return item;
 }
 
+CJSON_PUBLIC(cJSON *) cJSON_CreateInt64(cJSON_int64 num)
+{
+    cJSON *item = cJSON_New_Item(&global_hooks);
+    if(item)
+    {
+        item->type = cJSON_Number;
+        set_integer(item, num, false);
+    }
+
+    return item;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CreateUInt64(cJSON_uint64 num)
+{
+    cJSON *item = cJSON_New_Item(&global_hooks);
+    if(item)
+    {
+        item->type = cJSON_Number;
+        set_integer(item, (cJSON_int64)num, num > (cJSON_uint64)CJSON_INT64_MAX);
+    }
+
+    return item;
+}
+
 CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string)
 {
     cJSON *item = cJSON_New_Item(&global_hooks);
@@ -2625,6 +4429,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateIntArray(const int *numbers, int count)
             cJSON_Delete(a);
             return NULL;
         }
+        n->parent = a;
         if(!i)
         {
             a->child = n;
@@ -2665,6 +4470,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateFloatArray(const float *numbers, int count)
             cJSON_Delete(a);
             return NULL;
         }
+        n->parent = a;
         if(!i)
         {
             a->child = n;
@@ -2705,6 +4511,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateDoubleArray(const double *numbers, int count)
             cJSON_Delete(a);
             return NULL;
         }
+        n->parent = a;
         if(!i)
         {
             a->child = n;
@@ -2745,6 +4552,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char *const *strings, int co
             cJSON_Delete(a);
             return NULL;
         }
+        n->parent = a;
         if(!i)
         {
             a->child = n;
@@ -2790,9 +4598,10 @@ cJSON * cJSON_Duplicate_rec(const cJSON *item, size_t depth, cJSON_bool recurse)
         goto fail;
     }
     /* Copy over all vars */
-    newitem->type = item->type & (~cJSON_IsReference);
+    newitem->type = item->type & ~(cJSON_IsReference | cJSON_PrintIsCached | cJSON_PrintIsDirty | cJSON_TreeIsFrozen);
     newitem->valueint = item->valueint;
     newitem->valuedouble = item->valuedouble;
+    newitem->valueint64 = item->valueint64;
     if (item->valuestring)
     {
         newitem->valuestring = (char*)cJSON_strdup((unsigned char*)item->valuestring, &global_hooks);
@@ -2826,6 +4635,7 @@ cJSON * cJSON_Duplicate_rec(const cJSON *item, size_t depth, cJSON_bool recurse)
         {
             goto fail;
         }
+        newchild->parent = newitem;
         if (next != NULL)
         {
             /* If newitem->child already set, then crosswire ->prev and ->next and move on */
@@ -2857,101 +4667,194 @@ fail:
     return NULL;
 }
 
-static void skip_oneline_comment(char **input)
+/* Count the bytes at input that minifying copies unchanged: anything but whitespace, '/' and '"'. */
+static size_t skip_plain_json_bytes(const unsigned char * const input, const size_t length)
 {
-    *input += static_strlen("//");
+    size_t i = 0;
+
+#ifdef CJSON_SSE2
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i quote = _mm_set1_epi8('\"');
+    for (; (i + 16) <= length; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(input + i));
+        __m128i whitespace = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)), _mm_or_si128(_mm_cmpeq_epi8(chunk, carriage_return), _mm_cmpeq_epi8(chunk, newline)));
+        int mask = _mm_movemask_epi8(_mm_or_si128(whitespace, _mm_or_si128(_mm_cmpeq_epi8(chunk, slash), _mm_cmpeq_epi8(chunk, quote))));
+        if (mask != 0)
+        {
+            while (!(mask & 1))
+            {
+                mask >>= 1;
+                i++;
+            }
+            return i;
+        }
+    }
+#endif
 
-    for (; (*input)[0] != '\0'; ++(*input))
+    for (; i < length; i++)
     {
-        if ((*input)[0] == '\n') {
-            *input += static_strlen("\n");
-            return;
+        switch (input[i])
+        {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+            case '/':
+            case '\"':
+                return i;
+
+            default:
+                break;
         }
     }
+
+    return i;
 }
 
-static void skip_multiline_comment(char **input)
+/* returns the position behind the comment that starts at input */
+static const unsigned char *skip_oneline_comment(const unsigned char *input, const unsigned char * const input_end)
 {
-    *input += static_strlen("/*");
+    const unsigned char *newline = NULL;
 
-    for (; (*input)[0] != '\0'; ++(*input))
+    input += static_strlen("//");
+    if (input >= input_end)
     {
-        if (((*input)[0] == '*') && ((*input)[1] == '/'))
-        {
-            *input += static_strlen("*/");
-            return;
-        }
+        return input_end;
+    }
+
+    newline = (const unsigned char*)memchr(input, '\n', (size_t)(input_end - input));
+    if (newline == NULL)
+    {
+        return input_end;
     }
+
+    return newline + static_strlen("\n");
 }
 
-static void minify_string(char **input, char **output) {
-    (*output)[0] = (*input)[0];
-    *input += static_strlen("\"");
-    *output += static_strlen("\"");
+static const unsigned char *skip_multiline_comment(const unsigned char *input, const unsigned char * const input_end)
+{
+    input += static_strlen("/*");
+
+    while (input < input_end)
+    {
+        const unsigned char *star = (const unsigned char*)memchr(input, '*', (size_t)(input_end - input));
+        if ((star == NULL) || ((star + 1) >= input_end))
+        {
+            break;
+        }
+        if (star[1] == '/')
+        {
+            return star + static_strlen("*/");
+        }
+        input = star + 1;
+    }
 
+    return input_end;
+}
 
-    for (; (*input)[0] != '\0'; (void)++(*input), ++(*output)) {
-        (*output)[0] = (*input)[0];
+/* copy the string literal that starts at input, returns the position behind it */
+static const unsigned char *minify_string(const unsigned char *input, const unsigned char * const input_end, unsigned char **output)
+{
+    const unsigned char *start = input;
 
-        if ((*input)[0] == '\"') {
-            (*output)[0] = '\"';
-            *input += static_strlen("\"");
-            *output += static_strlen("\"");
-            return;
-        } else if (((*input)[0] == '\\') && ((*input)[1] == '\"')) {
-            (*output)[1] = (*input)[1];
-            *input += static_strlen("\"");
-            *output += static_strlen("\"");
+    input += static_strlen("\"");
+    while (input < input_end)
+    {
+        input += skip_plain_string_bytes(input, (size_t)(input_end - input), false);
+        if (input >= input_end)
+        {
+            break;
+        }
+        if (*input == '\"')
+        {
+            input += static_strlen("\"");
+            break;
         }
+        /* skip the escaped character, it might be a quote */
+        input += 2;
     }
+    if (input > input_end)
+    {
+        input = input_end;
+    }
+
+    memmove(*output, start, (size_t)(input - start));
+    *output += input - start;
+
+    return input;
 }
 
-CJSON_PUBLIC(void) cJSON_Minify(char *json)
+CJSON_PUBLIC(size_t) cJSON_MinifyWithLength(const char *json, size_t length, char *output)
 {
-    char *into = json;
+    const unsigned char *input = (const unsigned char*)json;
+    const unsigned char *input_end = NULL;
+    unsigned char *into = (unsigned char*)output;
 
-    if (json == NULL)
+    if ((json == NULL) || (output == NULL))
     {
-        return;
+        return 0;
     }
+    input_end = input + length;
 
-    while (json[0] != '\0')
+    while (input < input_end)
     {
-        switch (json[0])
+        /* copy everything up to the next whitespace, comment or string at once */
+        size_t plain_length = skip_plain_json_bytes(input, (size_t)(input_end - input));
+        if (into != input)
         {
-            case ' ':
-            case '\t':
-            case '\r':
-            case '\n':
-                json++;
-                break;
+            memmove(into, input, plain_length);
+        }
+        into += plain_length;
+        input += plain_length;
+        if (input >= input_end)
+        {
+            break;
+        }
 
+        switch (input[0])
+        {
             case '/':
-                if (json[1] == '/')
+                if (((input + 1) < input_end) && (input[1] == '/'))
+                {
+                    input = skip_oneline_comment(input, input_end);
+                }
+                else if (((input + 1) < input_end) && (input[1] == '*'))
                 {
-                    skip_oneline_comment(&json);
+                    input = skip_multiline_comment(input, input_end);
                 }
-                else if (json[1] == '*')
+                else
                 {
-                    skip_multiline_comment(&json);
-                } else {
-                    json++;
+                    input++;
                 }
                 break;
 
             case '\"':
-                minify_string(&json, (char**)&into);
+                input = minify_string(input, input_end, &into);
                 break;
 
             default:
-                into[0] = json[0];
-                json++;
-                into++;
+                /* whitespace */
+                input++;
+                break;
         }
     }
 
-    /* and null-terminate. */
-    *into = '\0';
+    return (size_t)(into - (unsigned char*)output);
+}
+
+CJSON_PUBLIC(void) cJSON_Minify(char *json)
+{
+    if (json == NULL)
+    {
+        return;
+    }
+
+    json[cJSON_MinifyWithLength(json, strlen(json), json)] = '\0';
 }
 
 CJSON_PUBLIC(cJSON_bool) cJSON_IsInvalid(const cJSON * const item)
@@ -3014,6 +4917,16 @@ CJSON_PUBLIC(cJSON_bool) cJSON_IsNumber(const cJSON * const item)
     return (item->type & 0xFF) == cJSON_Number;
 }
 
+CJSON_PUBLIC(cJSON_bool) cJSON_IsInteger(const cJSON * const item)
+{
+    if (!cJSON_IsNumber(item))
+    {
+        return false;
+    }
+
+    return number_is_integer(item);
+}
+
 CJSON_PUBLIC(cJSON_bool) cJSON_IsString(const cJSON * const item)
 {
     if (item == NULL)
@@ -3093,6 +5006,11 @@ CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * cons
             return true;
 
         case cJSON_Number:
+            if (number_is_integer(a) && number_is_integer(b))
+            {
+                /* doubles can't tell integers above 2^53 apart */
+                return (a->valueint64 == b->valueint64) && ((a->type & cJSON_NumberIsUnsigned) == (b->type & cJSON_NumberIsUnsigned));
+            }
             if (compare_double(a->valuedouble, b->valuedouble))
             {
                 return true;
@@ -98,6 +98,20 @@ then using the CJSON_API_VISIBILITY flag to "export" the same symbols the way CJ
 
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
+#define cJSON_NumberIsInteger 1024 /* valueint64 holds the exact integer value of the number */
+#define cJSON_NumberIsUnsigned 2048 /* valueint64 holds an unsigned value above the int64 range */
+#define cJSON_PrintIsCached 4096 /* print_offset/print_length locate the item in the last cJSON_PrintIncremental output */
+#define cJSON_PrintIsDirty 8192 /* the item changed since the last cJSON_PrintIncremental */
+#define cJSON_TreeIsFrozen 16384 /* the item belongs to a tree passed to cJSON_Freeze and can't be modified */
+
+/* 64 bit integer types used for exact integer numbers */
+#ifdef __GNUC__
+__extension__ typedef long long cJSON_int64;
+__extension__ typedef unsigned long long cJSON_uint64;
+#else
+typedef long long cJSON_int64;
+typedef unsigned long long cJSON_uint64;
+#endif
 
 /* The cJSON structure: */
 typedef struct cJSON
@@ -120,6 +134,18 @@ typedef struct cJSON
 
     /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
     char *string;
+
+    /* The item's exact integer value, if type has cJSON_NumberIsInteger set. Read it with cJSON_GetInt64Value/cJSON_GetUInt64Value */
+    cJSON_int64 valueint64;
+
+    /* The array/object this item is linked into, NULL for roots and detached items. */
+    struct cJSON *parent;
+    /* Span of the item in the last cJSON_PrintIncremental output, the offset is relative to the parent's span. */
+    unsigned int print_offset;
+    unsigned int print_length;
+
+    /* Lookup tables for the children of a frozen array/object, built by cJSON_Freeze. */
+    struct cJSON_Index *index;
 } cJSON;
 
 typedef struct cJSON_Hooks
@@ -131,6 +157,30 @@ typedef struct cJSON_Hooks
 
 typedef int cJSON_bool;
 
+/* Layout for cJSON_PrintWithOptions */
+typedef struct cJSON_PrintOptions
+{
+    int indent_width; /* indentation characters per nesting level */
+    cJSON_bool use_tabs; /* indent with tabs instead of spaces */
+    cJSON_bool compact_arrays; /* keep arrays without nested arrays/objects on one line */
+    int max_line_width; /* wrap compact arrays that get longer than this, 0 for no limit */
+} cJSON_PrintOptions;
+
+/* Counters filled in through cJSON_SetStats */
+typedef struct cJSON_Stats
+{
+    size_t allocations; /* calls to the allocator, reallocations included */
+    size_t allocated_bytes;
+    size_t deallocations;
+    size_t nodes_created;
+    size_t strings_copied; /* keys and string values parsed or duplicated */
+    size_t print_buffer_growths; /* times a print buffer had to be enlarged */
+    size_t parses;
+    size_t prints;
+    double parse_seconds;
+    double print_seconds;
+} cJSON_Stats;
+
 /* Limits how deeply nested arrays/objects can be before cJSON rejects to parse them.
  * This is to prevent stack overflows. */
 #ifndef CJSON_NESTING_LIMIT
@@ -148,6 +198,10 @@ CJSON_PUBLIC(const char*) cJSON_Version(void);
 
 /* Supply malloc, realloc and free functions to cJSON */
 CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks);
+/* Add everything the calling thread does in cJSON to the counters in stats from now on (they aren't reset).
+ * Returns the previous target, pass NULL to stop. Switch targets to attribute work to different contexts.
+ * Only available when cJSON.c is compiled with CJSON_INSTRUMENTATION, otherwise nothing is counted and NULL is returned. */
+CJSON_PUBLIC(cJSON_Stats *) cJSON_SetStats(cJSON_Stats *stats);
 
 /* Memory Management: the caller is always responsible to free the results from all variants of cJSON_Parse (with cJSON_Delete) and cJSON_Print (with stdlib free, cJSON_Hooks.free_fn, or cJSON_free as appropriate). The exception is cJSON_PrintPreallocated, where the caller has full responsibility of the buffer. */
 /* Supply a block of JSON, and this returns a cJSON object you can interrogate. */
@@ -157,11 +211,30 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
+/* Flags for cJSON_ParseWithFlags */
+#define cJSON_ParseRequireNullTerminated (1 << 0) /* same as require_null_terminated above */
+#define cJSON_ParseValidateUTF8 (1 << 1) /* reject strings and keys that aren't valid UTF-8, for input from untrusted sources */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithFlags(const char *value, size_t buffer_length, const char **return_parse_end, int flags);
+/* Parse into the nodes and string buffers of a previous result instead of allocating new ones.
+ * recycle must be a root (not inside another tree) and is consumed either way: what isn't reused is freed,
+ * so `tree = cJSON_ParseInto(tree, ...)` replaces cJSON_Delete + cJSON_ParseWithFlags. NULL behaves like cJSON_ParseWithFlags. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseInto(cJSON *recycle, const char *value, size_t buffer_length, const char **return_parse_end, int flags);
 
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. */
 CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item);
+/* Render a cJSON entity to formatted text with the given layout: every member/element on its own line, "key": value pairs. */
+CJSON_PUBLIC(char *) cJSON_PrintWithOptions(const cJSON *item, const cJSON_PrintOptions *options);
+/* Render a cJSON entity to canonical text (RFC 8785 style): object keys sorted by UTF-16 code units, numbers in their shortest
+ * round-trip form and no whitespace. Equal trees give byte identical output, which makes it suitable for hashing.
+ * Exact 64 bit integers are printed with all their digits and raw items are copied unchanged. */
+CJSON_PUBLIC(char *) cJSON_PrintCanonical(const cJSON *item);
+/* Render a cJSON entity to text without formatting, copying every subtree that wasn't modified since the previous call verbatim
+ * from that call's output. Pass the string returned by the previous call for the same root (NULL the first time), it is always
+ * released by this call. Only roots (items without parent) are rendered incrementally. Modifications through the cJSON API mark
+ * the changed path dirty, after writing to an item's fields directly call cJSON_MarkDirty on it. */
+CJSON_PUBLIC(char *) cJSON_PrintIncremental(cJSON *item, char *previous);
 /* Render a cJSON entity to text using a buffered strategy. prebuffer is a guess at the final size. guessing well reduces reallocation. fmt=0 gives unformatted, =1 gives formatted */
 CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt);
 /* Render a cJSON entity to text using a buffer already allocated in memory with given length. Returns 1 on success and 0 on failure. */
@@ -178,12 +251,23 @@ CJSON_PUBLIC(cJSON *) cJSON_GetArrayItem(const cJSON *array, int index);
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItem(const cJSON * const object, const char * const string);
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitive(const cJSON * const object, const char * const string);
 CJSON_PUBLIC(cJSON_bool) cJSON_HasObjectItem(const cJSON *object, const char *string);
+
+/* Make a whole tree (item must be a root) read-only, so any number of threads can read it concurrently without locking.
+ * Lookup tables are built for every array and object up front, which makes cJSON_GetArraySize and cJSON_GetArrayItem
+ * O(1) and cJSON_GetObjectItem a hash lookup. All functions that would modify the tree fail on it afterwards,
+ * only cJSON_Delete of the root (or cJSON_Duplicate to get a mutable copy) is allowed.
+ * Items behind references are read through but not frozen. Returns false (leaving the tree unchanged) if out of memory. */
+CJSON_PUBLIC(cJSON_bool) cJSON_Freeze(cJSON *item);
+CJSON_PUBLIC(cJSON_bool) cJSON_IsFrozen(const cJSON * const item);
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a few chars back to make sense of it. Defined when cJSON_Parse() returns 0. 0 when cJSON_Parse() succeeds. */
 CJSON_PUBLIC(const char *) cJSON_GetErrorPtr(void);
 
 /* Check item type and return its value */
 CJSON_PUBLIC(char *) cJSON_GetStringValue(const cJSON * const item);
 CJSON_PUBLIC(double) cJSON_GetNumberValue(const cJSON * const item);
+/* Integers are kept exactly when they fit into 64 bits. Other numbers are converted with saturation, non-numbers give 0. */
+CJSON_PUBLIC(cJSON_int64) cJSON_GetInt64Value(const cJSON * const item);
+CJSON_PUBLIC(cJSON_uint64) cJSON_GetUInt64Value(const cJSON * const item);
 
 /* These functions check the type of an item */
 CJSON_PUBLIC(cJSON_bool) cJSON_IsInvalid(const cJSON * const item);
@@ -192,6 +276,8 @@ CJSON_PUBLIC(cJSON_bool) cJSON_IsTrue(const cJSON * const item);
 CJSON_PUBLIC(cJSON_bool) cJSON_IsBool(const cJSON * const item);
 CJSON_PUBLIC(cJSON_bool) cJSON_IsNull(const cJSON * const item);
 CJSON_PUBLIC(cJSON_bool) cJSON_IsNumber(const cJSON * const item);
+/* true if the item is a number that holds an exact 64 bit integer */
+CJSON_PUBLIC(cJSON_bool) cJSON_IsInteger(const cJSON * const item);
 CJSON_PUBLIC(cJSON_bool) cJSON_IsString(const cJSON * const item);
 CJSON_PUBLIC(cJSON_bool) cJSON_IsArray(const cJSON * const item);
 CJSON_PUBLIC(cJSON_bool) cJSON_IsObject(const cJSON * const item);
@@ -203,6 +289,8 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateTrue(void);
 CJSON_PUBLIC(cJSON *) cJSON_CreateFalse(void);
 CJSON_PUBLIC(cJSON *) cJSON_CreateBool(cJSON_bool boolean);
 CJSON_PUBLIC(cJSON *) cJSON_CreateNumber(double num);
+CJSON_PUBLIC(cJSON *) cJSON_CreateInt64(cJSON_int64 num);
+CJSON_PUBLIC(cJSON *) cJSON_CreateUInt64(cJSON_uint64 num);
 CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string);
 /* raw json */
 CJSON_PUBLIC(cJSON *) cJSON_CreateRaw(const char *raw);
@@ -264,6 +352,9 @@ CJSON_PUBLIC(cJSON_bool) cJSON_Compare(const cJSON * const a, const cJSON * cons
  * The input pointer json cannot point to a read-only address area, such as a string constant, 
  * but should point to a readable and writable address area. */
 CJSON_PUBLIC(void) cJSON_Minify(char *json);
+/* Minify length bytes of json (no NUL terminator needed) into output, which needs room for length bytes.
+ * output may be json itself to minify in place. Returns the minified length, output is not NUL terminated. */
+CJSON_PUBLIC(size_t) cJSON_MinifyWithLength(const char *json, size_t length, char *output);
 
 /* Helper functions for creating and adding items to an object at the same time.
  * They return the added item or NULL on failure. */
@@ -277,18 +368,27 @@ CJSON_PUBLIC(cJSON*) cJSON_AddRawToObject(cJSON * const object, const char * con
 CJSON_PUBLIC(cJSON*) cJSON_AddObjectToObject(cJSON * const object, const char * const name);
 CJSON_PUBLIC(cJSON*) cJSON_AddArrayToObject(cJSON * const object, const char * const name);
 
-/* When assigning an integer value, it needs to be propagated to valuedouble too. */
-#define cJSON_SetIntValue(object, number) ((object) ? (object)->valueint = (object)->valuedouble = (number) : (number))
+/* When assigning an integer value, it needs to be propagated to valuedouble too. The item is marked dirty for cJSON_PrintIncremental.
+ * A frozen item is left alone and its current valueint returned, as cJSON_SetNumberValue does. */
+#define cJSON_SetIntValue(object, number) ((object) ? \
+    (((object)->type & cJSON_TreeIsFrozen) ? (object)->valueint : \
+     (cJSON_MarkDirty(object), (object)->valueint = (object)->valuedouble = (number))) : \
+    (number))
 /* helper for the cJSON_SetNumberValue macro */
 CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number);
 #define cJSON_SetNumberValue(object, number) ((object != NULL) ? cJSON_SetNumberHelper(object, (double)number) : (number))
+/* Set a number item to an exact 64 bit integer, valueint and valuedouble are updated as well. Returns the new value. */
+CJSON_PUBLIC(cJSON_int64) cJSON_SetInt64Value(cJSON *object, cJSON_int64 number);
+/* Tell cJSON_PrintIncremental that an item (and therefore its parents) changed behind the API's back */
+CJSON_PUBLIC(void) cJSON_MarkDirty(cJSON *item);
 /* Change the valuestring of a cJSON_String object, only takes effect when type of object is cJSON_String */
 CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring);
 
-/* If the object is not a boolean type this does nothing and returns cJSON_Invalid else it returns the new type*/
+/* If the object is not a boolean type or is frozen this does nothing and returns cJSON_Invalid else it returns the new type (and marks the item dirty) */
 #define cJSON_SetBoolValue(object, boolValue) ( \
-    (object != NULL && ((object)->type & (cJSON_False|cJSON_True))) ? \
-    (object)->type=((object)->type &(~(cJSON_False|cJSON_True)))|((boolValue)?cJSON_True:cJSON_False) : \
+    (object != NULL && ((object)->type & (cJSON_False|cJSON_True)) && !((object)->type & cJSON_TreeIsFrozen)) ? \
+    (cJSON_MarkDirty(object), \
+     (object)->type=((object)->type &(~(cJSON_False|cJSON_True)))|((boolValue)?cJSON_True:cJSON_False)) : \
     cJSON_Invalid\
 )
 
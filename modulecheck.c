@@ -14,10 +14,14 @@
  * - Support module families (v4l2loopback, snd-*, etc.)
  * - JSON-based configuration with flexible naming
  * 
- * Compilation: gcc -o modulecheck modulecheck.c -lcjson -Wall
+ * Compilation: gcc -o modulecheck modulecheck.c -lcjson -lpthread -Wall
+ * Add -DMODULECHECK_NO_MAIN to link the checker into another program
+ * (bench_modulecheck.c does).
  */
 
+#define _GNU_SOURCE  // strverscmp()
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -25,32 +29,190 @@
 #include <errno.h>
 #include <dirent.h>
 #include <sys/utsname.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/netlink.h>
+#include <fnmatch.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#ifdef MODULECHECK_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MODULECHECK_WITH_LZMA
+#include <lzma.h>
+#endif
+#ifdef MODULECHECK_WITH_ZSTD
+#include <zstd.h>
+#endif
 #include "cJSON.h"
+#include "modulecheck.h"
 
-#define MAX_PATH 4096
-#define MAX_CMD 8192
-#define MAX_MODULE_NAME 256
-#define MAX_ALIASES 10
+/*
+ * Instrumentation
+ * 
+ * Built with -DMODULECHECK_INSTRUMENTATION, every check reports into the
+ * ModuleCheckStats set for the calling thread (module_check_set_stats())
+ * and into the stats of the batch being checked: time and hits per find
+ * strategy, processes spawned, bytes read from files and pipes, and index
+ * cache hits/misses. Without it the hooks compile to nothing.
+ */
+#ifdef MODULECHECK_INSTRUMENTATION
+static _Thread_local ModuleCheckStats *check_stats;
+static _Thread_local ModuleCheckStats *check_batch_stats;
+
+#define stats_add(field, amount) do { \
+        if (check_stats != NULL) check_stats->field += (amount); \
+        if (check_batch_stats != NULL) check_batch_stats->field += (amount); \
+    } while (0)
+
+static double stats_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+// One strategy call that started at `start` is over; hit if it found the module
+static void stats_strategy(int strategy, double start, int hit) {
+    double elapsed = stats_clock() - start;
+    stats_add(strategy_calls[strategy], 1);
+    stats_add(strategy_hits[strategy], hit ? 1 : 0);
+    stats_add(strategy_seconds[strategy], elapsed);
+}
+#else
+#define stats_add(field, amount) ((void)0)
+#define stats_clock() 0.0
+#define stats_strategy(strategy, start, hit) ((void)(start))
+#endif
+
+ModuleCheckStats *module_check_set_stats(ModuleCheckStats *stats) {
+#ifdef MODULECHECK_INSTRUMENTATION
+    ModuleCheckStats *previous = check_stats;
+    check_stats = stats;
+    return previous;
+#else
+    (void)stats;
+    return NULL;
+#endif
+}
+
+void module_check_stats_add(ModuleCheckStats *total, const ModuleCheckStats *stats) {
+    for (int i = 0; i < MODULE_STRATEGY_COUNT; i++) {
+        total->strategy_calls[i] += stats->strategy_calls[i];
+        total->strategy_hits[i] += stats->strategy_hits[i];
+        total->strategy_seconds[i] += stats->strategy_seconds[i];
+    }
+    total->subprocesses += stats->subprocesses;
+    total->bytes_read += stats->bytes_read;
+    total->cache_hits += stats->cache_hits;
+    total->cache_misses += stats->cache_misses;
+    total->modules_checked += stats->modules_checked;
+}
+
+const char *module_strategy_name(int strategy) {
+    static const char *const names[MODULE_STRATEGY_COUNT] = { "loaded", "builtin", "file", "modinfo" };
+    return (strategy >= 0 && strategy < MODULE_STRATEGY_COUNT) ? names[strategy] : "none";
+}
+
+// getline() that counts what it read
+static ssize_t read_line(char **line, size_t *size, FILE *fp) {
+    ssize_t length = getline(line, size, fp);
+    if (length > 0) {
+        stats_add(bytes_read, (unsigned long long)length);
+    }
+    return length;
+}
+
+extern char **environ;
+
+// Run argv[0] (looked up in PATH) with its stdout on the returned stream and stderr on /dev/null.
+// No shell: module names and kernel versions go in as plain arguments. spawn_wait() closes it
+static FILE *spawn(char *const argv[], pid_t *pid) {
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) != 0) {
+        return NULL;
+    }
+    
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    int error = posix_spawnp(pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipefd[1]);
+    if (error != 0) {
+        close(pipefd[0]);
+        return NULL;
+    }
+    stats_add(subprocesses, 1);
+    
+    FILE *fp = fdopen(pipefd[0], "r");
+    if (fp == NULL) {
+        close(pipefd[0]);
+        waitpid(*pid, NULL, 0);
+    }
+    return fp;
+}
+
+// pclose() for spawn(): the exit status, -1 if it can't be had
+static int spawn_wait(FILE *fp, pid_t pid) {
+    int status;
+    fclose(fp);
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return status;
+}
 
 /*
- * Module structure
- * Stores information about a kernel module being checked
+ * Root prefix
  * 
- * Handles complex scenarios like:
- * - v4l2loopback (exact name)
- * - videodev (alias for v4l2 core)
- * - snd-* (sound card family)
+ * Every system path (/proc, /sys, /lib/modules, modprobe.d, kernel headers)
+ * is read below module_root, "" for the real root, so a copied or synthetic
+ * tree can be checked offline. See module_check_set_root().
  */
-typedef struct {
-    char name[MAX_MODULE_NAME];              // Primary module name
-    char aliases[MAX_ALIASES][MAX_MODULE_NAME];  // Alternative names
-    int alias_count;                          // Number of aliases
-    char found_as[MAX_MODULE_NAME];          // Which name was actually found
-    char path[MAX_PATH];                     // Path to .ko file if available
-    int loaded;                              // Is module currently loaded?
-    int available;                           // Is module available to load?
-    int builtin;                             // Is module built into kernel?
-} Module;
+static char module_root[MAX_PATH];
+
+// snprintf() of a system path below the root prefix
+static int root_path(char *buffer, size_t size, const char *format, ...) {
+    size_t length = strlen(module_root);
+    if (length >= size) {
+        buffer[0] = '\0';
+        return (int)length;
+    }
+    memcpy(buffer, module_root, length);
+    
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + length, size - length, format, args);
+    va_end(args);
+    return written < 0 ? written : (int)length + written;
+}
+
+const char *module_check_root(void) {
+    return module_root;
+}
+
+// A release string as uname() gives it ("6.1.0-13-amd64", "5.15.0+"), nothing that reads as a path or option
+static int kernel_version_valid(const char *version) {
+    if (version[0] == '.' || version[0] == '-') {
+        return 0;
+    }
+    for (const char *p = version; *p; p++) {
+        if (!isalnum((unsigned char)*p) && strchr(".-_+~", *p) == NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
 /*
  * get_kernel_version()
@@ -65,6 +227,22 @@ typedef struct {
 int get_kernel_version(char *version, size_t len) {
     struct utsname uts;
     
+    // Below a root prefix the tree says which kernel it is, if it can
+    if (module_root[0] != '\0') {
+        char path[MAX_PATH];
+        root_path(path, sizeof(path), "/proc/sys/kernel/osrelease");
+        FILE *fp = fopen(path, "r");
+        if (fp != NULL) {
+            int ok = fgets(version, (int)len, fp) != NULL;
+            fclose(fp);
+            version[strcspn(version, "\n")] = '\0';
+            if (ok && version[0] != '\0') {
+                // It names a directory below lib/modules and goes to modinfo: a plain release string only
+                return kernel_version_valid(version);
+            }
+        }
+    }
+    
     if (uname(&uts) != 0) {
         return 0;
     }
@@ -74,14 +252,238 @@ int get_kernel_version(char *version, size_t len) {
     return 1;
 }
 
+/*
+ * sysfs_module_state()
+ * 
+ * Fast path for loaded/built-in detection through /sys/module.
+ * 
+ * Every loaded module and every built-in module that has parameters or a
+ * version gets a /sys/module/<name> directory. Only loadable modules have
+ * an initstate file in it, so:
+ * - <name>/initstate exists: loaded (one stat)
+ * - <name> exists without initstate: built-in
+ * - <name> doesn't exist: not loaded, but possibly a built-in without
+ *   sysfs entry, so modules.builtin still has to be checked for that
+ * 
+ * No parsing and no subprocess. Whether /sys/module exists at all is
+ * checked once per process (per root), under a lock so that threads
+ * checking at the same time agree on it.
+ */
+static int sysfs_present = -1;
+static pthread_mutex_t sysfs_present_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// sysfs uses the kernel's underscore spelling; 0 for anything that isn't a plain name
+static size_t sysfs_module_name(const char *module_name, char *name, size_t size) {
+    size_t len = 0;
+    for (const char *p = module_name; *p; p++) {
+        if (len + 1 >= size || !(isalnum((unsigned char)*p) || *p == '_' || *p == '-')) {
+            return 0;
+        }
+        name[len++] = (*p == '-') ? '_' : *p;
+    }
+    name[len] = '\0';
+    return len;
+}
+
+int sysfs_module_state(const char *module_name) {
+    char path[MAX_PATH];
+    char name[MAX_MODULE_NAME];
+    struct stat st;
+    
+    pthread_mutex_lock(&sysfs_present_lock);
+    if (sysfs_present < 0) {
+        root_path(path, sizeof(path), "/sys/module");
+        sysfs_present = (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) ? 1 : 0;
+    }
+    int present = sysfs_present;
+    pthread_mutex_unlock(&sysfs_present_lock);
+    if (!present) {
+        return MODULE_SYSFS_UNAVAILABLE;
+    }
+    
+    if (sysfs_module_name(module_name, name, sizeof(name)) == 0) {
+        return MODULE_SYSFS_ABSENT;
+    }
+    
+    root_path(path, sizeof(path), "/sys/module/%s/initstate", name);
+    if (stat(path, &st) == 0) {
+        return MODULE_SYSFS_LOADED;
+    }
+    
+    path[strlen(path) - strlen("/initstate")] = '\0';
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        return MODULE_SYSFS_BUILTIN;
+    }
+    
+    return MODULE_SYSFS_ABSENT;
+}
+
+/*
+ * module_state_read()
+ * 
+ * What /sys/module/<name> says about a module beyond its presence:
+ * parameters/<param>, refcnt, holders/<module> and taint. The whole entry
+ * is read in one pass with openat() below the module's directory fd, and
+ * the /sys/module fd itself is opened once per process (and dropped by
+ * module_check_set_root()).
+ */
+static int sysfs_module_fd = -1;
+static pthread_mutex_t sysfs_module_fd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int sysfs_module_dir(void) {
+    pthread_mutex_lock(&sysfs_module_fd_lock);
+    if (sysfs_module_fd < 0) {
+        char path[MAX_PATH];
+        root_path(path, sizeof(path), "/sys/module");
+        sysfs_module_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    int fd = sysfs_module_fd;
+    pthread_mutex_unlock(&sysfs_module_fd_lock);
+    return fd;
+}
+
+// One sysfs attribute below dirfd, without its trailing newline; -1 if it can't be read (write-only parameters can't)
+static ssize_t sysfs_read_attribute(int dirfd, const char *name, char *buffer, size_t size) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t length = read(fd, buffer, size - 1);
+    close(fd);
+    if (length < 0) {
+        return -1;
+    }
+    stats_add(bytes_read, (unsigned long long)length);
+    while (length > 0 && buffer[length - 1] == '\n') {
+        length--;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+// Append "key=value" (or just "key" for a NULL value) to a NUL separated list
+static int state_list_add(char **data, size_t *length, const char *key, const char *value) {
+    size_t key_length = strlen(key);
+    size_t value_length = (value != NULL) ? strlen(value) + 1 : 0;
+    char *grown = realloc(*data, *length + key_length + value_length + 2);
+    if (grown == NULL) {
+        return 0;
+    }
+    *data = grown;
+    memcpy(grown + *length, key, key_length);
+    if (value != NULL) {
+        grown[*length + key_length] = '=';
+        memcpy(grown + *length + key_length + 1, value, value_length);  // with its NUL
+    } else {
+        grown[*length + key_length] = '\0';
+    }
+    *length += key_length + value_length + 1;
+    grown[*length] = '\0';  // the list as a whole stays terminated
+    return 1;
+}
+
+// Every readable attribute (or, with values == 0, every name) in a subdirectory of parent
+static int state_list_read(int parent, const char *subdir, int values, char **data, size_t *length) {
+    int fd = openat(parent, subdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return 1;  // built-ins have no holders, many modules no parameters
+    }
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+        return 1;
+    }
+    
+    char value[4096];  // a sysfs attribute is at most a page
+    struct dirent *entry;
+    int ok = 1;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (!values) {
+            ok = state_list_add(data, length, entry->d_name, NULL);
+        } else if (sysfs_read_attribute(fd, entry->d_name, value, sizeof(value)) >= 0) {
+            ok = state_list_add(data, length, entry->d_name, value);
+        }
+    }
+    closedir(dir);
+    return ok;
+}
+
+int module_state_read(const char *module_name, ModuleState *state) {
+    char name[MAX_MODULE_NAME];
+    char value[64];
+    
+    memset(state, 0, sizeof(ModuleState));
+    state->state = MODULE_SYSFS_ABSENT;
+    state->refcnt = -1;
+    if (sysfs_module_name(module_name, name, sizeof(name)) == 0) {
+        return 0;
+    }
+    
+    int sysfs = sysfs_module_dir();
+    if (sysfs < 0) {
+        state->state = MODULE_SYSFS_UNAVAILABLE;
+        return 0;
+    }
+    int dirfd = openat(sysfs, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) {
+        return 0;
+    }
+    
+    // Same rule as sysfs_module_state(): only loadable modules have an initstate
+    state->state = (faccessat(dirfd, "initstate", F_OK, 0) == 0) ? MODULE_SYSFS_LOADED : MODULE_SYSFS_BUILTIN;
+    if (sysfs_read_attribute(dirfd, "refcnt", value, sizeof(value)) > 0) {
+        state->refcnt = strtol(value, NULL, 10);
+    }
+    sysfs_read_attribute(dirfd, "taint", state->taint, sizeof(state->taint));
+    
+    int ok = state_list_read(dirfd, "parameters", 1, &state->parameters, &state->parameters_length) &&
+             state_list_read(dirfd, "holders", 0, &state->holders, &state->holders_length);
+    close(dirfd);
+    if (!ok) {
+        module_state_free(state);
+        return -1;
+    }
+    return 1;
+}
+
+const char *module_state_parameter(const ModuleState *state, const char *name) {
+    size_t name_length = strlen(name);
+    for (const char *entry = state->parameters; entry != NULL && entry < state->parameters + state->parameters_length;
+         entry += strlen(entry) + 1) {
+        if (strncmp(entry, name, name_length) == 0 && entry[name_length] == '=') {
+            return entry + name_length + 1;
+        }
+    }
+    return NULL;
+}
+
+const char *module_state_holder(const ModuleState *state, const char *previous) {
+    const char *next = (previous == NULL) ? state->holders : previous + strlen(previous) + 1;
+    return (next != NULL && next < state->holders + state->holders_length) ? next : NULL;
+}
+
+void module_state_free(ModuleState *state) {
+    free(state->parameters);
+    free(state->holders);
+    state->parameters = state->holders = NULL;
+    state->parameters_length = state->holders_length = 0;
+}
+
 /*
  * is_module_loaded()
  * 
  * Checks if a module is currently loaded in the kernel.
  * 
  * Strategy:
+ * 0. /sys/module/<name>/initstate (sysfs_module_state) - conclusive when sysfs is mounted
  * 1. Check /proc/modules (list of loaded modules)
- * 2. Use lsmod command as fallback
+ * 
+ * There is no lsmod fallback: lsmod only formats /proc/modules, so it can't
+ * succeed where reading the file failed, and running it costs a fork, a shell
+ * and two execs per name.
  * 
  * /proc/modules format:
  * module_name size used_by_count [dependencies] state address
@@ -92,7 +494,8 @@ int get_kernel_version(char *version, size_t len) {
  */
 int is_module_loaded(const char *module_name) {
     FILE *fp;
-    char line[512];
+    char *line = NULL;
+    size_t line_size = 0;
     char search_name[MAX_MODULE_NAME];
     
     // Normalize module name (replace - with _)
@@ -105,41 +508,36 @@ int is_module_loaded(const char *module_name) {
     }
     
     /*
-     * METHOD 1: Read /proc/modules directly
-     * This is the most reliable method
+     * METHOD 0: sysfs fast path
+     * Any answer other than "no sysfs" is final
      */
-    fp = fopen("/proc/modules", "r");
-    if (fp != NULL) {
-        while (fgets(line, sizeof(line), fp)) {
-            char loaded_module[MAX_MODULE_NAME];
-            
-            // Extract first field (module name)
-            if (sscanf(line, "%255s", loaded_module) == 1) {
-                // Normalize loaded module name too
-                for (char *p = loaded_module; *p; p++) {
-                    if (*p == '-') *p = '_';
-                }
-                
-                if (strcmp(loaded_module, search_name) == 0) {
-                    fclose(fp);
-                    return 1;
-                }
-            }
-        }
-        fclose(fp);
+    int state = sysfs_module_state(search_name);
+    if (state != MODULE_SYSFS_UNAVAILABLE) {
+        return state == MODULE_SYSFS_LOADED;
     }
     
     /*
-     * METHOD 2: Use lsmod command
-     * Fallback if /proc/modules isn't accessible
+     * METHOD 1: Read /proc/modules directly
+     * Whole lines are read, so a long dependency list can't be mistaken
+     * for the start of the next entry
      */
-    char cmd[MAX_CMD];
-    snprintf(cmd, sizeof(cmd), "lsmod 2>/dev/null | grep -q '^%s '", search_name);
-    if (system(cmd) == 0) {
-        return 1;
+    char path[MAX_PATH];
+    root_path(path, sizeof(path), "/proc/modules");
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
     }
     
-    return 0;
+    size_t search_len = strlen(search_name);
+    int found = 0;
+    while (!found && read_line(&line, &line_size, fp) != -1) {
+        // First field is the module name, the kernel already uses underscores
+        found = strncmp(line, search_name, search_len) == 0 && line[search_len] == ' ';
+    }
+    
+    free(line);
+    fclose(fp);
+    return found;
 }
 
 /*
@@ -152,434 +550,4517 @@ int is_module_loaded(const char *module_name) {
  * - They don't need to be loaded (already in kernel)
  * - Common for essential drivers (ext4, tcp, etc.)
  * 
- * Location: /lib/modules/<kernel>/modules.builtin
+ * Location: /lib/modules/<kernel>/modules.builtin(.bin)
  * Format: kernel/drivers/media/v4l2-core/videodev.ko
+ * 
+ * /sys/module answers first when the running kernel is the one asked about;
+ * the file is only read when sysfs can't tell (no entry, or no sysfs).
  */
+static char running_version[256];
+static pthread_mutex_t running_version_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int is_module_builtin(const char *module_name, const char *kernel_version) {
-    char builtin_path[MAX_PATH];
+    // sysfs describes the running kernel only (uname once per process)
+    pthread_mutex_lock(&running_version_lock);
+    if (running_version[0] == '\0') {
+        get_kernel_version(running_version, sizeof(running_version));
+    }
+    int running = strcmp(running_version, kernel_version) == 0;
+    pthread_mutex_unlock(&running_version_lock);
+    if (running) {
+        int state = sysfs_module_state(module_name);
+        if (state == MODULE_SYSFS_BUILTIN) {
+            return 1;
+        }
+        if (state == MODULE_SYSFS_LOADED) {
+            return 0;  // loadable module, can't be built in as well
+        }
+    }
+    
+    // modules.builtin.bin when depmod wrote one, else a scan of modules.builtin
+    char entry[MAX_PATH];
+    return module_index_lookup(kernel_version, MODULE_INDEX_BUILTIN, module_name, entry, sizeof(entry));
+}
+
+/*
+ * Module files
+ * 
+ * Distributions ship modules as .ko, .ko.gz, .ko.xz or .ko.zst. Paths are
+ * recognized by their suffix; the contents by their magic bytes. Reading the
+ * .modinfo section of a compressed module decompresses it as a stream and
+ * stops once the ELF section headers (and .modinfo, which comes before
+ * them) have been produced, so the trailing signature is never touched and
+ * nothing is written to disk.
+ * 
+ * The decompressors are optional so the basic build needs no libraries:
+ *   -DMODULECHECK_WITH_ZLIB -lz       .ko.gz
+ *   -DMODULECHECK_WITH_LZMA -llzma    .ko.xz
+ *   -DMODULECHECK_WITH_ZSTD -lzstd    .ko.zst
+ * Without them such modules are still found, only their .modinfo can't be
+ * read natively (check_module_by_modinfo() then runs modinfo).
+ */
+
+// Module name of a path like kernel/drivers/foo/snd-hda-intel.ko.zst: "snd_hda_intel"
+static int module_name_from_path(const char *path, size_t path_len, char *name, size_t size) {
+    const char *start = path + path_len;
+    while (start > path && start[-1] != '/') {
+        start--;
+    }
+    
+    size_t len = 0;
+    for (const char *p = start; p < path + path_len; p++) {
+        if (strncmp(p, ".ko", 3) == 0 && (p[3] == '\0' || p[3] == '.' || p + 3 == path + path_len)) {
+            break;
+        }
+        if (len + 1 >= size) {
+            return 0;
+        }
+        name[len++] = (*p == '-') ? '_' : *p;
+    }
+    name[len] = '\0';
+    return len > 0;
+}
+
+int module_compression_from_path(const char *path) {
+    size_t length = strlen(path);
+    static const struct {
+        const char *suffix;
+        int compression;
+    } suffixes[] = {
+        { ".ko", MODULE_COMPRESSION_NONE },
+        { ".ko.gz", MODULE_COMPRESSION_GZIP },
+        { ".ko.xz", MODULE_COMPRESSION_XZ },
+        { ".ko.zst", MODULE_COMPRESSION_ZSTD },
+    };
+    
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        size_t suffix_length = strlen(suffixes[i].suffix);
+        if (length > suffix_length && strcmp(path + length - suffix_length, suffixes[i].suffix) == 0) {
+            return suffixes[i].compression;
+        }
+    }
+    return MODULE_COMPRESSION_UNKNOWN;
+}
+
+// Compression by magic bytes; the suffix can lie (and modprobe doesn't trust it either)
+static int module_compression_detect(const unsigned char *magic, size_t length) {
+    if (length >= 4 && memcmp(magic, "\177ELF", 4) == 0) {
+        return MODULE_COMPRESSION_NONE;
+    }
+    if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return MODULE_COMPRESSION_GZIP;
+    }
+    if (length >= 6 && memcmp(magic, "\375" "7zXZ\0", 6) == 0) {
+        return MODULE_COMPRESSION_XZ;
+    }
+    if (length >= 4 && memcmp(magic, "\050\265\057\375", 4) == 0) {
+        return MODULE_COMPRESSION_ZSTD;
+    }
+    return MODULE_COMPRESSION_UNKNOWN;
+}
+
+typedef struct {
     FILE *fp;
-    char line[MAX_PATH];
+    int compression;
+    int finished;
+    unsigned char input[16384];
+#ifdef MODULECHECK_WITH_ZLIB
+    z_stream gzip;
+#endif
+#ifdef MODULECHECK_WITH_LZMA
+    lzma_stream xz;
+#endif
+#ifdef MODULECHECK_WITH_ZSTD
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer zstd_input;
+#endif
+} ModuleStream;
+
+static void module_stream_close(ModuleStream *stream) {
+#ifdef MODULECHECK_WITH_ZLIB
+    if (stream->compression == MODULE_COMPRESSION_GZIP) {
+        inflateEnd(&stream->gzip);
+    }
+#endif
+#ifdef MODULECHECK_WITH_LZMA
+    if (stream->compression == MODULE_COMPRESSION_XZ) {
+        lzma_end(&stream->xz);
+    }
+#endif
+#ifdef MODULECHECK_WITH_ZSTD
+    if (stream->compression == MODULE_COMPRESSION_ZSTD) {
+        ZSTD_freeDStream(stream->zstd);
+    }
+#endif
+    fclose(stream->fp);
+}
+
+// 1 if the file is a module in a format this build can decompress
+static int module_stream_open(ModuleStream *stream, const char *path) {
+    unsigned char magic[6];
     
-    snprintf(builtin_path, sizeof(builtin_path), 
-             "/lib/modules/%s/modules.builtin", kernel_version);
+    memset(stream, 0, sizeof(ModuleStream));
+    stream->fp = fopen(path, "rb");
+    if (stream->fp == NULL) {
+        return 0;
+    }
     
-    fp = fopen(builtin_path, "r");
-    if (fp == NULL) {
+    size_t magic_length = fread(magic, 1, sizeof(magic), stream->fp);
+    stream->compression = module_compression_detect(magic, magic_length);
+    rewind(stream->fp);
+    
+    int ok = 0;
+    switch (stream->compression) {
+    case MODULE_COMPRESSION_NONE:
+        ok = 1;
+        break;
+#ifdef MODULECHECK_WITH_ZLIB
+    case MODULE_COMPRESSION_GZIP:
+        ok = inflateInit2(&stream->gzip, 15 + 16) == Z_OK;  // +16: gzip wrapper
+        break;
+#endif
+#ifdef MODULECHECK_WITH_LZMA
+    case MODULE_COMPRESSION_XZ: {
+        lzma_stream init = LZMA_STREAM_INIT;
+        stream->xz = init;
+        ok = lzma_stream_decoder(&stream->xz, UINT64_MAX, 0) == LZMA_OK;
+        break;
+    }
+#endif
+#ifdef MODULECHECK_WITH_ZSTD
+    case MODULE_COMPRESSION_ZSTD:
+        stream->zstd = ZSTD_createDStream();
+        ok = stream->zstd != NULL && !ZSTD_isError(ZSTD_initDStream(stream->zstd));
+        break;
+#endif
+    default:
+        break;
+    }
+    
+    if (!ok) {
+        // Nothing was initialized for an unsupported format, so only the file needs closing
+        if (stream->compression != MODULE_COMPRESSION_UNKNOWN) {
+            module_stream_close(stream);
+        } else {
+            fclose(stream->fp);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+// Next decompressed bytes; 0 at the end of the module, -1 on corrupt or truncated input
+static ssize_t module_stream_read(ModuleStream *stream, unsigned char *output, size_t size) {
+    if (stream->finished) {
         return 0;
     }
     
-    // Normalize search name
-    char search_name[MAX_MODULE_NAME];
-    strncpy(search_name, module_name, sizeof(search_name) - 1);
-    for (char *p = search_name; *p; p++) {
-        if (*p == '-') *p = '_';
+    if (stream->compression == MODULE_COMPRESSION_NONE) {
+        size_t got = fread(output, 1, size, stream->fp);
+        stats_add(bytes_read, got);
+        if (got == 0) {
+            stream->finished = 1;
+            return ferror(stream->fp) ? -1 : 0;
+        }
+        return (ssize_t)got;
     }
     
-    while (fgets(line, sizeof(line), fp)) {
-        // Extract filename from path
-        char *filename = strrchr(line, '/');
-        if (filename) {
-            filename++; // Skip the '/'
-            
-            // Remove .ko extension
-            char *ext = strstr(filename, ".ko");
-            if (ext) {
-                *ext = '\0';
+#ifdef MODULECHECK_WITH_ZLIB
+    if (stream->compression == MODULE_COMPRESSION_GZIP) {
+        stream->gzip.next_out = output;
+        stream->gzip.avail_out = (uInt)size;
+        while (stream->gzip.avail_out == size) {
+            if (stream->gzip.avail_in == 0) {
+                stream->gzip.next_in = stream->input;
+                stream->gzip.avail_in = (uInt)fread(stream->input, 1, sizeof(stream->input), stream->fp);
+                stats_add(bytes_read, stream->gzip.avail_in);
             }
-            
-            // Normalize
-            for (char *p = filename; *p; p++) {
-                if (*p == '-') *p = '_';
+            int ret = inflate(&stream->gzip, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                stream->finished = 1;
+                break;
             }
-            
-            if (strcmp(filename, search_name) == 0) {
-                fclose(fp);
-                return 1;
+            if (ret != Z_OK) {
+                return -1;  // includes Z_BUF_ERROR: input ended mid-stream
             }
         }
+        return (ssize_t)(size - stream->gzip.avail_out);
     }
+#endif
     
-    fclose(fp);
-    return 0;
+#ifdef MODULECHECK_WITH_LZMA
+    if (stream->compression == MODULE_COMPRESSION_XZ) {
+        stream->xz.next_out = output;
+        stream->xz.avail_out = size;
+        while (stream->xz.avail_out == size) {
+            lzma_action action = LZMA_RUN;
+            if (stream->xz.avail_in == 0) {
+                stream->xz.next_in = stream->input;
+                stream->xz.avail_in = fread(stream->input, 1, sizeof(stream->input), stream->fp);
+                stats_add(bytes_read, stream->xz.avail_in);
+                if (stream->xz.avail_in == 0) {
+                    action = LZMA_FINISH;
+                }
+            }
+            lzma_ret ret = lzma_code(&stream->xz, action);
+            if (ret == LZMA_STREAM_END) {
+                stream->finished = 1;
+                break;
+            }
+            if (ret != LZMA_OK) {
+                return -1;
+            }
+        }
+        return (ssize_t)(size - stream->xz.avail_out);
+    }
+#endif
+    
+#ifdef MODULECHECK_WITH_ZSTD
+    if (stream->compression == MODULE_COMPRESSION_ZSTD) {
+        ZSTD_outBuffer out = { output, size, 0 };
+        while (out.pos == 0) {
+            if (stream->zstd_input.pos == stream->zstd_input.size) {
+                size_t got = fread(stream->input, 1, sizeof(stream->input), stream->fp);
+                stats_add(bytes_read, got);
+                if (got == 0) {
+                    // A frame that ended exactly at the last output isn't an error
+                    stream->finished = 1;
+                    return 0;
+                }
+                stream->zstd_input.src = stream->input;
+                stream->zstd_input.size = got;
+                stream->zstd_input.pos = 0;
+            }
+            size_t ret = ZSTD_decompressStream(stream->zstd, &out, &stream->zstd_input);
+            if (ZSTD_isError(ret)) {
+                return -1;
+            }
+        }
+        return (ssize_t)out.pos;
+    }
+#endif
+    
+    return -1;
+}
+
+// Unsigned field of an ELF structure in the file's byte order
+static uint64_t elf_field(const unsigned char *p, int size, int big_endian) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) {
+        value |= (uint64_t)p[big_endian ? size - 1 - i : i] << (8 * i);
+    }
+    return value;
 }
 
 /*
- * find_module_file()
- * 
- * Searches for the .ko (kernel object) file for a module.
- * 
- * Search locations:
- * 1. /lib/modules/<kernel>/kernel/ (standard location)
- * 2. /lib/modules/<kernel>/extra/ (third-party modules)
- * 3. /lib/modules/<kernel>/updates/ (distribution updates)
- * 
- * Why this matters:
- * - Confirms module is available to load
- * - Can check module dependencies
- * - Useful for troubleshooting
+ * Where .modinfo is in the (partial) module image data[0..length)
+ * Returns 1 with offset/size set, 0 if more bytes are needed (*needed is
+ * set to how many), -1 if this is no ELF module or has no .modinfo
  */
-int find_module_file(const char *module_name, const char *kernel_version, char *result_path) {
-    char search_paths[3][MAX_PATH];
-    char cmd[MAX_CMD];
-    FILE *fp;
+static int elf_locate_modinfo(const unsigned char *data, size_t length, size_t *needed,
+                              size_t *offset, size_t *size) {
+    if (length < 64) {
+        *needed = 64;
+        return 0;
+    }
+    if (memcmp(data, "\177ELF", 4) != 0 || (data[4] != 1 && data[4] != 2) || (data[5] != 1 && data[5] != 2)) {
+        return -1;
+    }
+    
+    int is64 = data[4] == 2;
+    int big_endian = data[5] == 2;
+    uint64_t shoff = is64 ? elf_field(data + 0x28, 8, big_endian) : elf_field(data + 0x20, 4, big_endian);
+    uint64_t shentsize = elf_field(data + (is64 ? 0x3a : 0x2e), 2, big_endian);
+    uint64_t shnum = elf_field(data + (is64 ? 0x3c : 0x30), 2, big_endian);
+    uint64_t shstrndx = elf_field(data + (is64 ? 0x3e : 0x32), 2, big_endian);
+    
+    // Anything bigger than this is no kernel module (and would only make us allocate)
+    const uint64_t limit = 1024ull * 1024 * 1024;
+    if (shentsize < (is64 ? 64u : 40u) || shnum == 0 || shstrndx >= shnum || shoff > limit) {
+        return -1;
+    }
+    uint64_t table_end = shoff + shnum * shentsize;
+    if (table_end > limit) {
+        return -1;
+    }
+    if (length < table_end) {
+        *needed = (size_t)table_end;
+        return 0;
+    }
+    
+    // Section i: name, offset, size
+    #define SECTION(i) (data + shoff + (i) * shentsize)
+    #define SECTION_NAME(i) elf_field(SECTION(i), 4, big_endian)
+    #define SECTION_OFFSET(i) (is64 ? elf_field(SECTION(i) + 0x18, 8, big_endian) : elf_field(SECTION(i) + 0x10, 4, big_endian))
+    #define SECTION_SIZE(i) (is64 ? elf_field(SECTION(i) + 0x20, 8, big_endian) : elf_field(SECTION(i) + 0x14, 4, big_endian))
+    
+    uint64_t strtab = SECTION_OFFSET(shstrndx);
+    uint64_t strtab_size = SECTION_SIZE(shstrndx);
+    int result = -1;
+    if (strtab > limit || strtab_size > limit) {
+        result = -1;
+    } else if (length < strtab + strtab_size) {
+        *needed = (size_t)(strtab + strtab_size);
+        result = 0;
+    } else {
+        for (uint64_t i = 0; i < shnum; i++) {
+            uint64_t name = SECTION_NAME(i);
+            if (name + sizeof(".modinfo") > strtab_size ||
+                memcmp(data + strtab + name, ".modinfo", sizeof(".modinfo")) != 0) {
+                continue;
+            }
+            
+            uint64_t start = SECTION_OFFSET(i);
+            uint64_t bytes = SECTION_SIZE(i);
+            if (start > limit || bytes > limit) {
+                break;
+            }
+            if (length < start + bytes) {
+                *needed = (size_t)(start + bytes);
+                result = 0;
+            } else {
+                *offset = (size_t)start;
+                *size = (size_t)bytes;
+                result = 1;
+            }
+            break;
+        }
+    }
+    
+    #undef SECTION
+    #undef SECTION_NAME
+    #undef SECTION_OFFSET
+    #undef SECTION_SIZE
+    return result;
+}
+
+int module_info_read(const char *path, ModuleInfo *info) {
+    ModuleStream stream;
+    unsigned char *data = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    size_t needed = 64;
+    size_t offset = 0;
+    size_t size = 0;
+    int state = 0;
+    
+    memset(info, 0, sizeof(ModuleInfo));
+    if (!module_stream_open(&stream, path)) {
+        return 0;
+    }
+    info->compression = stream.compression;
+    
+    /*
+     * Decompress in steps until the section headers and .modinfo are in;
+     * each step produces at least what the headers said is still missing
+     */
+    while (state == 0) {
+        while (length < needed) {
+            size_t want = needed - length < 65536 ? 65536 : needed - length;
+            if (capacity < length + want) {
+                unsigned char *grown = realloc(data, length + want);
+                if (grown == NULL) break;
+                data = grown;
+                capacity = length + want;
+            }
+            ssize_t got = module_stream_read(&stream, data + length, capacity - length);
+            if (got <= 0) break;
+            length += (size_t)got;
+        }
+        if (length < needed) {
+            state = -1;  // truncated, corrupt or out of memory
+            break;
+        }
+        state = elf_locate_modinfo(data, length, &needed, &offset, &size);
+    }
+    module_stream_close(&stream);
+    
+    info->bytes_decompressed = length;
+    if (state == 1) {
+        info->data = malloc(size + 1);
+        if (info->data != NULL) {
+            memcpy(info->data, data + offset, size);
+            info->data[size] = '\0';
+            info->length = size;
+        }
+    }
+    free(data);
+    return info->data != NULL;
+}
+
+const char *module_info_get(const ModuleInfo *info, const char *key, const char *previous) {
+    size_t key_length = strlen(key);
+    const char *end = info->data + info->length;
+    const char *p = info->data;
+    
+    if (previous != NULL) {
+        // previous is a value; continue after its string
+        p = previous + strlen(previous) + 1;
+    }
+    
+    // Entries are "key=value" strings, separated by one or more NULs (alignment padding)
+    while (p != NULL && p < end) {
+        size_t entry_length = strnlen(p, (size_t)(end - p));
+        if (entry_length > key_length && strncmp(p, key, key_length) == 0 && p[key_length] == '=') {
+            return p + key_length + 1;
+        }
+        p += entry_length + 1;
+    }
+    return NULL;
+}
+
+void module_info_free(ModuleInfo *info) {
+    free(info->data);
+    memset(info, 0, sizeof(ModuleInfo));
+}
+
+// <name>.ko[.gz|.xz|.zst] anywhere below dir ('-' and '_' alike); symlinks aren't followed
+static int find_module_file_in(const char *dir, const char *search_name, char *result_path, int depth) {
+    char name[MAX_MODULE_NAME];
+    char path[MAX_PATH];
+    int found = 0;
+    
+    DIR *d = opendir(dir);
+    if (d == NULL || depth > 16) {
+        if (d != NULL) closedir(d);
+        return 0;
+    }
+    
+    struct dirent *de;
+    while (!found && (de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        int written = snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (written < 0 || (size_t)written >= sizeof(path)) {
+            continue;
+        }
+        
+        unsigned char type = de->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(path, &st) != 0) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_LNK);
+        }
+        
+        if (type == DT_DIR) {
+            found = find_module_file_in(path, search_name, result_path, depth + 1);
+        } else if (type == DT_REG && module_compression_from_path(de->d_name) != MODULE_COMPRESSION_UNKNOWN &&
+                   module_name_from_path(de->d_name, strlen(de->d_name), name, sizeof(name)) &&
+                   strcmp(name, search_name) == 0) {
+            strcpy(result_path, path);
+            found = 1;
+        }
+    }
+    
+    closedir(d);
+    return found;
+}
+
+// find_module_file() without the modinfo fallback
+static int find_module_file_native(const char *module_name, const char *kernel_version, char *result_path) {
+    static const char *const subdirs[] = { "kernel", "extra", "updates" };
+    char search_path[MAX_PATH];
+    char search_name[MAX_MODULE_NAME];
+    
+    // Normalize module name for search
+    strncpy(search_name, module_name, sizeof(search_name) - 1);
+    search_name[sizeof(search_name) - 1] = '\0';
+    for (char *p = search_name; *p; p++) {
+        if (*p == '-') *p = '_';
+    }
+    
+    // modules.dep(.bin) knows the path of every module depmod saw
+    char dep[MAX_PATH];
+    if (module_index_lookup(kernel_version, MODULE_INDEX_DEP, search_name, dep, sizeof(dep))) {
+        dep[strcspn(dep, ":")] = '\0';
+        int written = root_path(search_path, sizeof(search_path), "/lib/modules/%s/%s", kernel_version, dep);
+        if (written > 0 && (size_t)written < sizeof(search_path) && access(search_path, F_OK) == 0) {
+            strcpy(result_path, search_path);
+            return 1;
+        }
+    }
+    
+    for (int i = 0; i < 3; i++) {
+        root_path(search_path, sizeof(search_path), "/lib/modules/%s/%s", kernel_version, subdirs[i]);
+        if (find_module_file_in(search_path, search_name, result_path, 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * kmod binary indexes
+ * 
+ * depmod writes modules.dep.bin, modules.alias.bin, modules.symbols.bin and
+ * (kmod 27+) modules.builtin.bin next to the text files: prefix tries that
+ * modprobe mmaps and walks instead of parsing. We do the same, so a lookup
+ * touches a handful of pages and needs no startup work. Layout (all
+ * integers big endian):
+ * 
+ *   header: u32 magic 0xB007F457, u32 version 0x0002xxxx, u32 root node
+ *   node reference: u32 file offset | flags (PREFIX, VALUES, CHILDS)
+ *   node: [prefix string\0] [u8 first, u8 last, u32 child[last-first+1]]
+ *         [u32 count, count x (u32 priority, value string\0)]
+ * 
+ * Each file is mapped once per kernel version and stays mapped for the life
+ * of the process. When a .bin file is missing or invalid, the text file is
+ * scanned instead.
+ */
+
+#define KMOD_INDEX_MAGIC 0xB007F457u
+#define KMOD_INDEX_VERSION_MAJOR 0x0002u
+#define KMOD_NODE_PREFIX 0x80000000u
+#define KMOD_NODE_VALUES 0x40000000u
+#define KMOD_NODE_CHILDS 0x20000000u
+#define KMOD_NODE_MASK   0x0FFFFFFFu
+
+static const char *const module_index_files[MODULE_INDEX_COUNT] = {
+    "modules.dep", "modules.alias", "modules.symbols", "modules.builtin",
+};
+
+typedef struct {
+    const char *prefix;
+    size_t prefix_length;
+    int first;
+    int last;
+    const unsigned char *children;
+    uint32_t value_count;
+    const unsigned char *values;
+} KmodNode;
+
+static uint32_t kmod_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int module_bin_index_open(ModuleBinIndex *index, const char *path) {
+    struct stat st;
+    
+    memset(index, 0, sizeof(ModuleBinIndex));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < 12 || (uint64_t)st.st_size > KMOD_NODE_MASK) {
+        close(fd);
+        return 0;
+    }
+    
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    
+    const unsigned char *data = map;
+    if (kmod_u32(data) != KMOD_INDEX_MAGIC || (kmod_u32(data + 4) >> 16) != KMOD_INDEX_VERSION_MAJOR) {
+        munmap(map, (size_t)st.st_size);
+        return 0;
+    }
+    
+    index->data = data;
+    index->size = (size_t)st.st_size;
+    index->root = kmod_u32(data + 8);
+    return 1;
+}
+
+void module_bin_index_close(ModuleBinIndex *index) {
+    if (index->data != NULL) {
+        munmap((void *)index->data, index->size);
+    }
+    memset(index, 0, sizeof(ModuleBinIndex));
+}
+
+// Decode the node a reference points to; 0 if it points outside the file
+static int kmod_node_read(const ModuleBinIndex *index, uint32_t reference, KmodNode *node) {
+    size_t offset = reference & KMOD_NODE_MASK;
+    const unsigned char *end = index->data + index->size;
+    const unsigned char *p = index->data + offset;
+    
+    memset(node, 0, sizeof(KmodNode));
+    node->prefix = "";
+    node->first = 1;  // no children: first > last
+    if (offset < 12 || offset >= index->size) {
+        return 0;
+    }
+    
+    if (reference & KMOD_NODE_PREFIX) {
+        const unsigned char *nul = memchr(p, '\0', (size_t)(end - p));
+        if (nul == NULL) {
+            return 0;
+        }
+        node->prefix = (const char *)p;
+        node->prefix_length = (size_t)(nul - p);
+        p = nul + 1;
+    }
+    
+    if (reference & KMOD_NODE_CHILDS) {
+        if (end - p < 2 || p[1] < p[0]) {
+            return 0;
+        }
+        node->first = p[0];
+        node->last = p[1];
+        p += 2;
+        if ((size_t)(end - p) < 4 * (size_t)(node->last - node->first + 1)) {
+            return 0;
+        }
+        node->children = p;
+        p += 4 * (node->last - node->first + 1);
+    }
+    
+    if (reference & KMOD_NODE_VALUES) {
+        if (end - p < 4) {
+            return 0;
+        }
+        node->value_count = kmod_u32(p);
+        node->values = p + 4;
+    }
+    return 1;
+}
+
+// First value of a node (values are sorted by priority), or NULL
+static const char *kmod_node_value(const ModuleBinIndex *index, const KmodNode *node) {
+    const unsigned char *end = index->data + index->size;
+    if (node->value_count == 0 || end - node->values < 5) {
+        return NULL;
+    }
+    const char *value = (const char *)node->values + 4;
+    return memchr(value, '\0', (size_t)(end - (const unsigned char *)value)) != NULL ? value : NULL;
+}
+
+static uint32_t kmod_node_child(const KmodNode *node, int c) {
+    if (c < node->first || c > node->last) {
+        return 0;
+    }
+    return kmod_u32(node->children + 4 * (c - node->first));
+}
+
+const char *module_bin_index_lookup(const ModuleBinIndex *index, const char *key) {
+    uint32_t reference = index->root;
+    size_t i = 0;
+    
+    for (int depth = 0; reference != 0 && depth < 4096; depth++) {
+        KmodNode node;
+        if (!kmod_node_read(index, reference, &node) ||
+            strncmp(node.prefix, key + i, node.prefix_length) != 0) {
+            return NULL;
+        }
+        i += node.prefix_length;
+        if (key[i] == '\0') {
+            return kmod_node_value(index, &node);
+        }
+        reference = kmod_node_child(&node, (unsigned char)key[i]);
+        i++;
+    }
+    return NULL;
+}
+
+// Depth-first search for a stored pattern that fnmatch()es key; pattern holds the path so far
+static const char *kmod_search_wild(const ModuleBinIndex *index, uint32_t reference, const char *key,
+                                    char *pattern, size_t length, size_t capacity) {
+    KmodNode node;
+    if (!kmod_node_read(index, reference, &node) || length + node.prefix_length + 2 > capacity) {
+        return NULL;
+    }
+    memcpy(pattern + length, node.prefix, node.prefix_length);
+    length += node.prefix_length;
+    pattern[length] = '\0';
+    
+    // Up to the first wildcard the stored key must equal the key, or nothing below can match
+    size_t literal = strcspn(pattern, "*?[");
+    if (strncmp(pattern, key, literal) != 0) {
+        return NULL;
+    }
+    
+    if (node.value_count > 0 && fnmatch(pattern, key, 0) == 0) {
+        return kmod_node_value(index, &node);
+    }
+    
+    for (int c = node.first; c <= node.last; c++) {
+        uint32_t child = kmod_node_child(&node, c);
+        if (child == 0) {
+            continue;
+        }
+        pattern[length] = (char)c;
+        pattern[length + 1] = '\0';
+        const char *value = kmod_search_wild(index, child, key, pattern, length + 1, capacity);
+        if (value != NULL) {
+            return value;
+        }
+    }
+    return NULL;
+}
+
+const char *module_bin_index_match(const ModuleBinIndex *index, const char *key) {
+    char pattern[MAX_PATH];
+    return kmod_search_wild(index, index->root, key, pattern, 0, sizeof(pattern));
+}
+
+// Mapped indexes per kernel version. A lookup holds its slot (users) while it reads the index
+// without the lock, so only slots nobody holds are unmapped. MODULE_INDEX_CACHE_SIZE versions stay
+// mapped; past that the least recently used one is replaced, and if every slot is held the lookup
+// scans the text file instead
+#define MODULE_INDEX_CACHE_SIZE 8
+
+static struct {
+    char version[MAX_MODULE_NAME];
+    ModuleBinIndex indexes[MODULE_INDEX_COUNT];
+    int tried[MODULE_INDEX_COUNT];
+    int users;              // lookups holding one of its indexes (module_bin_index_get/release)
+    unsigned long used;     // module_index_clock when last asked for
+} module_index_cache[MODULE_INDEX_CACHE_SIZE];
+static unsigned long module_index_clock;
+static pthread_mutex_t module_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// A kernel version's mapped index, or NULL; *slot is held until module_bin_index_release()
+static const ModuleBinIndex *module_bin_index_get(const char *kernel_version, int which, int *slot) {
+    const ModuleBinIndex *result = NULL;
+    int victim = -1;
+    
+    if (strlen(kernel_version) >= MAX_MODULE_NAME) {
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&module_index_lock);
+    int i;
+    for (i = 0; i < MODULE_INDEX_CACHE_SIZE; i++) {
+        if (strcmp(module_index_cache[i].version, kernel_version) == 0) {
+            break;
+        }
+        // The least recently used slot nobody holds; a free one was never used (0)
+        if (module_index_cache[i].users == 0 &&
+            (victim < 0 || module_index_cache[i].used < module_index_cache[victim].used)) {
+            victim = i;
+        }
+    }
+    if (i == MODULE_INDEX_CACHE_SIZE && victim >= 0) {
+        i = victim;
+        for (int w = 0; w < MODULE_INDEX_COUNT; w++) {
+            module_bin_index_close(&module_index_cache[i].indexes[w]);
+        }
+        memset(&module_index_cache[i], 0, sizeof(module_index_cache[i]));
+        strcpy(module_index_cache[i].version, kernel_version);
+    }
+    
+    if (i < MODULE_INDEX_CACHE_SIZE) {
+        if (module_index_cache[i].tried[which]) {
+            stats_add(cache_hits, 1);
+        } else {
+            char path[MAX_PATH];
+            stats_add(cache_misses, 1);
+            root_path(path, sizeof(path), "/lib/modules/%s/%s.bin", kernel_version, module_index_files[which]);
+            module_bin_index_open(&module_index_cache[i].indexes[which], path);
+            module_index_cache[i].tried[which] = 1;
+        }
+        module_index_cache[i].used = ++module_index_clock;
+        if (module_index_cache[i].indexes[which].data != NULL) {
+            result = &module_index_cache[i].indexes[which];
+            module_index_cache[i].users++;
+            *slot = i;
+        }
+    }
+    pthread_mutex_unlock(&module_index_lock);
+    return result;
+}
+
+// Done with an index from module_bin_index_get(); its version may be unmapped from now on
+static void module_bin_index_release(int slot) {
+    pthread_mutex_lock(&module_index_lock);
+    module_index_cache[slot].users--;
+    pthread_mutex_unlock(&module_index_lock);
+}
+
+// modprobe's alias normalization: '-' becomes '_', except inside [...]
+static void module_alias_normalize(const char *alias, char *normalized, size_t size) {
+    size_t length = 0;
+    int in_brackets = 0;
+    for (const char *p = alias; *p && length + 1 < size; p++) {
+        if (*p == '[') in_brackets = 1;
+        if (*p == ']') in_brackets = 0;
+        normalized[length++] = (*p == '-' && !in_brackets) ? '_' : *p;
+    }
+    normalized[length] = '\0';
+}
+
+// The text file behind an index, scanned line by line
+static int module_text_index_lookup(const char *kernel_version, int which, const char *key,
+                                    char *value, size_t size) {
+    char path[MAX_PATH];
+    char name[MAX_MODULE_NAME];
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t line_length;
+    int found = 0;
+    
+    root_path(path, sizeof(path), "/lib/modules/%s/%s", kernel_version, module_index_files[which]);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    
+    while (!found && (line_length = read_line(&line, &line_size, fp)) != -1) {
+        if (line_length > 0 && line[line_length - 1] == '\n') {
+            line[--line_length] = '\0';
+        }
+        
+        if (which == MODULE_INDEX_DEP || which == MODULE_INDEX_BUILTIN) {
+            // "kernel/.../name.ko[.xz][: deps]", keyed by module name
+            size_t path_length = strcspn(line, ":");
+            if (module_name_from_path(line, path_length, name, sizeof(name)) && strcmp(name, key) == 0) {
+                snprintf(value, size, "%s", line);
+                found = 1;
+            }
+        } else {
+            // "alias <pattern> <module>" (modules.symbols: "alias symbol:<name> <module>")
+            char *save = NULL;
+            char *keyword = strtok_r(line, " \t", &save);
+            char *pattern = strtok_r(NULL, " \t", &save);
+            char *module = strtok_r(NULL, " \t", &save);
+            if (keyword == NULL || strcmp(keyword, "alias") != 0 || pattern == NULL || module == NULL) {
+                continue;
+            }
+            if (which == MODULE_INDEX_SYMBOLS) {
+                found = strcmp(pattern, key) == 0;
+            } else {
+                // depmod writes the patterns as modules declare them ("fs-ext4"); the key is already normalized
+                char normalized[MAX_PATH];
+                module_alias_normalize(pattern, normalized, sizeof(normalized));
+                found = fnmatch(normalized, key, 0) == 0;
+            }
+            if (found) {
+                snprintf(value, size, "%s", module);
+            }
+        }
+    }
+    
+    free(line);
+    fclose(fp);
+    return found;
+}
+
+int module_index_lookup(const char *kernel_version, int which, const char *key, char *value, size_t size) {
+    char normalized[MAX_PATH];
+    
+    if (which < 0 || which >= MODULE_INDEX_COUNT || size == 0) {
+        return 0;
+    }
+    value[0] = '\0';
+    
+    // Module names are stored with underscores; alias patterns keep '-' only inside brackets
+    if (which == MODULE_INDEX_ALIAS) {
+        module_alias_normalize(key, normalized, sizeof(normalized));
+    } else {
+        snprintf(normalized, sizeof(normalized), "%s", key);
+        for (char *p = normalized; which != MODULE_INDEX_SYMBOLS && *p; p++) {
+            if (*p == '-') *p = '_';
+        }
+    }
+    
+    int slot;
+    const ModuleBinIndex *index = module_bin_index_get(kernel_version, which, &slot);
+    if (index == NULL) {
+        return module_text_index_lookup(kernel_version, which, normalized, value, size);
+    }
+    
+    const char *found = (which == MODULE_INDEX_ALIAS) ? module_bin_index_match(index, normalized)
+                                                      : module_bin_index_lookup(index, normalized);
+    if (found != NULL) {
+        snprintf(value, size, "%s", found);
+    }
+    module_bin_index_release(slot);
+    return found != NULL;
+}
+
+/*
+ * find_module_file()
+ * 
+ * Searches for the .ko (kernel object) file for a module.
+ * 
+ * Search locations:
+ * 1. /lib/modules/<kernel>/kernel/ (standard location)
+ * 2. /lib/modules/<kernel>/extra/ (third-party modules)
+ * 3. /lib/modules/<kernel>/updates/ (distribution updates)
+ * Matches <name>.ko, .ko.gz, .ko.xz and .ko.zst; modinfo is only run when
+ * none of the trees has the file.
+ * 
+ * Why this matters:
+ * - Confirms module is available to load
+ * - Can check module dependencies
+ * - Useful for troubleshooting
+ */
+int find_module_file(const char *module_name, const char *kernel_version, char *result_path) {
+    FILE *fp;
+    
+    // Walk the module trees directly, compressed modules included
+    if (find_module_file_native(module_name, kernel_version, result_path)) {
+        return 1;
+    }
+    
+    char search_name[MAX_MODULE_NAME];
+    strncpy(search_name, module_name, sizeof(search_name) - 1);
+    search_name[sizeof(search_name) - 1] = '\0';
+    for (char *p = search_name; *p; p++) {
+        if (*p == '-') *p = '_';
+    }
+    
+    // Try modinfo as fallback (-b/-k: the tree below the root prefix)
+    char *argv[10];
+    int argc = 0;
+    pid_t pid;
+    argv[argc++] = "modinfo";
+    if (module_root[0] != '\0') {
+        argv[argc++] = "-b";
+        argv[argc++] = module_root;
+        argv[argc++] = "-k";
+        argv[argc++] = (char *)kernel_version;
+    }
+    argv[argc++] = "-F";
+    argv[argc++] = "filename";
+    argv[argc++] = "--";
+    argv[argc++] = search_name;
+    argv[argc] = NULL;
+    fp = spawn(argv, &pid);
+    if (fp != NULL) {
+        if (fgets(result_path, MAX_PATH, fp) != NULL) {
+            stats_add(bytes_read, strlen(result_path));
+            result_path[strcspn(result_path, "\n")] = 0;
+            int status = spawn_wait(fp, pid);
+            
+            if (status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && 
+                strlen(result_path) > 0) {
+                return 1;
+            }
+        } else {
+            spawn_wait(fp, pid);
+        }
+    }
+    
+    return 0;
+}
+
+/*
+ * check_module_by_modinfo()
+ * 
+ * Uses modinfo command to get detailed module information.
+ * 
+ * Why this is useful:
+ * - Shows module aliases
+ * - Shows dependencies
+ * - Confirms module exists in system
+ * 
+ * The module file is looked up and its .modinfo read natively first
+ * (module_info_read(), compressed modules included); the modinfo command
+ * only runs for names that aren't a file, e.g. aliases from modules.alias.
+ * 
+ * modinfo output includes:
+ * - filename: /lib/modules/.../module.ko
+ * - alias: alternative names
+ * - depends: required modules
+ * - description: what the module does
+ */
+static int modinfo_filename(const char *module_name, const char *kernel_version, Module *mod);
+
+int check_module_by_modinfo(const char *module_name, Module *mod) {
+    char kernel_version[256] = "";
+    char path[MAX_PATH];
+    ModuleInfo info;
+    
+    // Native: the running kernel's module file, confirmed by reading its .modinfo
+    if (get_kernel_version(kernel_version, sizeof(kernel_version)) &&
+        find_module_file_native(module_name, kernel_version, path) &&
+        module_info_read(path, &info)) {
+        module_info_free(&info);
+        strncpy(mod->path, path, MAX_PATH - 1);
+        mod->path[MAX_PATH - 1] = '\0';
+        return 1;
+    }
+    
+    // An alias (pci:..., char-major-..., fs-...) from modules.alias(.bin), resolved to its module
+    char target[MAX_MODULE_NAME];
+    if (kernel_version[0] != '\0' &&
+        module_index_lookup(kernel_version, MODULE_INDEX_ALIAS, module_name, target, sizeof(target)) &&
+        find_module_file_native(target, kernel_version, path) &&
+        module_info_read(path, &info)) {
+        module_info_free(&info);
+        strncpy(mod->path, path, MAX_PATH - 1);
+        mod->path[MAX_PATH - 1] = '\0';
+        return 1;
+    }
+    
+    return modinfo_filename(module_name, (module_root[0] != '\0') ? kernel_version : NULL, mod);
+}
+
+// Run modinfo for a name, for kernel_version (NULL: the running kernel) below the root prefix
+static int modinfo_filename(const char *module_name, const char *kernel_version, Module *mod) {
+    FILE *fp;
+    char line[512];
+    char *argv[8];
+    int argc = 0;
+    pid_t pid;
+    
+    argv[argc++] = "modinfo";
+    if (module_root[0] != '\0') {
+        argv[argc++] = "-b";
+        argv[argc++] = module_root;
+    }
+    if (kernel_version != NULL) {
+        argv[argc++] = "-k";
+        argv[argc++] = (char *)kernel_version;
+    }
+    argv[argc++] = "--";
+    argv[argc++] = (char *)module_name;
+    argv[argc] = NULL;
+    fp = spawn(argv, &pid);
+    
+    if (fp == NULL) {
+        return 0;
+    }
+    
+    int found = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        stats_add(bytes_read, strlen(line));
+        if (strncmp(line, "filename:", 9) == 0) {
+            found = 1;
+            // Extract filename
+            char *filename = line + 9;
+            while (*filename == ' ' || *filename == '\t') filename++;
+            
+            strncpy(mod->path, filename, MAX_PATH - 1);
+            mod->path[strcspn(mod->path, "\n")] = 0;
+        }
+    }
+    
+    int status = spawn_wait(fp, pid);
+    return found && status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int find_family_strategy(int strategy, const char *pattern, const char *kernel_version,
+                                ModuleCheckContext *context, Module *mod);
+static int context_module_info(ModuleCheckContext *context, const char *module_name, Module *mod);
+
+/*
+ * find_module_names()
+ * 
+ * The search behind find_module(), over a plain list of candidate names
+ * (primary name first, then aliases) so that Module and CompactModule
+ * entries share it. Only the result fields of mod are written (loaded,
+ * available, builtin, found_as, path, found_by).
+ * 
+ * A name that is a family pattern is matched against the indexes of the
+ * running kernel instead (modinfo is skipped), and found_as becomes the
+ * matching module.
+ * 
+ * With a context (for kernel_version), every strategy goes through it.
+ * 
+ * Returns the index of the name that was found, or -1.
+ */
+static int find_module_names(const char *const *names, int name_count, const char *kernel_version,
+                             ModuleCheckContext *context, Module *mod) {
+    // Initialize
+    mod->loaded = 0;
+    mod->available = 0;
+    mod->builtin = 0;
+    mod->found_as[0] = '\0';
+    mod->path[0] = '\0';
+    mod->found_by = -1;
+    
+    // Every strategy call is timed when instrumentation is built in
+    double start;
+    int hit;
+    
+    /*
+     * STRATEGY 1: Check if currently loaded
+     * Primary name first, then aliases - module might be loaded under a different name
+     */
+    for (int i = 0; i < name_count; i++) {
+        int family = module_name_is_pattern(names[i]);
+        start = stats_clock();
+        hit = family ? find_family_strategy(MODULE_STRATEGY_LOADED, names[i], kernel_version, context, mod)
+                     : context ? module_context_is_loaded(context, names[i]) : is_module_loaded(names[i]);
+        stats_strategy(MODULE_STRATEGY_LOADED, start, hit);
+        if (hit) {
+            mod->loaded = 1;
+            mod->available = 1;
+            mod->found_by = MODULE_STRATEGY_LOADED;
+            if (!family) {
+                strncpy(mod->found_as, names[i], sizeof(mod->found_as) - 1);
+            }
+            
+            // Try to get module file path
+            start = stats_clock();
+            hit = context ? context_module_info(context, mod->found_as, mod) : check_module_by_modinfo(mod->found_as, mod);
+            stats_strategy(MODULE_STRATEGY_MODINFO, start, hit);
+            return i;
+        }
+    }
+    
+    /*
+     * STRATEGY 2: Check if built into kernel
+     * Built-in modules are always "available"
+     */
+    for (int i = 0; i < name_count; i++) {
+        int family = module_name_is_pattern(names[i]);
+        start = stats_clock();
+        hit = family ? find_family_strategy(MODULE_STRATEGY_BUILTIN, names[i], kernel_version, context, mod)
+                     : context ? module_context_is_builtin(context, names[i]) : is_module_builtin(names[i], kernel_version);
+        stats_strategy(MODULE_STRATEGY_BUILTIN, start, hit);
+        if (hit) {
+            mod->found_by = MODULE_STRATEGY_BUILTIN;
+            mod->builtin = 1;
+            mod->available = 1;
+            mod->loaded = 1; // Built-in = always loaded
+            if (!family) {
+                strncpy(mod->found_as, names[i], sizeof(mod->found_as) - 1);
+            }
+            strcpy(mod->path, "[built-in]");
+            return i;
+        }
+    }
+    
+    /*
+     * STRATEGY 3: Search for module file (not loaded but available)
+     */
+    for (int i = 0; i < name_count; i++) {
+        int family = module_name_is_pattern(names[i]);
+        start = stats_clock();
+        hit = family ? find_family_strategy(MODULE_STRATEGY_FILE, names[i], kernel_version, context, mod)
+                     : context ? module_context_find_file(context, names[i], mod->path)
+                               : find_module_file(names[i], kernel_version, mod->path);
+        stats_strategy(MODULE_STRATEGY_FILE, start, hit);
+        if (hit) {
+            mod->found_by = MODULE_STRATEGY_FILE;
+            mod->available = 1;
+            if (!family) {
+                strncpy(mod->found_as, names[i], sizeof(mod->found_as) - 1);
+            }
+            return i;
+        }
+    }
+    
+    /*
+     * STRATEGY 4: Use modinfo as final check
+     * Sometimes modules exist but are in non-standard locations
+     */
+    for (int i = 0; i < name_count; i++) {
+        if (module_name_is_pattern(names[i])) {
+            continue;  // modinfo takes names, not wildcards
+        }
+        start = stats_clock();
+        hit = context ? context_module_info(context, names[i], mod) : check_module_by_modinfo(names[i], mod);
+        stats_strategy(MODULE_STRATEGY_MODINFO, start, hit);
+        if (hit) {
+            mod->found_by = MODULE_STRATEGY_MODINFO;
+            mod->available = 1;
+            strncpy(mod->found_as, names[i], sizeof(mod->found_as) - 1);
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+/*
+ * find_module()
+ * 
+ * Main search function - tries multiple strategies to find a module.
+ * 
+ * Search strategy:
+ * 1. Check if loaded (is_module_loaded), primary name then aliases
+ * 2. Check if built-in (is_module_builtin)
+ * 3. Find .ko file location
+ * 4. Use modinfo for confirmation
+ * 
+ * Module naming complexity:
+ * - v4l2loopback: exact match required
+ * - videodev: core v4l2 module
+ * - snd_hda_intel: sound card (underscores vs hyphens)
+ */
+int find_module(Module *mod, const char *kernel_version) {
+    const char *names[1 + MAX_ALIASES];
+    int name_count = 0;
+    
+    names[name_count++] = mod->name;
+    for (int i = 0; i < mod->alias_count && i < MAX_ALIASES; i++) {
+        names[name_count++] = mod->aliases[i];
+    }
+    
+    return find_module_names(names, name_count, kernel_version, NULL, mod) >= 0;
+}
+
+/*
+ * modprobe.d rules
+ * 
+ * A module that find_module() reports as AVAILABLE can still be kept out by
+ * modprobe: "blacklist" stops it from being loaded through its aliases (udev
+ * autoloading), "install" replaces loading it with a command (often
+ * /bin/false or /bin/true to disable it), and "alias" makes a name that is
+ * no module at all resolve to one. The config directories are read once into
+ * a ModprobeRules table and every batch entry is checked against it.
+ */
+
+// Searched in this order; a file name in an earlier directory hides the same name in later ones
+static const char *const modprobe_dirs[] = {
+    "/run/modprobe.d",
+    "/etc/modprobe.d",
+    "/usr/local/lib/modprobe.d",
+    "/usr/lib/modprobe.d",
+    "/lib/modprobe.d",
+};
+
+#define MODPROBE_DIR_COUNT (sizeof(modprobe_dirs) / sizeof(modprobe_dirs[0]))
+
+// modprobe treats '-' and '_' in module names alike; store and compare the underscore form
+static void modprobe_normalize(char *name) {
+    for (char *p = name; *p; p++) {
+        if (*p == '-') *p = '_';
+    }
+}
+
+static int modprobe_add_rule(ModprobeRules *rules, int type, char *name, const char *value) {
+    if (rules->count == rules->capacity) {
+        size_t capacity = rules->capacity ? rules->capacity * 2 : 64;
+        ModprobeRule *grown = realloc(rules->rules, capacity * sizeof(ModprobeRule));
+        if (grown == NULL) {
+            return 0;
+        }
+        rules->rules = grown;
+        rules->capacity = capacity;
+    }
+    
+    modprobe_normalize(name);
+    ModprobeRule *rule = &rules->rules[rules->count];
+    rule->type = type;
+    rule->name = module_strings_intern(&rules->strings, name);
+    rule->value = module_strings_intern(&rules->strings, value);
+    if (rule->name == MODULE_STRING_INVALID || rule->value == MODULE_STRING_INVALID) {
+        return 0;
+    }
+    rules->count++;
+    return 1;
+}
+
+// Parse one config file; lines ending in a backslash continue on the next line
+static int modprobe_parse_file(ModprobeRules *rules, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 1;  // unreadable files are skipped, like modprobe does
+    }
+    
+    char *line = NULL;
+    size_t line_size = 0;
+    char *logical = NULL;
+    size_t logical_length = 0;
+    ssize_t length;
+    int ok = 1;
+    
+    while (ok && (length = read_line(&line, &line_size, fp)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        int continued = length > 0 && line[length - 1] == '\\';
+        if (continued) {
+            line[--length] = '\0';
+        }
+        
+        char *joined = realloc(logical, logical_length + (size_t)length + 2);
+        if (joined == NULL) {
+            ok = 0;
+            break;
+        }
+        logical = joined;
+        memcpy(logical + logical_length, line, (size_t)length);
+        logical_length += (size_t)length;
+        logical[logical_length++] = ' ';
+        logical[logical_length] = '\0';
+        if (continued) {
+            continue;
+        }
+        logical_length = 0;
+        
+        char *save = NULL;
+        char *command = strtok_r(logical, " \t", &save);
+        if (command == NULL || command[0] == '#') {
+            continue;
+        }
+        char *name = strtok_r(NULL, " \t", &save);
+        if (name == NULL) {
+            continue;
+        }
+        
+        if (strcmp(command, "blacklist") == 0) {
+            ok = modprobe_add_rule(rules, MODPROBE_RULE_BLACKLIST, name, "");
+        } else if (strcmp(command, "alias") == 0) {
+            char *target = strtok_r(NULL, " \t", &save);
+            if (target != NULL) {
+                modprobe_normalize(target);
+                ok = modprobe_add_rule(rules, MODPROBE_RULE_ALIAS, name, target);
+            }
+        } else if (strcmp(command, "install") == 0) {
+            // The command is the rest of the line, as given
+            char *rest = save + strspn(save, " \t");
+            size_t rest_length = strlen(rest);
+            while (rest_length > 0 && (rest[rest_length - 1] == ' ' || rest[rest_length - 1] == '\t')) {
+                rest[--rest_length] = '\0';
+            }
+            ok = modprobe_add_rule(rules, MODPROBE_RULE_INSTALL, name, rest);
+        }
+        // options, remove, softdep, weakdep: no effect on whether a module can be loaded
+    }
+    
+    free(line);
+    free(logical);
+    fclose(fp);
+    return ok;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    const char *const *sa = a;
+    const char *const *sb = b;
+    return strcmp(strrchr(*sa, '/') + 1, strrchr(*sb, '/') + 1);
+}
+
+int modprobe_rules_load(ModprobeRules *rules) {
+    char **files = NULL;
+    size_t file_count = 0;
+    size_t file_capacity = 0;
+    int ok = 1;
+    
+    memset(rules, 0, sizeof(ModprobeRules));
+    
+    /*
+     * Step 1: Collect *.conf files
+     * The first directory that has a given file name wins
+     */
+    for (size_t dir = 0; ok && dir < MODPROBE_DIR_COUNT; dir++) {
+        char dir_path[MAX_PATH];
+        root_path(dir_path, sizeof(dir_path), "%s", modprobe_dirs[dir]);
+        DIR *d = opendir(dir_path);
+        if (d == NULL) {
+            continue;
+        }
+        
+        struct dirent *de;
+        while (ok && (de = readdir(d)) != NULL) {
+            size_t length = strlen(de->d_name);
+            if (de->d_name[0] == '.' || length < 6 || strcmp(de->d_name + length - 5, ".conf") != 0) {
+                continue;
+            }
+            
+            int shadowed = 0;
+            for (size_t i = 0; i < file_count && !shadowed; i++) {
+                shadowed = strcmp(strrchr(files[i], '/') + 1, de->d_name) == 0;
+            }
+            if (shadowed) {
+                continue;
+            }
+            
+            if (file_count == file_capacity) {
+                file_capacity = file_capacity ? file_capacity * 2 : 32;
+                char **grown = realloc(files, file_capacity * sizeof(char *));
+                if (grown == NULL) {
+                    ok = 0;
+                    break;
+                }
+                files = grown;
+            }
+            char *path = malloc(strlen(dir_path) + length + 2);
+            if (path == NULL) {
+                ok = 0;
+                break;
+            }
+            sprintf(path, "%s/%s", dir_path, de->d_name);
+            files[file_count++] = path;
+        }
+        closedir(d);
+    }
+    
+    /*
+     * Step 2: Parse them in file name order, whatever directory they came from
+     */
+    if (file_count > 0) {
+        qsort(files, file_count, sizeof(char *), compare_strings);
+    }
+    for (size_t i = 0; i < file_count; i++) {
+        if (ok) {
+            ok = modprobe_parse_file(rules, files[i]);
+            rules->file_count++;
+        }
+        free(files[i]);
+    }
+    free(files);
+    
+    /*
+     * Step 3: modprobe.blacklist=a,b on the kernel command line
+     */
+    char cmdline_path[MAX_PATH];
+    root_path(cmdline_path, sizeof(cmdline_path), "/proc/cmdline");
+    FILE *fp = ok ? fopen(cmdline_path, "r") : NULL;
+    if (fp != NULL) {
+        char *cmdline = NULL;
+        size_t cmdline_size = 0;
+        if (read_line(&cmdline, &cmdline_size, fp) != -1) {
+            char *save = NULL;
+            for (char *arg = strtok_r(cmdline, " \t\n", &save); ok && arg != NULL; arg = strtok_r(NULL, " \t\n", &save)) {
+                if (strncmp(arg, "modprobe.blacklist=", strlen("modprobe.blacklist=")) != 0) {
+                    continue;
+                }
+                char *list_save = NULL;
+                for (char *name = strtok_r(arg + strlen("modprobe.blacklist="), ",", &list_save);
+                     ok && name != NULL; name = strtok_r(NULL, ",", &list_save)) {
+                    ok = modprobe_add_rule(rules, MODPROBE_RULE_BLACKLIST, name, "");
+                }
+            }
+        }
+        free(cmdline);
+        fclose(fp);
+    }
+    
+    if (!ok) {
+        modprobe_rules_free(rules);
+        return -1;
+    }
+    return (int)rules->file_count;
+}
+
+void modprobe_rules_free(ModprobeRules *rules) {
+    free(rules->strings.data);
+    free(rules->strings.slots);
+    free(rules->rules);
+    memset(rules, 0, sizeof(ModprobeRules));
+}
+
+// First rule of a type for a module name (the first one read is the one modprobe uses)
+static const ModprobeRule *modprobe_find(const ModprobeRules *rules, int type, const char *module_name) {
+    char name[MAX_MODULE_NAME];
+    
+    if (rules == NULL || rules->count == 0) {
+        return NULL;
+    }
+    strncpy(name, module_name, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    modprobe_normalize(name);
+    
+    for (size_t i = 0; i < rules->count; i++) {
+        const ModprobeRule *rule = &rules->rules[i];
+        if (rule->type != type) {
+            continue;
+        }
+        const char *pattern = rules->strings.data + rule->name;
+        // Only aliases may be wildcards ("alias pci:v00008086d* e1000e")
+        if (type == MODPROBE_RULE_ALIAS ? fnmatch(pattern, name, 0) == 0 : strcmp(pattern, name) == 0) {
+            return rule;
+        }
+    }
+    return NULL;
+}
+
+int modprobe_is_blacklisted(const ModprobeRules *rules, const char *module_name) {
+    return modprobe_find(rules, MODPROBE_RULE_BLACKLIST, module_name) != NULL;
+}
+
+const char *modprobe_install_command(const ModprobeRules *rules, const char *module_name) {
+    const ModprobeRule *rule = modprobe_find(rules, MODPROBE_RULE_INSTALL, module_name);
+    return rule != NULL ? rules->strings.data + rule->value : NULL;
+}
+
+const char *modprobe_resolve_alias(const ModprobeRules *rules, const char *name) {
+    const ModprobeRule *rule = modprobe_find(rules, MODPROBE_RULE_ALIAS, name);
+    return rule != NULL ? rules->strings.data + rule->value : NULL;
+}
+
+// MODULE_FLAG_BLACKLISTED/INSTALL/DISABLED for a module name
+static uint16_t modprobe_verdict(const ModprobeRules *rules, const char *module_name) {
+    uint16_t flags = 0;
+    
+    if (modprobe_is_blacklisted(rules, module_name)) {
+        flags |= MODULE_FLAG_BLACKLISTED;
+    }
+    
+    const char *command = modprobe_install_command(rules, module_name);
+    if (command != NULL) {
+        flags |= MODULE_FLAG_INSTALL;
+        
+        // "install foo /bin/false" and "install foo /bin/true" are the usual way to disable a module
+        size_t length = strcspn(command, " \t;");
+        const char *program = command + length;
+        while (program > command && program[-1] != '/') {
+            program--;
+        }
+        size_t program_length = (size_t)(command + length - program);
+        if ((program_length == 4 && strncmp(program, "true", 4) == 0) ||
+            (program_length == 5 && strncmp(program, "false", 5) == 0)) {
+            flags |= MODULE_FLAG_DISABLED;
+        }
+    }
+    
+    return flags;
+}
+
+/*
+ * Compact batch representation
+ * 
+ * Module carries fixed buffers for every name, alias and path (~7.2 KB), which
+ * is fine for a handful of checks but not for thousands of entries across
+ * kernels. A ModuleBatch stores each string once in a shared, interned table
+ * and each entry as five IDs and a flag word. Only one scratch Module lives on
+ * the stack while an entry is being checked.
+ */
+
+// FNV-1a, good enough for module names and paths
+static uint32_t hash_string(const char *string) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)string; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Rebuild the hash slots at a new size (power of two)
+static int strings_rehash(ModuleStringTable *table, uint32_t slot_count) {
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) {
+        return 0;
+    }
+    
+    // Walk the stored strings; offset 0 (the empty string) is never hashed
+    for (uint32_t offset = 1; offset < table->length; offset += (uint32_t)strlen(table->data + offset) + 1) {
+        uint32_t slot = hash_string(table->data + offset) & (slot_count - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = offset;
+    }
+    
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return 1;
+}
+
+uint32_t module_strings_intern(ModuleStringTable *table, const char *string) {
+    if (string == NULL || string[0] == '\0') {
+        return MODULE_STRING_NONE;
+    }
+    
+    // Start with the empty string at offset 0
+    if (table->data == NULL) {
+        table->data = malloc(4096);
+        if (table->data == NULL) {
+            return MODULE_STRING_INVALID;
+        }
+        table->capacity = 4096;
+        table->data[0] = '\0';
+        table->length = 1;
+    }
+    
+    // Keep the table at most half full
+    if ((table->string_count + 1) * 2 > table->slot_count) {
+        if (!strings_rehash(table, table->slot_count ? table->slot_count * 2 : 64)) {
+            return MODULE_STRING_INVALID;
+        }
+    }
+    
+    uint32_t mask = table->slot_count - 1;
+    uint32_t slot = hash_string(string) & mask;
+    while (table->slots[slot] != 0) {
+        if (strcmp(table->data + table->slots[slot], string) == 0) {
+            return table->slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    // Not present, append it
+    size_t length = strlen(string) + 1;
+    if (table->length + length >= UINT32_MAX) {
+        return MODULE_STRING_INVALID;
+    }
+    if (table->length + length > table->capacity) {
+        size_t capacity = table->capacity;
+        while (table->length + length > capacity) {
+            capacity *= 2;
+        }
+        if (capacity > UINT32_MAX) {
+            capacity = UINT32_MAX;
+        }
+        char *data = realloc(table->data, capacity);
+        if (data == NULL) {
+            return MODULE_STRING_INVALID;
+        }
+        table->data = data;
+        table->capacity = (uint32_t)capacity;
+    }
+    
+    uint32_t offset = table->length;
+    memcpy(table->data + offset, string, length);
+    table->length += (uint32_t)length;
+    table->slots[slot] = offset;
+    table->string_count++;
+    return offset;
+}
+
+void module_batch_init(ModuleBatch *batch) {
+    memset(batch, 0, sizeof(ModuleBatch));
+}
+
+void module_batch_free(ModuleBatch *batch) {
+    free(batch->strings.data);
+    free(batch->strings.slots);
+    free(batch->aliases);
+    free(batch->modules);
+    memset(batch, 0, sizeof(ModuleBatch));
+}
+
+const char *module_batch_string(const ModuleBatch *batch, uint32_t id) {
+    if (batch->strings.data == NULL || id >= batch->strings.length) {
+        return "";
+    }
+    return batch->strings.data + id;
+}
+
+long module_batch_add(ModuleBatch *batch, const char *name, const char *const *aliases, size_t alias_count) {
+    if (name == NULL || alias_count > UINT16_MAX) {
+        return -1;
+    }
+    
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 64;
+        CompactModule *modules = realloc(batch->modules, capacity * sizeof(CompactModule));
+        if (modules == NULL) {
+            return -1;
+        }
+        batch->modules = modules;
+        batch->capacity = capacity;
+    }
+    
+    if (batch->alias_count + alias_count > batch->alias_capacity) {
+        size_t capacity = batch->alias_capacity ? batch->alias_capacity : 64;
+        while (batch->alias_count + alias_count > capacity) {
+            capacity *= 2;
+        }
+        uint32_t *alias_ids = realloc(batch->aliases, capacity * sizeof(uint32_t));
+        if (alias_ids == NULL) {
+            return -1;
+        }
+        batch->aliases = alias_ids;
+        batch->alias_capacity = capacity;
+    }
+    
+    CompactModule *mod = &batch->modules[batch->count];
+    memset(mod, 0, sizeof(CompactModule));
+    mod->name = module_strings_intern(&batch->strings, name);
+    if (mod->name == MODULE_STRING_INVALID) {
+        return -1;
+    }
+    
+    // Empty aliases are dropped, as they can never match
+    mod->alias_first = (uint32_t)batch->alias_count;
+    for (size_t i = 0; i < alias_count; i++) {
+        uint32_t alias = module_strings_intern(&batch->strings, aliases[i]);
+        if (alias == MODULE_STRING_INVALID) {
+            return -1;
+        }
+        if (alias != MODULE_STRING_NONE) {
+            batch->aliases[batch->alias_count++] = alias;
+            mod->alias_count++;
+        }
+    }
+    
+    return (long)batch->count++;
+}
+
+// The module modprobe would act on for a checked entry: the member of a family or the modprobe.d alias
+// target found (found_as), for a modules.alias name the module file it resolved to, else the name
+static const char *module_batch_verdict_name(const ModuleBatch *batch, const CompactModule *mod,
+                                             char *buffer, size_t size) {
+    const char *path = module_batch_string(batch, mod->path);
+    if (MODULE_FLAG_FOUND_BY(mod->flags) == MODULE_STRATEGY_MODINFO && strstr(path, ".ko") != NULL &&
+        module_name_from_path(path, strlen(path), buffer, size)) {
+        return buffer;
+    }
+    return module_batch_string(batch, mod->found_as != MODULE_STRING_NONE ? mod->found_as : mod->name);
+}
+
+// What modprobe would do with a checked entry; also reported for modules that weren't found
+static void module_batch_verdict(const ModuleBatch *batch, CompactModule *mod, const ModprobeRules *rules) {
+    char name[MAX_MODULE_NAME];
+    if (rules != NULL) {
+        mod->flags |= modprobe_verdict(rules, module_batch_verdict_name(batch, mod, name, sizeof(name)));
+    }
+}
+
+static int module_batch_check_entry(ModuleBatch *batch, size_t index, const char *kernel_version);
+
+int module_batch_check_one(ModuleBatch *batch, size_t index, const char *kernel_version) {
+#ifdef MODULECHECK_INSTRUMENTATION
+    // Everything counted while checking this entry also goes to the batch
+    ModuleCheckStats *previous = check_batch_stats;
+    check_batch_stats = batch->stats;
+    stats_add(modules_checked, 1);
+    int found = module_batch_check_entry(batch, index, kernel_version);
+    check_batch_stats = previous;
+    return found;
+#else
+    return module_batch_check_entry(batch, index, kernel_version);
+#endif
+}
+
+static int module_batch_check_entry(ModuleBatch *batch, size_t index, const char *kernel_version) {
+    if (index >= batch->count) {
+        return 0;
+    }
+    
+    CompactModule *entry = &batch->modules[index];
+    size_t name_count = 1 + (size_t)entry->alias_count;
+    const char *stack_names[1 + MAX_ALIASES];
+    const char **names = stack_names;
+    Module result;  // scratch for the search results only
+    
+    if (name_count > sizeof(stack_names) / sizeof(stack_names[0])) {
+        names = malloc(name_count * sizeof(const char *));
+        if (names == NULL) {
+            return 0;
+        }
+    }
+    
+    // The string table doesn't grow during the search, so these pointers stay valid
+    names[0] = module_batch_string(batch, entry->name);
+    for (size_t i = 1; i < name_count; i++) {
+        names[i] = module_batch_string(batch, batch->aliases[entry->alias_first + i - 1]);
+    }
+    
+    // The batch's context, if it is for this kernel
+    ModuleCheckContext *context = batch->context;
+    if (context != NULL && strcmp(module_context_kernel_version(context), kernel_version) != 0) {
+        context = NULL;
+    }
+    
+    int found = find_module_names(names, (int)name_count, kernel_version, context, &result);
+    const char *found_name = (found >= 0) ? names[found] : names[0];
+    
+    // A name that is no module may still be a modprobe.d alias for one
+    const char *alias_target = NULL;
+    for (size_t i = 0; found < 0 && i < name_count && batch->rules != NULL; i++) {
+        alias_target = module_name_is_pattern(names[i]) ? NULL : modprobe_resolve_alias(batch->rules, names[i]);
+        if (alias_target != NULL && find_module_names(&alias_target, 1, kernel_version, context, &result) == 0) {
+            found = 0;
+            found_name = alias_target;
+        } else {
+            alias_target = NULL;
+        }
+    }
+    
+    if (names != stack_names) {
+        free(names);
+    }
+    
+    entry->flags = 0;
+    entry->found_as = MODULE_STRING_NONE;
+    entry->path = MODULE_STRING_NONE;
+    if (found < 0) {
+        module_batch_verdict(batch, entry, batch->rules);
+        return 0;
+    }
+    
+    entry->flags |= (result.loaded ? MODULE_FLAG_LOADED : 0) |
+                    (result.available ? MODULE_FLAG_AVAILABLE : 0) |
+                    (result.builtin ? MODULE_FLAG_BUILTIN : 0) |
+                    (uint16_t)((result.found_by + 1) << MODULE_FLAG_STRATEGY_SHIFT);
+    if (alias_target != NULL) {
+        // The target string belongs to the rules, so it is interned into the batch
+        uint32_t target = module_strings_intern(&batch->strings, alias_target);
+        entry = &batch->modules[index];
+        entry->found_as = (target == MODULE_STRING_INVALID) ? entry->name : target;
+        entry->flags |= MODULE_FLAG_VIA_ALIAS;
+    } else if (module_name_is_pattern(found_name)) {
+        // A family: the member that matched
+        uint32_t member = module_strings_intern(&batch->strings, result.found_as);
+        entry = &batch->modules[index];
+        entry->found_as = (member == MODULE_STRING_INVALID) ? entry->name : member;
+    } else {
+        entry->found_as = (found == 0) ? entry->name : batch->aliases[entry->alias_first + (uint32_t)found - 1];
+    }
+    
+    // A path that can't be stored is dropped rather than failing the check
+    uint32_t path = module_strings_intern(&batch->strings, result.path);
+    entry = &batch->modules[index];
+    entry->path = (path == MODULE_STRING_INVALID) ? MODULE_STRING_NONE : path;
+    module_batch_verdict(batch, entry, batch->rules);
+    return 1;
+}
+
+size_t module_batch_check(ModuleBatch *batch, const char *kernel_version) {
+    size_t found = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        found += (size_t)module_batch_check_one(batch, i, kernel_version);
+    }
+    return found;
+}
+
+/*
+ * Symbol index
+ * 
+ * Which module exports a kernel symbol: modules.symbols.bin answers for
+ * module symbols directly. Everything else goes into one hash table per
+ * kernel: modules.symbols when there is no .bin, plus Module.symvers from
+ * the kernel headers, which also lists what vmlinux itself exports and
+ * whether an export is GPL-only.
+ */
+
+// Module.symvers of a kernel: headers linked from the module tree, then the distribution locations
+static const char *const symvers_paths[] = {
+    "/lib/modules/%s/build/Module.symvers",
+    "/usr/src/kernels/%s/Module.symvers",
+    "/usr/src/linux-headers-%s/Module.symvers",
+};
+
+static int symbol_index_grow(SymbolIndex *index) {
+    uint32_t slot_count = index->slot_count ? index->slot_count * 2 : 1024;
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < index->count; i++) {
+        uint32_t slot = hash_string(index->strings.data + index->entries[i].symbol) & (slot_count - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = (uint32_t)i + 1;
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->slot_count = slot_count;
+    return 1;
+}
+
+// Slot of a symbol: holding its entry index + 1, or 0 where it would go
+static uint32_t *symbol_index_slot(const SymbolIndex *index, const char *symbol) {
+    uint32_t mask = index->slot_count - 1;
+    uint32_t slot = hash_string(symbol) & mask;
+    while (index->slots[slot] != 0 &&
+           strcmp(index->strings.data + index->entries[index->slots[slot] - 1].symbol, symbol) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return &index->slots[slot];
+}
+
+// Add or update a symbol; the first provider seen is kept, flags accumulate
+static int symbol_index_add(SymbolIndex *index, const char *symbol, const char *module, uint32_t flags) {
+    if ((index->count + 1) * 2 > index->slot_count && !symbol_index_grow(index)) {
+        return 0;
+    }
+    
+    uint32_t *slot = symbol_index_slot(index, symbol);
+    if (*slot != 0) {
+        index->entries[*slot - 1].flags |= flags;
+        return 1;
+    }
+    
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 1024;
+        SymbolEntry *entries = realloc(index->entries, capacity * sizeof(SymbolEntry));
+        if (entries == NULL) {
+            return 0;
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    
+    SymbolEntry *entry = &index->entries[index->count];
+    entry->symbol = module_strings_intern(&index->strings, symbol);
+    entry->module = module_strings_intern(&index->strings, module);
+    entry->flags = flags;
+    if (entry->symbol == MODULE_STRING_INVALID || entry->module == MODULE_STRING_INVALID) {
+        return 0;
+    }
+    *slot = (uint32_t)index->count + 1;
+    index->count++;
+    return 1;
+}
+
+// modules.symbols: "alias symbol:<name> <module>"
+static int symbol_index_load_symbols(SymbolIndex *index, const char *kernel_version) {
+    char path[MAX_PATH];
+    char *line = NULL;
+    size_t line_size = 0;
+    int ok = 1;
+    
+    root_path(path, sizeof(path), "/lib/modules/%s/modules.symbols", kernel_version);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 1;
+    }
+    
+    while (ok && read_line(&line, &line_size, fp) != -1) {
+        char *save = NULL;
+        char *keyword = strtok_r(line, " \t\n", &save);
+        char *symbol = strtok_r(NULL, " \t\n", &save);
+        char *module = strtok_r(NULL, " \t\n", &save);
+        if (keyword != NULL && strcmp(keyword, "alias") == 0 && symbol != NULL && module != NULL &&
+            strncmp(symbol, "symbol:", strlen("symbol:")) == 0) {
+            ok = symbol_index_add(index, symbol + strlen("symbol:"), module, 0);
+        }
+    }
+    
+    free(line);
+    fclose(fp);
+    if (ok) {
+        index->sources |= SYMBOL_SOURCE_MODULES_SYMBOLS;
+    }
+    return ok;
+}
+
+// Module.symvers: "<crc>\t<symbol>\t<module path or vmlinux>\t<export type>[\t<namespace>]"
+static int symbol_index_load_symvers(SymbolIndex *index, const char *kernel_version) {
+    char path[MAX_PATH];
+    char module[MAX_MODULE_NAME];
+    char *line = NULL;
+    size_t line_size = 0;
+    int ok = 1;
+    FILE *fp = NULL;
+    
+    for (size_t i = 0; fp == NULL && i < sizeof(symvers_paths) / sizeof(symvers_paths[0]); i++) {
+        root_path(path, sizeof(path), symvers_paths[i], kernel_version);
+        fp = fopen(path, "r");
+    }
+    if (fp == NULL) {
+        return 1;
+    }
+    
+    while (ok && read_line(&line, &line_size, fp) != -1) {
+        char *save = NULL;
+        char *crc = strtok_r(line, "\t\n", &save);
+        char *symbol = strtok_r(NULL, "\t\n", &save);
+        char *owner = strtok_r(NULL, "\t\n", &save);
+        char *export = strtok_r(NULL, "\t\n", &save);
+        if (crc == NULL || symbol == NULL || owner == NULL) {
+            continue;
+        }
+        
+        // "drivers/sound/core/snd" -> "snd"; "vmlinux" stays
+        const char *base = strrchr(owner, '/');
+        base = (base != NULL) ? base + 1 : owner;
+        snprintf(module, sizeof(module), "%s", base);
+        for (char *p = module; *p; p++) {
+            if (*p == '-') *p = '_';
+        }
+        
+        uint32_t flags = (export != NULL && strstr(export, "_GPL") != NULL) ? SYMBOL_FLAG_GPL_ONLY : 0;
+        ok = symbol_index_add(index, symbol, module, flags);
+    }
+    
+    free(line);
+    fclose(fp);
+    if (ok) {
+        index->sources |= SYMBOL_SOURCE_SYMVERS;
+    }
+    return ok;
+}
+
+int symbol_index_load(SymbolIndex *index, const char *kernel_version, int skip_modules_symbols) {
+    memset(index, 0, sizeof(SymbolIndex));
+    snprintf(index->version, sizeof(index->version), "%s", kernel_version);
+    
+    int ok = symbol_index_grow(index);
+    if (ok && !skip_modules_symbols) {
+        ok = symbol_index_load_symbols(index, kernel_version);
+    }
+    if (ok) {
+        ok = symbol_index_load_symvers(index, kernel_version);
+    }
+    if (!ok) {
+        symbol_index_free(index);
+        return -1;
+    }
+    return (int)index->count;
+}
+
+const SymbolEntry *symbol_index_lookup(const SymbolIndex *index, const char *symbol) {
+    if (index->slot_count == 0) {
+        return NULL;
+    }
+    uint32_t slot = *symbol_index_slot(index, symbol);
+    return slot != 0 ? &index->entries[slot - 1] : NULL;
+}
+
+const char *symbol_index_string(const SymbolIndex *index, uint32_t id) {
+    if (index->strings.data == NULL || id >= index->strings.length) {
+        return "";
+    }
+    return index->strings.data + id;
+}
+
+void symbol_index_free(SymbolIndex *index) {
+    free(index->strings.data);
+    free(index->strings.slots);
+    free(index->entries);
+    free(index->slots);
+    memset(index, 0, sizeof(SymbolIndex));
+}
+
+// The hash index of the last kernel asked about, built on first use
+static SymbolIndex symbol_cache;
+static int symbol_cache_ready;
+static pthread_mutex_t symbol_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int find_symbol_module(const char *symbol, const char *kernel_version, Module *mod, int *gpl_only) {
+    char key[MAX_PATH];
+    char provider[MAX_MODULE_NAME] = "";
+    uint32_t flags = 0;
+    
+    memset(mod, 0, sizeof(Module));
+    if (gpl_only != NULL) {
+        *gpl_only = 0;
+    }
+    if (strlen(symbol) + strlen("symbol:") >= sizeof(key)) {
+        return MODULE_SYMBOL_UNKNOWN;
+    }
+    
+    /*
+     * STEP 1: modules.symbols.bin
+     * A trie lookup in a mapped file; module symbols only
+     */
+    int slot;
+    const ModuleBinIndex *bin = module_bin_index_get(kernel_version, MODULE_INDEX_SYMBOLS, &slot);
+    int have_bin = bin != NULL;
+    snprintf(key, sizeof(key), "symbol:%s", symbol);
+    if (have_bin) {
+        const char *found = module_bin_index_lookup(bin, key);
+        if (found != NULL) {
+            snprintf(provider, sizeof(provider), "%s", found);
+        }
+        module_bin_index_release(slot);
+    }
+    
+    /*
+     * STEP 2: Hash index
+     * Module.symvers (and modules.symbols if there is no .bin); knows vmlinux
+     * exports and GPL-only exports
+     */
+    pthread_mutex_lock(&symbol_cache_lock);
+    if (symbol_cache_ready && strcmp(symbol_cache.version, kernel_version) == 0) {
+        stats_add(cache_hits, 1);
+    } else {
+        stats_add(cache_misses, 1);
+        symbol_index_free(&symbol_cache);
+        symbol_cache_ready = symbol_index_load(&symbol_cache, kernel_version, have_bin) >= 0;
+    }
+    const SymbolEntry *entry = symbol_cache_ready ? symbol_index_lookup(&symbol_cache, symbol) : NULL;
+    if (entry != NULL) {
+        flags = entry->flags;
+        if (provider[0] == '\0') {
+            snprintf(provider, sizeof(provider), "%s", symbol_index_string(&symbol_cache, entry->module));
+        }
+    }
+    pthread_mutex_unlock(&symbol_cache_lock);
+    
+    if (gpl_only != NULL) {
+        *gpl_only = (flags & SYMBOL_FLAG_GPL_ONLY) != 0;
+    }
+    if (provider[0] == '\0') {
+        return MODULE_SYMBOL_UNKNOWN;
+    }
+    
+    snprintf(mod->name, sizeof(mod->name), "%s", provider);
+    if (strcmp(provider, "vmlinux") == 0) {
+        // Exported by the kernel image itself: always there
+        mod->loaded = 1;
+        mod->available = 1;
+        mod->builtin = 1;
+        strcpy(mod->found_as, "vmlinux");
+        strcpy(mod->path, "[built-in]");
+        return MODULE_SYMBOL_KERNEL;
+    }
+    
+    /*
+     * STEP 3: Availability of the provider, as for any other module
+     */
+    find_module(mod, kernel_version);
+    return MODULE_SYMBOL_MODULE;
+}
+
+/*
+ * Per-kernel module index
+ * 
+ * For kernels other than the running one, nothing is loaded, so availability
+ * is decided by modules.builtin and the module files alone. Instead of
+ * re-reading those for every name (is_module_builtin) or running find
+ * (find_module_file), each kernel gets a sorted array of every module it
+ * ships, built once from modules.builtin and modules.dep (or a directory walk
+ * when depmod hasn't run), and queried with a binary search.
+ */
+
+// Base of the string table being sorted or searched on this thread (qsort/bsearch have no context argument)
+static _Thread_local const char *index_sort_base;
+
+static int compare_index_entries(const void *a, const void *b) {
+    const KernelModuleEntry *ea = a;
+    const KernelModuleEntry *eb = b;
+    int order = strcmp(index_sort_base + ea->name, index_sort_base + eb->name);
+    if (order != 0) {
+        return order;
+    }
+    // Built-in first, then in the order depmod listed them (updates/ before kernel/ etc.)
+    if (ea->builtin != eb->builtin) {
+        return eb->builtin - ea->builtin;
+    }
+    return (ea->order > eb->order) - (ea->order < eb->order);
+}
+
+static int compare_index_key(const void *key, const void *entry) {
+    return strcmp(key, index_sort_base + ((const KernelModuleEntry *)entry)->name);
+}
+
+static int index_add(KernelModuleIndex *index, const char *name, const char *path, int builtin) {
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 1024;
+        KernelModuleEntry *entries = realloc(index->entries, capacity * sizeof(KernelModuleEntry));
+        if (entries == NULL) {
+            return 0;
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    
+    KernelModuleEntry *entry = &index->entries[index->count];
+    entry->name = module_strings_intern(&index->strings, name);
+    entry->path = module_strings_intern(&index->strings, path);
+    if (entry->name == MODULE_STRING_INVALID || entry->path == MODULE_STRING_INVALID) {
+        return 0;
+    }
+    entry->builtin = builtin ? 1 : 0;
+    int compression = module_compression_from_path(path);
+    entry->compression = (uint8_t)(compression == MODULE_COMPRESSION_UNKNOWN ? MODULE_COMPRESSION_NONE : compression);
+    entry->order = (uint32_t)index->count;
+    index->count++;
+    return 1;
+}
+
+// Add every module listed one per line (first field a relative .ko path) in a depmod file
+static int index_add_list(KernelModuleIndex *index, const char *file, int builtin) {
+    char path[MAX_PATH];
+    char full_path[MAX_PATH];
+    char name[MAX_MODULE_NAME];
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t line_len;
+    int ok = 1;
+    
+    root_path(path, sizeof(path), "/lib/modules/%s/%s", index->version, file);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    
+    while (ok && (line_len = read_line(&line, &line_size, fp)) != -1) {
+        // modules.dep: "kernel/.../foo.ko.xz: deps", modules.builtin: "kernel/.../foo.ko"
+        size_t path_len = strcspn(line, ":\n");
+        if (path_len == 0 || !module_name_from_path(line, path_len, name, sizeof(name))) {
+            continue;
+        }
+        
+        if (builtin) {
+            ok = index_add(index, name, "[built-in]", 1);
+        } else {
+            line[path_len] = '\0';
+            root_path(full_path, sizeof(full_path), "/lib/modules/%s/%s", index->version, line);
+            ok = index_add(index, name, full_path, 0);
+        }
+    }
+    
+    free(line);
+    fclose(fp);
+    return ok;
+}
+
+static void index_finish(KernelModuleIndex *index);
+
+// Without modules.dep: find every *.ko* below dir (symlinks like build/ and source/ aren't followed)
+static int index_walk(KernelModuleIndex *index, const char *dir, int depth) {
+    char name[MAX_MODULE_NAME];
+    char path[MAX_PATH];
+    int ok = 1;
+    
+    if (depth > 16) {
+        return 1;
+    }
+    
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return 1;
+    }
+    
+    struct dirent *de;
+    while (ok && (de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        
+        int written = snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (written < 0 || (size_t)written >= sizeof(path)) {
+            continue;
+        }
+        
+        unsigned char type = de->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(path, &st) != 0) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_LNK);
+        }
+        
+        if (type == DT_DIR) {
+            ok = index_walk(index, path, depth + 1);
+        } else if (type == DT_REG && module_compression_from_path(de->d_name) != MODULE_COMPRESSION_UNKNOWN &&
+                   module_name_from_path(de->d_name, strlen(de->d_name), name, sizeof(name))) {
+            ok = index_add(index, name, path, 0);
+        }
+    }
+    
+    closedir(d);
+    return ok;
+}
+
+int kernel_index_build(KernelModuleIndex *index, const char *kernel_version) {
+    // kernel_version may be index->version itself (module_audit_run)
+    char version[MAX_MODULE_NAME];
+    strncpy(version, kernel_version, sizeof(version) - 1);
+    version[sizeof(version) - 1] = '\0';
+    memset(index, 0, sizeof(KernelModuleIndex));
+    strcpy(index->version, version);
+    
+    char dir[MAX_PATH];
+    struct stat st;
+    root_path(dir, sizeof(dir), "/lib/modules/%s", index->version);
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return 0;
+    }
+    
+    // A missing modules.builtin just means nothing is known to be built in
+    int ok = index_add_list(index, "modules.builtin", 1) != 0;
+    if (ok) {
+        int dep = index_add_list(index, "modules.dep", 0);
+        if (dep < 0) {
+            ok = index_walk(index, dir, 0);
+        } else {
+            ok = dep;
+        }
+    }
+    if (!ok) {
+        kernel_index_free(index);
+        return 0;
+    }
+    
+    index_finish(index);
+    return 1;
+}
+
+// Sort by name, then keep only the preferred entry for every name
+static void index_finish(KernelModuleIndex *index) {
+    index_sort_base = index->strings.data;
+    if (index->count > 0) {
+        qsort(index->entries, index->count, sizeof(KernelModuleEntry), compare_index_entries);
+    }
+    size_t unique = 0;
+    for (size_t i = 0; i < index->count; i++) {
+        if (unique == 0 || index->entries[i].name != index->entries[unique - 1].name) {
+            index->entries[unique++] = index->entries[i];
+        }
+    }
+    index->count = unique;
+    index->ready = 1;
+}
+
+void kernel_index_free(KernelModuleIndex *index) {
+    free(index->strings.data);
+    free(index->strings.slots);
+    free(index->entries);
+    memset(&index->strings, 0, sizeof(index->strings));
+    index->entries = NULL;
+    index->count = 0;
+    index->capacity = 0;
+    index->ready = 0;
+}
+
+const KernelModuleEntry *kernel_index_lookup(const KernelModuleIndex *index, const char *module_name) {
+    char name[MAX_MODULE_NAME];
+    
+    if (!index->ready || index->count == 0) {
+        return NULL;
+    }
+    
+    strncpy(name, module_name, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    for (char *p = name; *p; p++) {
+        if (*p == '-') *p = '_';
+    }
+    
+    index_sort_base = index->strings.data;
+    return bsearch(name, index->entries, index->count, sizeof(KernelModuleEntry), compare_index_key);
+}
+
+const char *kernel_index_string(const KernelModuleIndex *index, uint32_t id) {
+    if (index->strings.data == NULL || id >= index->strings.length) {
+        return "";
+    }
+    return index->strings.data + id;
+}
+
+/*
+ * Kernel contexts
+ * 
+ * A ModuleCheckContext answers the per-name questions of find_module()
+ * for one kernel version relative to directory fds opened once: fstatat()
+ * below /sys/module for loaded and built-in modules, the KernelModuleIndex
+ * of the version (built on first use) for module files, and fstatat()
+ * below /lib/modules/<version> to confirm a file is still there.
+ */
+struct ModuleCheckContext {
+    char version[MAX_MODULE_NAME];
+    int running;             // the version of the running kernel (sysfs describes it)
+    int modules_fd;          // <root>/lib/modules/<version>, -1 if missing
+    int proc_fd;             // <root>/proc
+    int sysfs_fd;            // <root>/sys/module, -1 without sysfs
+    size_t modules_prefix;   // length of "<root>/lib/modules/<version>/" in index paths
+    int has_dep;             // modules.dep exists, so the index wasn't built by a walk
+    KernelModuleIndex files; // modules.builtin + modules.dep
+    KernelModuleIndex tree;  // walk of the tree, for files modules.dep doesn't know yet
+    int files_tried;
+    int tree_tried;
+    int lookups;             // name lookups before the index was built
+};
+
+ModuleCheckContext *module_context_open(const char *kernel_version) {
+    char running[256];
+    char path[MAX_PATH];
+    
+    if (!get_kernel_version(running, sizeof(running)) && kernel_version == NULL) {
+        return NULL;
+    }
+    if (kernel_version == NULL) {
+        kernel_version = running;
+    }
+    if (strlen(kernel_version) >= MAX_MODULE_NAME) {
+        return NULL;
+    }
+    
+    ModuleCheckContext *context = calloc(1, sizeof(ModuleCheckContext));
+    if (context == NULL) {
+        return NULL;
+    }
+    strcpy(context->version, kernel_version);
+    context->running = strcmp(running, kernel_version) == 0;
+    
+    int written = root_path(path, sizeof(path), "/lib/modules/%s", kernel_version);
+    context->modules_prefix = (written > 0) ? (size_t)written + 1 : 0;
+    context->modules_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    root_path(path, sizeof(path), "/proc");
+    context->proc_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    root_path(path, sizeof(path), "/sys/module");
+    context->sysfs_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    
+    struct stat st;
+    context->has_dep = context->modules_fd >= 0 && fstatat(context->modules_fd, "modules.dep", &st, 0) == 0;
+    return context;
+}
+
+void module_context_close(ModuleCheckContext *context) {
+    if (context == NULL) {
+        return;
+    }
+    if (context->modules_fd >= 0) close(context->modules_fd);
+    if (context->proc_fd >= 0) close(context->proc_fd);
+    if (context->sysfs_fd >= 0) close(context->sysfs_fd);
+    kernel_index_free(&context->files);
+    kernel_index_free(&context->tree);
+    free(context);
+}
+
+const char *module_context_kernel_version(const ModuleCheckContext *context) {
+    return context->version;
+}
+
+// The version's index, built by the first query that needs it
+static const KernelModuleIndex *context_files(ModuleCheckContext *context) {
+    if (context->files_tried) {
+        stats_add(cache_hits, 1);
+    } else {
+        stats_add(cache_misses, 1);
+        context->files_tried = 1;
+        if (context->modules_fd >= 0) {
+            kernel_index_build(&context->files, context->version);
+        }
+    }
+    return &context->files;
+}
+
+/*
+ * Building the index reads and sorts all of modules.dep, which costs more
+ * than a few single lookups in modules.dep(.bin); the first lookups of a
+ * context go the way is_module_builtin() and find_module_file() go.
+ */
+#define CONTEXT_INDEX_AFTER 16
+
+static int context_indexed(ModuleCheckContext *context) {
+    return context->files_tried || ++context->lookups > CONTEXT_INDEX_AFTER;
+}
+
+// Same for a walk of the tree; only useful when the files index came from modules.dep
+static const KernelModuleIndex *context_tree(ModuleCheckContext *context) {
+    if (!context->tree_tried) {
+        char dir[MAX_PATH];
+        context->tree_tried = 1;
+        strcpy(context->tree.version, context->version);
+        root_path(dir, sizeof(dir), "/lib/modules/%s", context->version);
+        if (context->has_dep && index_walk(&context->tree, dir, 0)) {
+            index_finish(&context->tree);
+        } else {
+            kernel_index_free(&context->tree);
+        }
+    }
+    return &context->tree;
+}
+
+// "<name>/<file>" below /sys/module, for fstatat(); 0 if the name isn't a plain module name
+static int context_sysfs_path(const char *module_name, const char *file, char *path, size_t size) {
+    size_t len = sysfs_module_name(module_name, path, size);
+    if (len == 0 || len + 1 + strlen(file) + 1 > size) {
+        return 0;
+    }
+    if (file[0] != '\0') {
+        path[len] = '/';
+        strcpy(path + len + 1, file);
+    }
+    return 1;
+}
+
+int module_context_is_loaded(ModuleCheckContext *context, const char *module_name) {
+    char path[MAX_MODULE_NAME + 16];
+    struct stat st;
+    
+    // /sys/module and /proc/modules are the running kernel's; nothing of another version is loaded
+    if (!context->running) {
+        return 0;
+    }
+    if (context->sysfs_fd >= 0) {
+        return context_sysfs_path(module_name, "initstate", path, sizeof(path)) &&
+               fstatat(context->sysfs_fd, path, &st, 0) == 0;
+    }
+    
+    // No sysfs: the first field of /proc/modules, as in is_module_loaded()
+    if (context->proc_fd < 0 || !context_sysfs_path(module_name, "", path, sizeof(path))) {
+        return 0;
+    }
+    int fd = openat(context->proc_fd, "modules", O_RDONLY | O_CLOEXEC);
+    FILE *fp = (fd >= 0) ? fdopen(fd, "r") : NULL;
+    if (fp == NULL) {
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t search_len = strlen(path);
+    int found = 0;
+    while (!found && read_line(&line, &line_size, fp) != -1) {
+        found = strncmp(line, path, search_len) == 0 && line[search_len] == ' ';
+    }
+    free(line);
+    fclose(fp);
+    return found;
+}
+
+int module_context_is_builtin(ModuleCheckContext *context, const char *module_name) {
+    char path[MAX_MODULE_NAME + 16];
+    struct stat st;
+    
+    // sysfs first, as in is_module_builtin(): a directory without initstate
+    if (context->running && context->sysfs_fd >= 0 && context_sysfs_path(module_name, "", path, sizeof(path))) {
+        if (fstatat(context->sysfs_fd, path, &st, 0) == 0 && S_ISDIR(st.st_mode)) {
+            strcat(path, "/initstate");
+            return fstatat(context->sysfs_fd, path, &st, 0) != 0;
+        }
+    }
+    
+    if (!context_indexed(context)) {
+        char entry[MAX_PATH];
+        return module_index_lookup(context->version, MODULE_INDEX_BUILTIN, module_name, entry, sizeof(entry));
+    }
+    const KernelModuleEntry *entry = kernel_index_lookup(context_files(context), module_name);
+    return entry != NULL && entry->builtin;
+}
+
+// A module file from one of the context's indexes, if it is still there
+static int context_index_file(ModuleCheckContext *context, const KernelModuleIndex *index,
+                              const char *module_name, char *result_path) {
+    const KernelModuleEntry *entry = kernel_index_lookup(index, module_name);
+    if (entry == NULL || entry->builtin) {
+        return 0;
+    }
+    
+    const char *path = kernel_index_string(index, entry->path);
+    struct stat st;
+    if (strlen(path) > context->modules_prefix && context->modules_fd >= 0) {
+        if (fstatat(context->modules_fd, path + context->modules_prefix, &st, 0) != 0) {
+            return 0;
+        }
+    } else if (stat(path, &st) != 0) {
+        return 0;
+    }
+    snprintf(result_path, MAX_PATH, "%s", path);
+    return 1;
+}
+
+int module_context_find_file(ModuleCheckContext *context, const char *module_name, char *result_path) {
+    if (context->modules_fd < 0) {
+        return 0;
+    }
+    if (!context_indexed(context)) {
+        return find_module_file_native(module_name, context->version, result_path);
+    }
+    if (context_index_file(context, context_files(context), module_name, result_path)) {
+        return 1;
+    }
+    return context->has_dep && context_index_file(context, context_tree(context), module_name, result_path);
+}
+
+// check_module_by_modinfo() for the context's kernel
+static int context_module_info(ModuleCheckContext *context, const char *module_name, Module *mod) {
+    char path[MAX_PATH];
+    char target[MAX_MODULE_NAME];
+    ModuleInfo info;
+    
+    // The module file, or the module an alias from modules.alias(.bin) resolves to, confirmed by its .modinfo
+    const char *name = module_name;
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            if (!module_index_lookup(context->version, MODULE_INDEX_ALIAS, module_name, target, sizeof(target))) {
+                break;
+            }
+            name = target;
+        }
+        if (module_context_find_file(context, name, path) && module_info_read(path, &info)) {
+            module_info_free(&info);
+            snprintf(mod->path, sizeof(mod->path), "%s", path);
+            return 1;
+        }
+    }
+    
+    return modinfo_filename(module_name, (module_root[0] != '\0' || !context->running) ? context->version : NULL, mod);
+}
+
+int module_context_find(ModuleCheckContext *context, Module *mod) {
+    const char *names[1 + MAX_ALIASES];
+    int name_count = 0;
+    
+    names[name_count++] = mod->name;
+    for (int i = 0; i < mod->alias_count && i < MAX_ALIASES; i++) {
+        names[name_count++] = mod->aliases[i];
+    }
+    
+    return find_module_names(names, name_count, context->version, context, mod) >= 0;
+}
+
+/*
+ * Module families
+ * 
+ * A name with glob characters ("snd_*", "v4l2*", "snd_hda_codec_[hr]*")
+ * stands for every module it matches. Matches are found in a sorted index
+ * without enumerating it: the literal prefix before the first wildcard is
+ * binary searched, and only the entries sharing that prefix go through
+ * fnmatch(). Hyphens are normalized to underscores as for plain names
+ * (except inside [...] classes, where '-' is a range).
+ */
+
+int module_name_is_pattern(const char *name) {
+    return strpbrk(name, "*?[") != NULL;
+}
+
+const KernelModuleEntry *kernel_index_match(const KernelModuleIndex *index, const char *pattern,
+                                            const KernelModuleEntry *previous) {
+    char normalized[MAX_MODULE_NAME];
+    
+    if (!index->ready || index->count == 0 || strlen(pattern) >= sizeof(normalized)) {
+        return NULL;
+    }
+    module_alias_normalize(pattern, normalized, sizeof(normalized));
+    size_t prefix = strcspn(normalized, "*?[\\");
+    
+    const KernelModuleEntry *entry = previous + 1;
+    if (previous == NULL) {
+        // Lower bound of the prefix: every match sorts at or after it
+        size_t low = 0;
+        size_t high = index->count;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (strncmp(index->strings.data + index->entries[mid].name, normalized, prefix) < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        entry = index->entries + low;
+    }
+    
+    for (; entry < index->entries + index->count; entry++) {
+        const char *name = index->strings.data + entry->name;
+        if (strncmp(name, normalized, prefix) != 0) {
+            break;  // past the entries sharing the prefix
+        }
+        if (fnmatch(normalized, name, 0) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Loaded and built-in modules of the running kernel, as the kernel sees them right now
+static int running_index_build(KernelModuleIndex *index) {
+    char path[MAX_PATH];
+    struct stat st;
+    int ok = 1;
+    
+    memset(index, 0, sizeof(KernelModuleIndex));
+    strcpy(index->version, "running");
+    
+    // sysfs: a directory with initstate is a loaded module, without it built in
+    root_path(path, sizeof(path), "/sys/module");
+    DIR *d = opendir(path);
+    if (d != NULL) {
+        struct dirent *de;
+        while (ok && (de = readdir(d)) != NULL) {
+            if (de->d_name[0] == '.') {
+                continue;
+            }
+            root_path(path, sizeof(path), "/sys/module/%s/initstate", de->d_name);
+            int loaded = stat(path, &st) == 0;
+            ok = index_add(index, de->d_name, "", !loaded);
+        }
+        closedir(d);
+    } else {
+        // No sysfs: /proc/modules lists loaded modules, built-ins are left to modules.builtin
+        root_path(path, sizeof(path), "/proc/modules");
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+            return 0;
+        }
+        char *line = NULL;
+        size_t line_size = 0;
+        while (ok && read_line(&line, &line_size, fp) != -1) {
+            line[strcspn(line, " \n")] = '\0';
+            if (line[0] != '\0') {
+                ok = index_add(index, line, "", 0);
+            }
+        }
+        free(line);
+        fclose(fp);
+    }
+    
+    if (!ok) {
+        kernel_index_free(index);
+        return 0;
+    }
+    index_finish(index);
+    return 1;
+}
+
+// Indexes of the running kernel for families in find_module(): the files of the
+// last kernel version asked about, and the loaded modules (at most a second old)
+static KernelModuleIndex family_files;
+static KernelModuleIndex family_running;
+static time_t family_running_time;
+static pthread_mutex_t family_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// First member of a family matching one strategy; its name goes to found_as
+static int find_family_strategy(int strategy, const char *pattern, const char *kernel_version,
+                                ModuleCheckContext *context, Module *mod) {
+    const KernelModuleEntry *entry = NULL;
+    const KernelModuleIndex *index = NULL;
+    int builtin = (strategy == MODULE_STRATEGY_BUILTIN);
+    
+    pthread_mutex_lock(&family_cache_lock);
+    
+    // Loaded and (if sysfs lists them) built-in modules, as the kernel sees them (only if it is the one asked about)
+    if ((strategy == MODULE_STRATEGY_LOADED || strategy == MODULE_STRATEGY_BUILTIN) &&
+        (context == NULL || context->running)) {
+        time_t now = time(NULL);
+        if (family_running.ready && family_running_time == now) {
+            stats_add(cache_hits, 1);
+        } else {
+            stats_add(cache_misses, 1);
+            kernel_index_free(&family_running);
+            running_index_build(&family_running);
+            family_running_time = now;
+        }
+        index = &family_running;
+        for (entry = kernel_index_match(index, pattern, NULL); entry != NULL; entry = kernel_index_match(index, pattern, entry)) {
+            if (entry->builtin == builtin) break;
+        }
+    }
+    
+    // modules.builtin and the module files (the context has them already)
+    if (entry == NULL && strategy != MODULE_STRATEGY_LOADED) {
+        if (context != NULL) {
+            index = context_files(context);
+        } else if (strcmp(family_files.version, kernel_version) == 0) {
+            stats_add(cache_hits, 1);
+            index = &family_files;
+        } else {
+            stats_add(cache_misses, 1);
+            kernel_index_free(&family_files);
+            kernel_index_build(&family_files, kernel_version);
+            index = &family_files;
+        }
+        for (entry = kernel_index_match(index, pattern, NULL); entry != NULL; entry = kernel_index_match(index, pattern, entry)) {
+            if (entry->builtin == builtin) break;
+        }
+    }
+    
+    if (entry != NULL) {
+        snprintf(mod->found_as, sizeof(mod->found_as), "%s", kernel_index_string(index, entry->name));
+        if (builtin) {
+            strcpy(mod->path, "[built-in]");
+        } else if (strategy == MODULE_STRATEGY_FILE) {
+            snprintf(mod->path, sizeof(mod->path), "%s", kernel_index_string(index, entry->path));
+        }
+    }
+    
+    pthread_mutex_unlock(&family_cache_lock);
+    return entry != NULL;
+}
+
+// Unmaps and frees the caches other checks read without holding their locks: no check may be running
+int module_check_set_root(const char *root) {
+    size_t length = (root != NULL) ? strlen(root) : 0;
+    while (length > 0 && root[length - 1] == '/') {
+        length--;
+    }
+    // Leave room for the paths below it
+    if (length + 256 > sizeof(module_root)) {
+        return 0;
+    }
+    if (length > 0) {
+        memcpy(module_root, root, length);
+    }
+    module_root[length] = '\0';
+    
+    // Everything cached so far was read below the old root
+    pthread_mutex_lock(&sysfs_present_lock);
+    sysfs_present = -1;
+    pthread_mutex_unlock(&sysfs_present_lock);
+    pthread_mutex_lock(&running_version_lock);
+    running_version[0] = '\0';
+    pthread_mutex_unlock(&running_version_lock);
+    
+    pthread_mutex_lock(&sysfs_module_fd_lock);
+    if (sysfs_module_fd >= 0) {
+        close(sysfs_module_fd);
+        sysfs_module_fd = -1;
+    }
+    pthread_mutex_unlock(&sysfs_module_fd_lock);
+    
+    pthread_mutex_lock(&module_index_lock);
+    for (int i = 0; i < MODULE_INDEX_CACHE_SIZE; i++) {
+        for (int which = 0; which < MODULE_INDEX_COUNT; which++) {
+            module_bin_index_close(&module_index_cache[i].indexes[which]);
+        }
+    }
+    memset(module_index_cache, 0, sizeof(module_index_cache));
+    pthread_mutex_unlock(&module_index_lock);
+    
+    pthread_mutex_lock(&symbol_cache_lock);
+    symbol_index_free(&symbol_cache);
+    symbol_cache_ready = 0;
+    pthread_mutex_unlock(&symbol_cache_lock);
+    
+    pthread_mutex_lock(&family_cache_lock);
+    kernel_index_free(&family_files);
+    kernel_index_free(&family_running);
+    family_files.version[0] = '\0';
+    family_running_time = 0;
+    pthread_mutex_unlock(&family_cache_lock);
+    return 1;
+}
+
+static void *kernel_index_thread(void *arg) {
+    KernelModuleIndex *index = arg;
+    kernel_index_build(index, index->version);
+    return NULL;
+}
+
+static int compare_versions(const void *a, const void *b) {
+    return strverscmp(((const KernelModuleIndex *)a)->version, ((const KernelModuleIndex *)b)->version);
+}
+
+int module_audit_run(ModuleAudit *audit, const ModuleBatch *batch) {
+    memset(audit, 0, sizeof(ModuleAudit));
+    
+    /*
+     * Step 1: Enumerate installed kernels
+     * Every directory in /lib/modules that looks like a kernel tree
+     */
+    char modules_dir[MAX_PATH];
+    root_path(modules_dir, sizeof(modules_dir), "/lib/modules");
+    DIR *d = opendir(modules_dir);
+    if (d == NULL) {
+        return 0;
+    }
+    
+    size_t capacity = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        char path[MAX_PATH];
+        struct stat st;
+        if (de->d_name[0] == '.' || strlen(de->d_name) >= MAX_MODULE_NAME) {
+            continue;
+        }
+        int written = snprintf(path, sizeof(path), "%s/%s", modules_dir, de->d_name);
+        if (written < 0 || (size_t)written >= sizeof(path) || stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        
+        if (audit->kernel_count == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            KernelModuleIndex *kernels = realloc(audit->kernels, capacity * sizeof(KernelModuleIndex));
+            if (kernels == NULL) {
+                closedir(d);
+                module_audit_free(audit);
+                return 0;
+            }
+            audit->kernels = kernels;
+        }
+        KernelModuleIndex *index = &audit->kernels[audit->kernel_count++];
+        memset(index, 0, sizeof(KernelModuleIndex));
+        strcpy(index->version, de->d_name);
+    }
+    closedir(d);
+    
+    if (audit->kernel_count == 0) {
+        return 1;
+    }
+    qsort(audit->kernels, audit->kernel_count, sizeof(KernelModuleIndex), compare_versions);
+    
+    /*
+     * Step 2: Build the per-kernel indexes in parallel, one thread per kernel
+     * Kernels whose thread can't be started are indexed on this thread
+     */
+    pthread_t *threads = calloc(audit->kernel_count, sizeof(pthread_t));
+    int *started = calloc(audit->kernel_count, sizeof(int));
+    for (size_t k = 0; k < audit->kernel_count; k++) {
+        if (threads != NULL && started != NULL &&
+            pthread_create(&threads[k], NULL, kernel_index_thread, &audit->kernels[k]) == 0) {
+            started[k] = 1;
+        } else {
+            kernel_index_thread(&audit->kernels[k]);
+        }
+    }
+    for (size_t k = 0; k < audit->kernel_count; k++) {
+        if (started != NULL && started[k]) {
+            pthread_join(threads[k], NULL);
+        }
+    }
+    free(threads);
+    free(started);
+    
+    /*
+     * Step 3: Fill the module x kernel matrix
+     * Primary name first, then aliases, like find_module()
+     */
+    audit->module_count = batch->count;
+    audit->cells = calloc(audit->module_count * audit->kernel_count + 1, sizeof(ModuleAuditCell));
+    if (audit->cells == NULL) {
+        module_audit_free(audit);
+        return 0;
+    }
+    
+    for (size_t m = 0; m < batch->count; m++) {
+        const CompactModule *mod = &batch->modules[m];
+        for (size_t k = 0; k < audit->kernel_count; k++) {
+            ModuleAuditCell *cell = &audit->cells[m * audit->kernel_count + k];
+            for (int n = 0; n <= mod->alias_count && cell->entry == NULL; n++) {
+                uint32_t id = (n == 0) ? mod->name : batch->aliases[mod->alias_first + (uint32_t)n - 1];
+                const char *name = module_batch_string(batch, id);
+                cell->entry = module_name_is_pattern(name) ? kernel_index_match(&audit->kernels[k], name, NULL)
+                                                           : kernel_index_lookup(&audit->kernels[k], name);
+                cell->found_as = id;
+            }
+            if (cell->entry == NULL) {
+                cell->found_as = MODULE_STRING_NONE;
+            }
+        }
+    }
+    
+    return 1;
+}
+
+const ModuleAuditCell *module_audit_cell(const ModuleAudit *audit, size_t module, size_t kernel) {
+    return &audit->cells[module * audit->kernel_count + kernel];
+}
+
+void module_audit_free(ModuleAudit *audit) {
+    for (size_t k = 0; k < audit->kernel_count; k++) {
+        kernel_index_free(&audit->kernels[k]);
+    }
+    free(audit->kernels);
+    free(audit->cells);
+    memset(audit, 0, sizeof(ModuleAudit));
+}
+
+/*
+ * batch_add_json_entry()
+ * 
+ * Adds one element of the "modules" array to a batch. Handles both the
+ * string format and the object format with aliases (any number of them).
+ * 
+ * Returns the batch index, or -1 if the element is skipped (malformed entry
+ * or out of memory).
+ */
+static long batch_add_json_entry(ModuleBatch *batch, const cJSON *item) {
+    const char *name = NULL;
+    const char **alias_names = NULL;
+    size_t alias_count = 0;
+    
+    if (cJSON_IsString(item)) {
+        // Simple string format
+        name = cJSON_GetStringValue(item);
+    } else if (cJSON_IsObject(item)) {
+        // Object format with aliases
+        cJSON *name_obj = cJSON_GetObjectItem(item, "name");
+        if (name_obj == NULL || !cJSON_IsString(name_obj)) return -1;
+        name = cJSON_GetStringValue(name_obj);
+        
+        cJSON *aliases = cJSON_GetObjectItem(item, "aliases");
+        if (aliases != NULL && cJSON_IsArray(aliases) && cJSON_GetArraySize(aliases) > 0) {
+            alias_names = malloc((size_t)cJSON_GetArraySize(aliases) * sizeof(const char *));
+            if (alias_names == NULL) return -1;
+            
+            cJSON *alias = NULL;
+            cJSON_ArrayForEach(alias, aliases) {
+                if (cJSON_IsString(alias)) {
+                    alias_names[alias_count++] = cJSON_GetStringValue(alias);
+                }
+            }
+        }
+    }
+    if (name == NULL) return -1;
+    
+    long index = module_batch_add(batch, name, alias_names, alias_count);
+    free(alias_names);
+    if (index < 0) {
+        fprintf(stderr, "Out of memory adding module %s\n", name);
+    }
+    return index;
+}
+
+/*
+ * Check runs
+ * 
+ * What check_modules_from_json() and check_modules_from_stream() share:
+ * the kernel version and modprobe.d rules read once, the report line(s)
+ * printed per entry, the symbol section and the summary.
+ */
+typedef struct {
+    char kernel_version[256];
+    ModuleCheckContext *context;
+    ModprobeRules rules;
+    int rules_loaded;
+    int loaded_count;
+    int available_count;
+    int symbol_count;
+    int symbols_missing;
+    int state_checks;
+    int state_failures;
+#ifdef MODULECHECK_INSTRUMENTATION
+    ModuleCheckStats stats;
+#endif
+} CheckRun;
+
+static int check_run_begin(CheckRun *run) {
+    memset(run, 0, sizeof(CheckRun));
+    if (!get_kernel_version(run->kernel_version, sizeof(run->kernel_version))) {
+        fprintf(stderr, "Failed to get kernel version\n");
+        return 0;
+    }
+    printf("Kernel version: %s\n", run->kernel_version);
+    
+    // Directories and indexes of the kernel, and modprobe.d, are opened and read once for the whole run
+    run->context = module_context_open(run->kernel_version);
+    run->rules_loaded = modprobe_rules_load(&run->rules) >= 0;
+    return 1;
+}
+
+// Point a batch at the run's context, rules and counters
+static void check_run_batch(CheckRun *run, ModuleBatch *batch) {
+    batch->rules = run->rules_loaded ? &run->rules : NULL;
+    batch->context = run->context;
+#ifdef MODULECHECK_INSTRUMENTATION
+    batch->stats = &run->stats;
+#endif
+}
+
+static void check_run_state(CheckRun *run, const ModuleBatch *batch, size_t index, const cJSON *item);
+
+// Check and report one config entry as [number/total] (total 0 if not known yet)
+static void check_run_entry(CheckRun *run, ModuleBatch *batch, const cJSON *item, int number, int total) {
+    long index = batch_add_json_entry(batch, item);
+    if (index < 0) return;
+    const char *name = module_batch_string(batch, batch->modules[index].name);
+    
+    // Check the module
+    if (total > 0) {
+        printf("[%d/%d] %s: ", number, total, name);
+    } else {
+        printf("[%d] %s: ", number, name);
+    }
+    
+#ifdef MODULECHECK_INSTRUMENTATION
+    ModuleCheckStats module_stats;
+    memset(&module_stats, 0, sizeof(module_stats));
+    ModuleCheckStats *previous = module_check_set_stats(&module_stats);
+    int found = module_batch_check_one(batch, (size_t)index, run->kernel_version);
+    module_check_set_stats(previous);
+#else
+    int found = module_batch_check_one(batch, (size_t)index, run->kernel_version);
+#endif
+    
+    char verdict_name[MAX_MODULE_NAME];
+    if (found) {
+        const CompactModule *mod = &batch->modules[index];
+        const char *path = module_batch_string(batch, mod->path);
+        name = module_batch_string(batch, mod->name);  // the check may have grown the string table
+        
+        if ((mod->flags & MODULE_FLAG_DISABLED) && !(mod->flags & MODULE_FLAG_LOADED)) {
+            // The file exists, but modprobe would run the install command instead
+            printf("✗ DISABLED (install %s)\n",
+                   modprobe_install_command(batch->rules, module_batch_verdict_name(batch, mod, verdict_name, sizeof(verdict_name))));
+        } else if (mod->flags & MODULE_FLAG_LOADED) {
+            printf("✓ LOADED");
+            run->loaded_count++;
+            run->available_count++;
+            
+            if (mod->flags & MODULE_FLAG_BUILTIN) {
+                printf(" (built-in)");
+            }
+            if (mod->found_as != mod->name && (!(mod->flags & MODULE_FLAG_BUILTIN) || module_name_is_pattern(name))) {
+                printf(" as '%s'", module_batch_string(batch, mod->found_as));
+            }
+            
+            if (path[0] != '\0') {
+                printf("\n  %s", path);
+            }
+            printf("\n");
+        } else if (mod->flags & MODULE_FLAG_AVAILABLE) {
+            printf("○ AVAILABLE (not loaded)");
+            if (module_name_is_pattern(name)) {
+                printf(" as '%s'", module_batch_string(batch, mod->found_as));
+            }
+            printf("\n");
+            run->available_count++;
+            
+            if (path[0] != '\0') {
+                printf("  %s\n", path);
+            }
+        }
+    } else {
+        printf("✗ NOT FOUND\n");
+    }
+    
+    // modprobe.d verdicts that don't change the status but matter for loading
+    const CompactModule *mod = &batch->modules[index];
+    if (mod->flags & MODULE_FLAG_VIA_ALIAS) {
+        printf("  via modprobe.d alias -> %s\n", module_batch_string(batch, mod->found_as));
+    }
+    if (mod->flags & MODULE_FLAG_BLACKLISTED) {
+        printf("  ⚠ blacklisted in modprobe.d (not autoloaded)\n");
+    }
+    int shown_disabled = (mod->flags & MODULE_FLAG_DISABLED) && (mod->flags & MODULE_FLAG_AVAILABLE) &&
+                         !(mod->flags & MODULE_FLAG_LOADED);
+    if ((mod->flags & MODULE_FLAG_INSTALL) && !shown_disabled) {
+        printf("  ⚠ modprobe runs: %s\n", modprobe_install_command(batch->rules,
+               module_batch_verdict_name(batch, mod, verdict_name, sizeof(verdict_name))));
+    }
+    check_run_state(run, batch, (size_t)index, item);
+#ifdef MODULECHECK_INSTRUMENTATION
+    double seconds = 0.0;
+    for (int s = 0; s < MODULE_STRATEGY_COUNT; s++) {
+        seconds += module_stats.strategy_seconds[s];
+    }
+    printf("  [stats] found by %s, %.3f ms, %lu processes, %llu bytes, cache %lu/%lu\n",
+           module_strategy_name(MODULE_FLAG_FOUND_BY(mod->flags)), seconds * 1000.0,
+           module_stats.subprocesses, module_stats.bytes_read,
+           module_stats.cache_hits, module_stats.cache_hits + module_stats.cache_misses);
+#endif
+}
+
+/*
+ * Optional "expect" of an entry object: the state a loaded module has to
+ * be in, compared with /sys/module (module_state_read()):
+ *   {"name": "v4l2loopback",
+ *    "expect": {"parameters": {"devices": 4, "exclusive_caps": true},
+ *               "refcnt": 0, "holders": [], "taint": ""}}
+ * A number matches a numeric value, true/false match Y/N (or 1/0), and an
+ * array matches a comma separated array parameter element by element.
+ */
+static int state_value_matches(const cJSON *expected, const char *actual, size_t length) {
+    if (cJSON_IsString(expected)) {
+        return strlen(expected->valuestring) == length && memcmp(expected->valuestring, actual, length) == 0;
+    }
+    if (cJSON_IsBool(expected)) {
+        const char *accepted = cJSON_IsTrue(expected) ? "Yy1" : "Nn0";
+        return length == 1 && strchr(accepted, actual[0]) != NULL;
+    }
+    if (cJSON_IsNumber(expected)) {
+        char number[64];
+        char *end;
+        if (length == 0 || length >= sizeof(number)) {
+            return 0;
+        }
+        memcpy(number, actual, length);
+        number[length] = '\0';
+        double value = strtod(number, &end);
+        return *end == '\0' && value == expected->valuedouble;
+    }
+    if (cJSON_IsArray(expected)) {
+        const cJSON *element = NULL;
+        const char *end = actual + length;
+        if (cJSON_GetArraySize(expected) == 0) {
+            return length == 0;  // [] is an empty list, not one empty element
+        }
+        cJSON_ArrayForEach(element, expected) {
+            if (actual > end || cJSON_IsArray(element)) {
+                return 0;
+            }
+            const char *comma = memchr(actual, ',', (size_t)(end - actual));
+            size_t element_length = (comma != NULL) ? (size_t)(comma - actual) : (size_t)(end - actual);
+            if (!state_value_matches(element, actual, element_length)) {
+                return 0;
+            }
+            actual += element_length + 1;
+        }
+        return actual > end;  // every element used up
+    }
+    return 0;
+}
+
+// One line per expectation; a failed one shows what was expected
+static void check_run_state_line(CheckRun *run, int ok, const char *what, const char *actual, const cJSON *expected) {
+    printf("  %s %s: %s", ok ? "✓" : "✗", what, actual);
+    if (!ok) {
+        char *text = cJSON_PrintUnformatted(expected);
+        printf(" (expected %s)", text != NULL ? text : "?");
+        cJSON_free(text);
+        run->state_failures++;
+    }
+    printf("\n");
+}
+
+static void check_run_state(CheckRun *run, const ModuleBatch *batch, size_t index, const cJSON *item) {
+    const cJSON *expect = cJSON_IsObject(item) ? cJSON_GetObjectItem(item, "expect") : NULL;
+    if (!cJSON_IsObject(expect)) {
+        return;
+    }
+    const cJSON *parameters = cJSON_GetObjectItem(expect, "parameters");
+    const cJSON *refcnt = cJSON_GetObjectItem(expect, "refcnt");
+    const cJSON *holders = cJSON_GetObjectItem(expect, "holders");
+    const cJSON *taint = cJSON_GetObjectItem(expect, "taint");
+    int checks = (cJSON_IsObject(parameters) ? cJSON_GetArraySize(parameters) : 0) +
+                 cJSON_IsNumber(refcnt) + cJSON_IsArray(holders) + cJSON_IsString(taint);
+    if (checks == 0) {
+        return;
+    }
+    run->state_checks += checks;
+    
+    // The state belongs to the module that was found, which may be an alias or a family member
+    const CompactModule *mod = &batch->modules[index];
+    const char *name = module_batch_string(batch, mod->found_as != MODULE_STRING_NONE ? mod->found_as : mod->name);
+    ModuleState state;
+    int read = (mod->flags & MODULE_FLAG_LOADED) ? module_state_read(name, &state) : 0;
+    if (read != 1) {
+        printf("  ✗ state not checked (%s)\n", !(mod->flags & MODULE_FLAG_LOADED) ? "not loaded" :
+               read < 0 ? "out of memory" : "no /sys/module entry");
+        run->state_failures += checks;
+        return;
+    }
+    
+    const cJSON *parameter = NULL;
+    if (!cJSON_IsObject(parameters)) {
+        parameters = NULL;
+    }
+    cJSON_ArrayForEach(parameter, parameters) {
+        char what[MAX_MODULE_NAME + 16];
+        const char *value = module_state_parameter(&state, parameter->string);
+        snprintf(what, sizeof(what), "parameter %s", parameter->string);
+        check_run_state_line(run, value != NULL && state_value_matches(parameter, value, strlen(value)), what,
+                             value != NULL ? value : "(missing)", parameter);
+    }
+    
+    if (cJSON_IsNumber(refcnt)) {
+        char value[32] = "(none)";
+        if (state.refcnt >= 0) {
+            snprintf(value, sizeof(value), "%ld", state.refcnt);
+        }
+        check_run_state_line(run, state.refcnt >= 0 && (double)state.refcnt == refcnt->valuedouble,
+                             "refcnt", value, refcnt);
+    }
+    
+    if (cJSON_IsArray(holders)) {
+        // The same set in any order, compared in the kernel's underscore spelling
+        char list[1024] = "";
+        size_t length = 0;
+        int actual_count = 0;
+        for (const char *h = module_state_holder(&state, NULL); h != NULL; h = module_state_holder(&state, h)) {
+            int written = snprintf(list + length, sizeof(list) - length, "%s%s", length > 0 ? "," : "", h);
+            length = (written > 0 && (size_t)written < sizeof(list) - length) ? length + (size_t)written : length;
+            actual_count++;
+        }
+        int ok = actual_count == cJSON_GetArraySize(holders);
+        const cJSON *holder = NULL;
+        cJSON_ArrayForEach(holder, holders) {
+            char wanted[MAX_MODULE_NAME];
+            const char *h = NULL;
+            if (cJSON_IsString(holder) && sysfs_module_name(holder->valuestring, wanted, sizeof(wanted)) > 0) {
+                h = module_state_holder(&state, NULL);
+                while (h != NULL && strcmp(h, wanted) != 0) {
+                    h = module_state_holder(&state, h);
+                }
+            }
+            ok = ok && h != NULL;
+        }
+        check_run_state_line(run, ok, "holders", actual_count > 0 ? list : "(none)", holders);
+    }
+    
+    if (cJSON_IsString(taint)) {
+        check_run_state_line(run, strcmp(state.taint, taint->valuestring) == 0, "taint",
+                             state.taint[0] != '\0' ? state.taint : "(none)", taint);
+    }
+    module_state_free(&state);
+}
+
+// Optional "symbols": kernel symbols an out-of-tree driver needs, resolved to the providing module
+static void check_run_symbols(CheckRun *run, const cJSON *symbols) {
+    if (!cJSON_IsArray(symbols) || cJSON_GetArraySize(symbols) == 0) {
+        return;
+    }
+    printf("\nResolving %d symbols...\n", cJSON_GetArraySize(symbols));
+    cJSON *symbol = NULL;
+    cJSON_ArrayForEach(symbol, symbols) {
+        if (!cJSON_IsString(symbol)) continue;
+        run->symbol_count++;
+        
+        Module provider;
+        int gpl_only = 0;
+        int where = find_symbol_module(symbol->valuestring, run->kernel_version, &provider, &gpl_only);
+        printf("  %s: ", symbol->valuestring);
+        if (where == MODULE_SYMBOL_KERNEL) {
+            printf("✓ kernel");
+        } else if (where == MODULE_SYMBOL_MODULE && provider.loaded) {
+            printf("✓ %s (loaded)", provider.name);
+        } else if (where == MODULE_SYMBOL_MODULE && provider.available) {
+            printf("○ %s (available, not loaded)", provider.name);
+        } else if (where == MODULE_SYMBOL_MODULE) {
+            printf("✗ %s (module not found)", provider.name);
+            run->symbols_missing++;
+        } else {
+            printf("✗ UNKNOWN SYMBOL");
+            run->symbols_missing++;
+        }
+        printf("%s\n", gpl_only ? " [GPL-only]" : "");
+    }
+}
+
+// Print the summary and release the run; returns 0 if all modules are at least available (every symbol has a provider, every expected state holds)
+static int check_run_end(CheckRun *run, int total) {
+    printf("\n========================================\n");
+    printf("Summary:\n");
+    printf("  Loaded: %d/%d\n", run->loaded_count, total);
+    printf("  Available: %d/%d\n", run->available_count, total);
+    if (run->symbol_count > 0) {
+        printf("  Symbols: %d/%d\n", run->symbol_count - run->symbols_missing, run->symbol_count);
+    }
+    if (run->state_checks > 0) {
+        printf("  State: %d/%d\n", run->state_checks - run->state_failures, run->state_checks);
+    }
+#ifdef MODULECHECK_INSTRUMENTATION
+    const ModuleCheckStats *stats = &run->stats;
+    printf("Instrumentation (%lu modules):\n", stats->modules_checked);
+    for (int s = 0; s < MODULE_STRATEGY_COUNT; s++) {
+        printf("  %-8s %lu calls, %lu hits, %.3f ms\n", module_strategy_name(s),
+               stats->strategy_calls[s], stats->strategy_hits[s], stats->strategy_seconds[s] * 1000.0);
+    }
+    printf("  Processes spawned: %lu\n", stats->subprocesses);
+    printf("  Bytes read: %llu\n", stats->bytes_read);
+    printf("  Index cache: %lu hits, %lu misses\n", stats->cache_hits, stats->cache_misses);
+#endif
+    printf("========================================\n");
+    
+    if (run->rules_loaded) {
+        modprobe_rules_free(&run->rules);
+    }
+    module_context_close(run->context);
+    return (run->available_count == total && run->symbols_missing == 0 && run->state_failures == 0) ? 0 : 1;
+}
+
+/*
+ * check_modules_from_json()
+ * 
+ * Parses JSON and checks multiple modules.
+ * 
+ * JSON format:
+ * {
+ *   "modules": [
+ *     {
+ *       "name": "v4l2loopback",
+ *       "aliases": []
+ *     },
+ *     {
+ *       "name": "videodev",
+ *       "aliases": ["v4l2_core"]
+ *     }
+ *   ]
+ * }
+ * 
+ * Flexible format also supported:
+ * {
+ *   "modules": ["v4l2loopback", "videodev"]
+ * }
+ */
+int check_modules_from_json(const char *json_str) {
+    cJSON *root = cJSON_Parse(json_str);
+    if (root == NULL) {
+        fprintf(stderr, "Error parsing JSON: %s\n", cJSON_GetErrorPtr());
+        return -1;
+    }
+    
+    CheckRun run;
+    if (!check_run_begin(&run)) {
+        cJSON_Delete(root);
+        return -1;
+    }
+    
+    cJSON *modules = cJSON_GetObjectItem(root, "modules");
+    if (modules == NULL || !cJSON_IsArray(modules)) {
+        fprintf(stderr, "No modules array found in JSON\n");
+        if (run.rules_loaded) {
+            modprobe_rules_free(&run.rules);
+        }
+        module_context_close(run.context);
+        cJSON_Delete(root);
+        return -1;
+    }
+    
+    int total = cJSON_GetArraySize(modules);
+    
+    // Entries are kept compact, so large manifests don't cost 7 KB per module
+    ModuleBatch batch;
+    module_batch_init(&batch);
+    check_run_batch(&run, &batch);
+    
+    printf("Checking %d modules...\n\n", total);
+    
+    int i = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, modules) {
+        check_run_entry(&run, &batch, item, ++i, total);
+    }
+    module_batch_free(&batch);
+    
+    check_run_symbols(&run, cJSON_GetObjectItem(root, "symbols"));
+    cJSON_Delete(root);
+    return check_run_end(&run, total);
+}
+
+/*
+ * Streaming config reader
+ * 
+ * check_modules_from_stream() never holds the whole document: the config
+ * is pulled through a fixed buffer, the top-level object is walked here,
+ * and only the raw text of one "modules" element at a time is collected
+ * and handed to cJSON. Other keys are skipped without being stored, except
+ * "symbols" (a short list), which is resolved after the modules. Elements
+ * are only scanned for their extent here; cJSON validates each one.
+ */
+typedef struct {
+    FILE *fp;
+    char buffer[16384];
+    size_t position;
+    size_t length;
+    size_t consumed;  // bytes before buffer[0], for error messages
+    char *text;       // raw text of the value being collected
+    size_t text_length;
+    size_t text_capacity;
+    int collect;
+    int failed;       // out of memory
+} ConfigStream;
+
+static int stream_peek(ConfigStream *stream) {
+    if (stream->position == stream->length) {
+        stream->consumed += stream->length;
+        stream->length = fread(stream->buffer, 1, sizeof(stream->buffer), stream->fp);
+        stream->position = 0;
+        if (stream->length == 0) {
+            return EOF;
+        }
+    }
+    return (unsigned char)stream->buffer[stream->position];
+}
+
+static int stream_next(ConfigStream *stream) {
+    int c = stream_peek(stream);
+    if (c == EOF) {
+        return EOF;
+    }
+    stream->position++;
+    
+    if (stream->collect) {
+        if (stream->text_length + 2 > stream->text_capacity) {
+            size_t capacity = stream->text_capacity ? stream->text_capacity * 2 : 256;
+            char *text = realloc(stream->text, capacity);
+            if (text == NULL) {
+                stream->failed = 1;
+                return EOF;
+            }
+            stream->text = text;
+            stream->text_capacity = capacity;
+        }
+        stream->text[stream->text_length++] = (char)c;
+        stream->text[stream->text_length] = '\0';
+    }
+    return c;
+}
+
+// Next non-whitespace character, not consumed
+static int stream_skip_space(ConfigStream *stream) {
+    int c;
+    while ((c = stream_peek(stream)) == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        stream->position++;
+    }
+    return c;
+}
+
+static int stream_string(ConfigStream *stream) {
+    stream_next(stream);  // opening quote
+    for (;;) {
+        int c = stream_next(stream);
+        if (c == EOF) return 0;
+        if (c == '"') return 1;
+        if (c == '\\' && stream_next(stream) == EOF) return 0;
+    }
+}
+
+// Scan one value; its text lands in stream->text if collecting. 0 at EOF or on a stray bracket
+static int stream_value(ConfigStream *stream, int collect) {
+    stream->collect = collect;
+    stream->text_length = 0;
+    
+    int c = stream_skip_space(stream);
+    int ok = 1;
+    if (c == '"') {
+        ok = stream_string(stream);
+    } else if (c == '{' || c == '[') {
+        int depth = 0;
+        do {
+            c = stream_peek(stream);
+            if (c == '"') {
+                ok = stream_string(stream);
+                continue;
+            }
+            c = stream_next(stream);
+            if (c == '{' || c == '[') depth++;
+            if (c == '}' || c == ']') depth--;
+            ok = c != EOF;
+        } while (ok && depth > 0);
+    } else {
+        // Number, true, false or null: up to the next delimiter
+        size_t length = 0;
+        while ((c = stream_peek(stream)) != EOF && strchr(",]} \t\r\n", c) == NULL) {
+            stream_next(stream);
+            length++;
+        }
+        ok = length > 0;
+    }
+    stream->collect = 0;
+    return ok && !stream->failed;
+}
+
+// Expect one of `allowed` next; consumes and returns it, or 0
+static int stream_expect(ConfigStream *stream, const char *allowed) {
+    int c = stream_skip_space(stream);
+    if (c == EOF || strchr(allowed, c) == NULL) {
+        return 0;
+    }
+    stream->position++;
+    return c;
+}
+
+// Count the "modules" elements in a first pass and rewind; -1 if fp can't be rewound (a pipe) or doesn't parse
+static int stream_count_modules(FILE *fp) {
+    long start = ftell(fp);
+    if (start < 0) {
+        return -1;
+    }
+    ConfigStream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.fp = fp;
+    
+    int count = 0;
+    int ok = stream_expect(&stream, "{") != 0;
+    int c = ok ? stream_skip_space(&stream) : EOF;
+    if (c == '}') {
+        stream.position++;
+    }
+    while (ok && c != '}') {
+        ok = stream_skip_space(&stream) == '"' && stream_value(&stream, 1);
+        cJSON *key = ok ? cJSON_ParseWithLength(stream.text, stream.text_length) : NULL;
+        ok = ok && cJSON_IsString(key) && stream_expect(&stream, ":");
+        if (ok && strcmp(key->valuestring, "modules") == 0) {
+            // Elements are only scanned for their extent, not parsed
+            ok = stream_expect(&stream, "[") != 0;
+            int more = ok && stream_skip_space(&stream) != ']';
+            if (ok && !more) {
+                stream.position++;  // empty array
+            }
+            while (more) {
+                ok = stream_value(&stream, 0);
+                count += ok;
+                int separator = ok ? stream_expect(&stream, ",]") : 0;
+                ok = separator != 0;
+                more = separator == ',';
+            }
+        } else if (ok) {
+            ok = stream_value(&stream, 0);
+        }
+        cJSON_Delete(key);
+        
+        c = ok ? stream_expect(&stream, ",}") : 0;
+        ok = c != 0;
+    }
+    free(stream.text);
+    
+    if (fseek(fp, start, SEEK_SET) != 0) {
+        return -1;
+    }
+    return ok ? count : -1;
+}
+
+int check_modules_from_stream(FILE *fp) {
+    ConfigStream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.fp = fp;
+    
+    CheckRun run;
+    if (!check_run_begin(&run)) {
+        return -1;
+    }
+    // A file is counted first so the output matches check_modules_from_json(); a pipe can only be read once
+    int expected = stream_count_modules(fp);
+    if (expected >= 0) {
+        printf("Checking %d modules...\n\n", expected);
+    } else {
+        printf("Checking modules...\n\n");
+    }
+    fflush(stdout);
+    
+    int total = 0;
+    int seen_modules = 0;
+    int ok = stream_expect(&stream, "{") != 0;
+    cJSON *symbols = NULL;
+    
+    int c = ok ? stream_skip_space(&stream) : EOF;
+    if (c == '}') {
+        stream.position++;
+    }
+    while (ok && c != '}') {
+        // "key":
+        ok = stream_skip_space(&stream) == '"' && stream_value(&stream, 1);
+        cJSON *key = ok ? cJSON_ParseWithLength(stream.text, stream.text_length) : NULL;
+        ok = ok && cJSON_IsString(key) && stream_expect(&stream, ":");
+        const char *name = ok ? key->valuestring : "";
+        
+        if (ok && strcmp(name, "modules") == 0) {
+            // Every element is checked and reported as soon as it is complete
+            seen_modules = 1;
+            ok = stream_expect(&stream, "[") != 0;
+            int more = ok;
+            if (ok && stream_skip_space(&stream) == ']') {
+                stream.position++;  // empty array
+                more = 0;
+            }
+            while (more) {
+                ok = stream_value(&stream, 1);
+                cJSON *item = ok ? cJSON_ParseWithLength(stream.text, stream.text_length) : NULL;
+                ok = item != NULL;
+                if (ok) {
+                    ModuleBatch batch;
+                    module_batch_init(&batch);
+                    check_run_batch(&run, &batch);
+                    check_run_entry(&run, &batch, item, ++total, expected > 0 ? expected : 0);
+                    module_batch_free(&batch);
+                    fflush(stdout);
+                }
+                cJSON_Delete(item);
+                int separator = ok ? stream_expect(&stream, ",]") : 0;
+                ok = separator != 0;
+                more = separator == ',';
+            }
+        } else if (ok && strcmp(name, "symbols") == 0) {
+            ok = stream_value(&stream, 1);
+            cJSON_Delete(symbols);
+            symbols = ok ? cJSON_ParseWithLength(stream.text, stream.text_length) : NULL;
+        } else if (ok) {
+            ok = stream_value(&stream, 0);
+        }
+        cJSON_Delete(key);
+        
+        c = ok ? stream_expect(&stream, ",}") : 0;
+        ok = c != 0;
+    }
+    free(stream.text);
+    
+    if (!ok || !seen_modules) {
+        if (!ok) {
+            fprintf(stderr, "Error parsing JSON near byte %zu\n", stream.consumed + stream.position);
+        } else {
+            fprintf(stderr, "No modules array found in JSON\n");
+        }
+        cJSON_Delete(symbols);
+        if (run.rules_loaded) {
+            modprobe_rules_free(&run.rules);
+        }
+        module_context_close(run.context);
+        return -1;
+    }
+    
+    check_run_symbols(&run, symbols);
+    cJSON_Delete(symbols);
+    return check_run_end(&run, total);
+}
+
+/*
+ * audit_modules_from_json()
+ * 
+ * Same JSON format as check_modules_from_json(), but checks every kernel
+ * installed in /lib/modules instead of the running one: is each module
+ * built in or available as a file, so a reboot into that kernel will find it?
+ * 
+ * Output:
+ *   [1/2] videodev
+ *     6.1.0-13-amd64: ✓ BUILT-IN
+ *     6.5.0-1-amd64: ○ AVAILABLE as 'v4l2_core'
+ *   ...
+ *   Summary:
+ *     6.1.0-13-amd64: 2/2
+ *     6.5.0-1-amd64: 1/2 (missing: v4l2loopback)
+ */
+int audit_modules_from_json(const char *json_str) {
+    cJSON *root = cJSON_Parse(json_str);
+    if (root == NULL) {
+        fprintf(stderr, "Error parsing JSON: %s\n", cJSON_GetErrorPtr());
+        return -1;
+    }
+    
+    cJSON *modules = cJSON_GetObjectItem(root, "modules");
+    if (modules == NULL || !cJSON_IsArray(modules)) {
+        fprintf(stderr, "No modules array found in JSON\n");
+        cJSON_Delete(root);
+        return -1;
+    }
+    
+    ModuleBatch batch;
+    module_batch_init(&batch);
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, modules) {
+        batch_add_json_entry(&batch, item);
+    }
+    cJSON_Delete(root);
+    
+    ModuleAudit audit;
+    if (!module_audit_run(&audit, &batch)) {
+        fprintf(stderr, "Failed to read /lib/modules\n");
+        module_batch_free(&batch);
+        return -1;
+    }
+    
+    printf("Auditing %zu modules across %zu kernels...\n\n", batch.count, audit.kernel_count);
+    
+    for (size_t m = 0; m < batch.count; m++) {
+        const CompactModule *mod = &batch.modules[m];
+        printf("[%zu/%zu] %s\n", m + 1, batch.count, module_batch_string(&batch, mod->name));
+        
+        for (size_t k = 0; k < audit.kernel_count; k++) {
+            const ModuleAuditCell *cell = module_audit_cell(&audit, m, k);
+            printf("  %s: ", audit.kernels[k].version);
+            if (!audit.kernels[k].ready) {
+                printf("? UNREADABLE\n");
+            } else if (cell->entry == NULL) {
+                printf("✗ MISSING\n");
+            } else {
+                printf(cell->entry->builtin ? "✓ BUILT-IN" : "○ AVAILABLE");
+                if (module_name_is_pattern(module_batch_string(&batch, cell->found_as))) {
+                    printf(" as '%s'", kernel_index_string(&audit.kernels[k], cell->entry->name));
+                } else if (cell->found_as != mod->name) {
+                    printf(" as '%s'", module_batch_string(&batch, cell->found_as));
+                }
+                printf("\n");
+            }
+        }
+    }
+    
+    int complete = 1;
+    printf("\n========================================\n");
+    printf("Summary:\n");
+    for (size_t k = 0; k < audit.kernel_count; k++) {
+        size_t found = 0;
+        for (size_t m = 0; m < batch.count; m++) {
+            found += module_audit_cell(&audit, m, k)->entry != NULL;
+        }
+        printf("  %s: %zu/%zu", audit.kernels[k].version, found, batch.count);
+        if (found < batch.count) {
+            complete = 0;
+            printf(" (missing:");
+            for (size_t m = 0; m < batch.count; m++) {
+                if (module_audit_cell(&audit, m, k)->entry == NULL) {
+                    printf(" %s", module_batch_string(&batch, batch.modules[m].name));
+                }
+            }
+            printf(")");
+        }
+        printf("\n");
+    }
+    printf("========================================\n");
+    
+    module_audit_free(&audit);
+    module_batch_free(&batch);
+    
+    // Return 0 only if every module is available in every installed kernel
+    return complete ? 0 : 1;
+}
+
+/*
+ * ============================================================================
+ * DAEMON MODE
+ * ============================================================================
+ * 
+ * Health checks that exec modulecheck pay for the process, the JSON config,
+ * uname and a scan per name on every run. The daemon keeps two indexes of
+ * the running kernel in memory and answers newline-delimited JSON requests
+ * on a Unix socket with lookups only:
+ * - files: modules.builtin + modules.dep (KernelModuleIndex), rebuilt when
+ *   the mtime of one of them or of /lib/modules/<kver> changes
+ * - running: /sys/module (or /proc/modules), rebuilt after a module uevent
+ *   from the kernel; without a uevent socket (no permission, no netlink in
+ *   the namespace) loaded state is looked up live through sysfs instead
+ */
+
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_MAX_REQUEST (1024 * 1024)
+#define DAEMON_MAX_OUTPUT (4 * 1024 * 1024)  // unsent answers a client may leave queued before it is dropped
+
+typedef struct {
+    char kernel_version[256];
+    KernelModuleIndex files;
+    KernelModuleIndex running;
+    ModprobeRules rules;
+    ModuleBinIndex alias_bin;        // modules.alias.bin, if depmod wrote one
+    ModuleStringTable alias_strings; // else modules.alias: pattern and module pairs in file order
+    uint32_t *aliases;
+    size_t alias_count;
+    int running_stale;
+    int uevent_fd;
+    struct timespec files_signature[5];
+    time_t files_checked;
+    unsigned long queries;
+} ModuleDaemon;
+
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    char *output;  // answers the socket didn't take yet
+    size_t output_length;
+    size_t output_capacity;
+} DaemonClient;
+
+// Set by SIGINT/SIGTERM, checked after every poll()
+static volatile sig_atomic_t daemon_stop;
+
+static void daemon_signal(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+static void daemon_free_aliases(ModuleDaemon *daemon) {
+    module_bin_index_close(&daemon->alias_bin);
+    free(daemon->alias_strings.data);
+    free(daemon->alias_strings.slots);
+    free(daemon->aliases);
+    memset(&daemon->alias_strings, 0, sizeof(daemon->alias_strings));
+    daemon->aliases = NULL;
+    daemon->alias_count = 0;
+}
+
+// modules.alias into memory: the .bin trie mapped, or the text file's "alias <pattern> <module>" lines
+static void daemon_load_aliases(ModuleDaemon *daemon) {
+    char path[MAX_PATH];
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t capacity = 0;
+    
+    daemon_free_aliases(daemon);
+    root_path(path, sizeof(path), "/lib/modules/%s/modules.alias.bin", daemon->kernel_version);
+    if (module_bin_index_open(&daemon->alias_bin, path)) {
+        return;
+    }
+    
+    root_path(path, sizeof(path), "/lib/modules/%s/modules.alias", daemon->kernel_version);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return;
+    }
+    while (read_line(&line, &line_size, fp) != -1) {
+        char *save = NULL;
+        char *keyword = strtok_r(line, " \t\n", &save);
+        char *pattern = strtok_r(NULL, " \t\n", &save);
+        char *module = strtok_r(NULL, " \t\n", &save);
+        if (keyword == NULL || strcmp(keyword, "alias") != 0 || pattern == NULL || module == NULL) {
+            continue;
+        }
+        if (daemon->alias_count + 2 > capacity) {
+            size_t grown_capacity = capacity ? capacity * 2 : 1024;
+            uint32_t *grown = realloc(daemon->aliases, grown_capacity * sizeof(uint32_t));
+            if (grown == NULL) break;
+            daemon->aliases = grown;
+            capacity = grown_capacity;
+        }
+        // Stored normalized, like the names they are matched against (depmod writes "fs-ext4")
+        char normalized[MAX_PATH];
+        module_alias_normalize(pattern, normalized, sizeof(normalized));
+        uint32_t pattern_id = module_strings_intern(&daemon->alias_strings, normalized);
+        uint32_t module_id = module_strings_intern(&daemon->alias_strings, module);
+        if (pattern_id == MODULE_STRING_INVALID || module_id == MODULE_STRING_INVALID) break;
+        daemon->aliases[daemon->alias_count++] = pattern_id;
+        daemon->aliases[daemon->alias_count++] = module_id;
+    }
+    free(line);
+    fclose(fp);
+}
+
+// The module a modules.alias name resolves to (first match, as module_index_lookup()), or NULL
+static const char *daemon_alias_target(const ModuleDaemon *daemon, const char *alias) {
+    char normalized[MAX_PATH];
+    module_alias_normalize(alias, normalized, sizeof(normalized));
+    if (daemon->alias_bin.data != NULL) {
+        return module_bin_index_match(&daemon->alias_bin, normalized);
+    }
+    for (size_t i = 0; i < daemon->alias_count; i += 2) {
+        if (fnmatch(daemon->alias_strings.data + daemon->aliases[i], normalized, 0) == 0) {
+            return daemon->alias_strings.data + daemon->aliases[i + 1];
+        }
+    }
+    return NULL;
+}
+
+// Rebuild the file index and aliases if /lib/modules/<kver>, modules.dep, modules.builtin or modules.alias(.bin) changed
+static void daemon_refresh_files(ModuleDaemon *daemon, int force) {
+    static const char *const files[] = { "", "/modules.dep", "/modules.builtin", "/modules.alias", "/modules.alias.bin" };
+    struct timespec signature[5];
+    char path[MAX_PATH];
+    struct stat st;
+    
+    memset(signature, 0, sizeof(signature));
+    for (int i = 0; i < 5; i++) {
+        root_path(path, sizeof(path), "/lib/modules/%s%s", daemon->kernel_version, files[i]);
+        if (stat(path, &st) == 0) {
+            signature[i] = st.st_mtim;
+        }
+    }
+    daemon->files_checked = time(NULL);
+    if (!force && memcmp(signature, daemon->files_signature, sizeof(signature)) == 0) {
+        return;
+    }
+    memcpy(daemon->files_signature, signature, sizeof(signature));
+    
+    // A kernel without /lib/modules tree keeps an empty index (sysfs still answers)
+    kernel_index_free(&daemon->files);
+    kernel_index_build(&daemon->files, daemon->kernel_version);
+    daemon_load_aliases(daemon);
+}
+
+static void daemon_refresh_running(ModuleDaemon *daemon) {
+    kernel_index_free(&daemon->running);
+    running_index_build(&daemon->running);
+    daemon->running_stale = 0;
+}
+
+// MODULE_SYSFS_* state of one name in the running kernel
+static int daemon_running_state(ModuleDaemon *daemon, const char *name) {
+    if (daemon->uevent_fd >= 0 && daemon->running.ready) {
+        const KernelModuleEntry *entry = kernel_index_lookup(&daemon->running, name);
+        if (entry == NULL) {
+            return MODULE_SYSFS_ABSENT;
+        }
+        return entry->builtin ? MODULE_SYSFS_BUILTIN : MODULE_SYSFS_LOADED;
+    }
+    
+    // No change notifications: the cached snapshot could be stale, ask the kernel
+    int state = sysfs_module_state(name);
+    if (state == MODULE_SYSFS_UNAVAILABLE) {
+        state = is_module_loaded(name) ? MODULE_SYSFS_LOADED : MODULE_SYSFS_ABSENT;
+    }
+    return state;
+}
+
+// daemon_strategy() for a family pattern: the first member that matches; *name becomes the member
+static uint16_t daemon_family_strategy(ModuleDaemon *daemon, int strategy, const char **name, const char **path) {
+    const KernelModuleEntry *entry;
+    
+    if (strategy == 1 || strategy == 2) {
+        if ((daemon->uevent_fd < 0 && strategy == 1) || !daemon->running.ready) {
+            daemon_refresh_running(daemon);  // no change notifications: a fresh snapshot per name
+        }
+        for (entry = kernel_index_match(&daemon->running, *name, NULL); entry != NULL;
+             entry = kernel_index_match(&daemon->running, *name, entry)) {
+            if (entry->builtin == (strategy == 2)) {
+                const char *member = kernel_index_string(&daemon->running, entry->name);
+                const KernelModuleEntry *file = kernel_index_lookup(&daemon->files, member);
+                *name = member;
+                if (strategy == 2) {
+                    *path = "[built-in]";
+                    return MODULE_FLAG_LOADED | MODULE_FLAG_AVAILABLE | MODULE_FLAG_BUILTIN;
+                }
+                *path = file != NULL && !file->builtin ? kernel_index_string(&daemon->files, file->path) : "";
+                return MODULE_FLAG_LOADED | MODULE_FLAG_AVAILABLE;
+            }
+        }
+    }
+    if (strategy == 2 || strategy == 3) {
+        for (entry = kernel_index_match(&daemon->files, *name, NULL); entry != NULL;
+             entry = kernel_index_match(&daemon->files, *name, entry)) {
+            if (entry->builtin == (strategy == 2)) {
+                *name = kernel_index_string(&daemon->files, entry->name);
+                *path = kernel_index_string(&daemon->files, entry->path);
+                return (strategy == 2) ? MODULE_FLAG_LOADED | MODULE_FLAG_AVAILABLE | MODULE_FLAG_BUILTIN
+                                       : MODULE_FLAG_AVAILABLE;
+            }
+        }
+    }
+    return 0;
+}
+
+// One find_module() strategy (1 loaded, 2 built-in, 3 module file) for one name; 0 if it doesn't match
+static uint16_t daemon_strategy(ModuleDaemon *daemon, int strategy, const char **name, const char **path) {
+    if (module_name_is_pattern(*name)) {
+        return daemon_family_strategy(daemon, strategy, name, path);
+    }
+    const KernelModuleEntry *entry = kernel_index_lookup(&daemon->files, *name);
+    
+    if (strategy == 1 && daemon_running_state(daemon, *name) == MODULE_SYSFS_LOADED) {
+        *path = entry != NULL && !entry->builtin ? kernel_index_string(&daemon->files, entry->path) : "";
+        return MODULE_FLAG_LOADED | MODULE_FLAG_AVAILABLE;
+    }
+    if (strategy == 2 && ((entry != NULL && entry->builtin) || daemon_running_state(daemon, *name) == MODULE_SYSFS_BUILTIN)) {
+        *path = "[built-in]";
+        return MODULE_FLAG_LOADED | MODULE_FLAG_AVAILABLE | MODULE_FLAG_BUILTIN;
+    }
+    if (strategy == 3 && entry != NULL) {
+        *path = kernel_index_string(&daemon->files, entry->path);
+        return MODULE_FLAG_AVAILABLE;
+    }
+    return 0;
+}
+
+/*
+ * Same strategies and result flags as module_batch_check_one(), minus
+ * running modinfo (a process per name is what the daemon exists to avoid);
+ * modules.alias names are resolved from memory instead
+ */
+static void daemon_check_module(ModuleDaemon *daemon, ModuleBatch *batch, size_t index) {
+    CompactModule *mod = &batch->modules[index];
+    int name_count = 1 + mod->alias_count;
+    const char *found_name = module_batch_string(batch, mod->name);
+    const char *path = "";
+    uint16_t flags = 0;
+    
+    // Strategy by strategy, primary name first, then aliases
+    for (int strategy = 1; strategy <= 3 && flags == 0; strategy++) {
+        for (int i = 0; i < name_count && flags == 0; i++) {
+            uint32_t id = (i == 0) ? mod->name : batch->aliases[mod->alias_first + (uint32_t)i - 1];
+            const char *name = module_batch_string(batch, id);
+            double start = stats_clock();
+            flags = daemon_strategy(daemon, strategy, &name, &path);
+            stats_strategy(strategy - 1, start, flags != 0);
+            if (flags != 0) {
+                found_name = name;
+                flags |= (uint16_t)(strategy << MODULE_FLAG_STRATEGY_SHIFT);  // found_by + 1
+            }
+        }
+    }
+    
+    // modprobe.d aliases for names that aren't modules themselves
+    for (int i = 0; i < name_count && flags == 0; i++) {
+        uint32_t id = (i == 0) ? mod->name : batch->aliases[mod->alias_first + (uint32_t)i - 1];
+        const char *alias = module_batch_string(batch, id);
+        const char *target = module_name_is_pattern(alias) ? NULL : modprobe_resolve_alias(&daemon->rules, alias);
+        for (int strategy = 1; target != NULL && strategy <= 3 && flags == 0; strategy++) {
+            double start = stats_clock();
+            flags = daemon_strategy(daemon, strategy, &target, &path);
+            stats_strategy(strategy - 1, start, flags != 0);
+            if (flags != 0) {
+                flags |= (uint16_t)(strategy << MODULE_FLAG_STRATEGY_SHIFT);
+            }
+        }
+        if (flags != 0) {
+            flags |= MODULE_FLAG_VIA_ALIAS;
+            found_name = target;
+        }
+    }
+    
+    // modules.alias names (pci:..., fs-...): a module file of the target, as check_module_by_modinfo() finds it
+    for (int i = 0; i < name_count && flags == 0; i++) {
+        uint32_t id = (i == 0) ? mod->name : batch->aliases[mod->alias_first + (uint32_t)i - 1];
+        const char *alias = module_batch_string(batch, id);
+        if (module_name_is_pattern(alias)) {
+            continue;
+        }
+        double start = stats_clock();
+        const char *target = daemon_alias_target(daemon, alias);
+        const KernelModuleEntry *entry = (target != NULL) ? kernel_index_lookup(&daemon->files, target) : NULL;
+        if (entry != NULL && !entry->builtin) {
+            path = kernel_index_string(&daemon->files, entry->path);
+            flags = MODULE_FLAG_AVAILABLE | (uint16_t)((MODULE_STRATEGY_MODINFO + 1) << MODULE_FLAG_STRATEGY_SHIFT);
+            found_name = alias;
+        }
+        stats_strategy(MODULE_STRATEGY_MODINFO, start, flags != 0);
+    }
+    
+    // Everything points into the batch, the rules or the indexes; intern before the batch strings move
+    uint32_t found_as = (flags & MODULE_FLAG_AVAILABLE) ? module_strings_intern(&batch->strings, found_name) : MODULE_STRING_NONE;
+    uint32_t path_id = module_strings_intern(&batch->strings, path);
+    mod = &batch->modules[index];
+    mod->flags = flags;
+    mod->found_as = found_as == MODULE_STRING_INVALID ? mod->name : found_as;
+    mod->path = path_id == MODULE_STRING_INVALID ? MODULE_STRING_NONE : path_id;
+    module_batch_verdict(batch, mod, &daemon->rules);
+}
+
+static cJSON *daemon_error(const char *message) {
+    cJSON *response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "error", message);
+    return response;
+}
+
+// Answer one request line; returns the response object (never NULL unless out of memory)
+#ifdef MODULECHECK_INSTRUMENTATION
+static cJSON *daemon_stats_json(const ModuleCheckStats *stats) {
+    cJSON *object = cJSON_CreateObject();
+    cJSON *strategies = cJSON_AddObjectToObject(object, "strategies");
+    for (int i = 0; i < MODULE_STRATEGY_COUNT; i++) {
+        cJSON *strategy = cJSON_AddObjectToObject(strategies, module_strategy_name(i));
+        cJSON_AddNumberToObject(strategy, "calls", (double)stats->strategy_calls[i]);
+        cJSON_AddNumberToObject(strategy, "hits", (double)stats->strategy_hits[i]);
+        cJSON_AddNumberToObject(strategy, "seconds", stats->strategy_seconds[i]);
+    }
+    cJSON_AddNumberToObject(object, "subprocesses", (double)stats->subprocesses);
+    cJSON_AddNumberToObject(object, "bytes_read", (double)stats->bytes_read);
+    cJSON_AddNumberToObject(object, "cache_hits", (double)stats->cache_hits);
+    cJSON_AddNumberToObject(object, "cache_misses", (double)stats->cache_misses);
+    return object;
+}
+#endif
+
+static cJSON *daemon_handle_request(ModuleDaemon *daemon, const char *request, size_t length) {
+    cJSON *root = cJSON_ParseWithLength(request, length);
+    if (root == NULL) {
+        return daemon_error("invalid JSON");
+    }
+    
+    cJSON *command = cJSON_GetObjectItem(root, "command");
+    if (cJSON_IsString(command)) {
+        cJSON *response = NULL;
+        if (strcmp(command->valuestring, "ping") == 0) {
+            response = cJSON_CreateObject();
+            cJSON_AddStringToObject(response, "kernel", daemon->kernel_version);
+            cJSON_AddNumberToObject(response, "queries", (double)daemon->queries);
+            cJSON_AddNumberToObject(response, "indexed_files", (double)daemon->files.count);
+            cJSON_AddBoolToObject(response, "uevents", daemon->uevent_fd >= 0);
+        } else if (strcmp(command->valuestring, "reload") == 0) {
+            daemon_refresh_files(daemon, 1);
+            daemon_refresh_running(daemon);
+            modprobe_rules_free(&daemon->rules);
+            modprobe_rules_load(&daemon->rules);
+            response = cJSON_CreateObject();
+            cJSON_AddBoolToObject(response, "ok", 1);
+        } else {
+            response = daemon_error("unknown command");
+        }
+        cJSON_Delete(root);
+        return response;
+    }
+    
+    cJSON *modules = cJSON_GetObjectItem(root, "modules");
+    if (!cJSON_IsArray(modules)) {
+        cJSON_Delete(root);
+        return daemon_error("No modules array found in JSON");
+    }
     
-    snprintf(search_paths[0], MAX_PATH, "/lib/modules/%s/kernel", kernel_version);
-    snprintf(search_paths[1], MAX_PATH, "/lib/modules/%s/extra", kernel_version);
-    snprintf(search_paths[2], MAX_PATH, "/lib/modules/%s/updates", kernel_version);
+    if (daemon->running_stale && daemon->uevent_fd >= 0) {
+        daemon_refresh_running(daemon);
+    }
+    daemon->queries++;
     
-    // Normalize module name for search
-    char search_name[MAX_MODULE_NAME];
-    strncpy(search_name, module_name, sizeof(search_name) - 1);
-    for (char *p = search_name; *p; p++) {
-        if (*p == '-') *p = '_';
+    ModuleBatch batch;
+    module_batch_init(&batch);
+#ifdef MODULECHECK_INSTRUMENTATION
+    ModuleCheckStats stats;
+    memset(&stats, 0, sizeof(stats));
+    ModuleCheckStats *previous = module_check_set_stats(&stats);
+#endif
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, modules) {
+        batch_add_json_entry(&batch, item);
     }
+    cJSON_Delete(root);
     
-    // Search each path hierarchy
-    for (int i = 0; i < 3; i++) {
-        // Use find command to search recursively
-        snprintf(cmd, sizeof(cmd), 
-                 "find %s -name '%s.ko*' 2>/dev/null | head -1", 
-                 search_paths[i], search_name);
+    cJSON *response = cJSON_CreateObject();
+    cJSON *results = cJSON_CreateArray();
+    int loaded = 0;
+    int available = 0;
+    for (size_t i = 0; i < batch.count; i++) {
+        daemon_check_module(daemon, &batch, i);
+        stats_add(modules_checked, 1);
+        const CompactModule *mod = &batch.modules[i];
         
-        fp = popen(cmd, "r");
-        if (fp != NULL) {
-            if (fgets(result_path, MAX_PATH, fp) != NULL) {
-                // Remove newline
-                result_path[strcspn(result_path, "\n")] = 0;
-                pclose(fp);
-                
-                if (strlen(result_path) > 0 && access(result_path, F_OK) == 0) {
-                    return 1;
-                }
-            }
-            pclose(fp);
+        const char *status = "missing";
+        if (mod->flags & MODULE_FLAG_BUILTIN) {
+            status = "builtin";
+        } else if (mod->flags & MODULE_FLAG_LOADED) {
+            status = "loaded";
+        } else if (mod->flags & MODULE_FLAG_DISABLED) {
+            // The file may be there, but modprobe runs true/false instead
+            status = (mod->flags & MODULE_FLAG_AVAILABLE) ? "disabled" : "missing";
+        } else if (mod->flags & MODULE_FLAG_AVAILABLE) {
+            status = "available";
         }
-    }
-    
-    // Try modinfo as fallback
-    snprintf(cmd, sizeof(cmd), "modinfo -F filename %s 2>/dev/null", search_name);
-    fp = popen(cmd, "r");
-    if (fp != NULL) {
-        if (fgets(result_path, MAX_PATH, fp) != NULL) {
-            result_path[strcspn(result_path, "\n")] = 0;
-            int status = pclose(fp);
-            
-            if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && 
-                strlen(result_path) > 0) {
-                return 1;
-            }
-        } else {
-            pclose(fp);
+        loaded += (mod->flags & MODULE_FLAG_LOADED) != 0;
+        available += strcmp(status, "missing") != 0 && strcmp(status, "disabled") != 0;
+        
+        cJSON *result = cJSON_CreateObject();
+        cJSON_AddStringToObject(result, "name", module_batch_string(&batch, mod->name));
+        cJSON_AddStringToObject(result, "status", status);
+        if (mod->flags & MODULE_FLAG_AVAILABLE) {
+            cJSON_AddStringToObject(result, "found_as", module_batch_string(&batch, mod->found_as));
+            cJSON_AddStringToObject(result, "path", module_batch_string(&batch, mod->path));
+        }
+        if (mod->flags & MODULE_FLAG_BLACKLISTED) {
+            cJSON_AddBoolToObject(result, "blacklisted", 1);
         }
+        if (mod->flags & MODULE_FLAG_INSTALL) {
+            char rule_name[MAX_MODULE_NAME];
+            cJSON_AddStringToObject(result, "install", modprobe_install_command(&daemon->rules,
+                                    module_batch_verdict_name(&batch, mod, rule_name, sizeof(rule_name))));
+        }
+        cJSON_AddItemToArray(results, result);
     }
     
-    return 0;
+    cJSON_AddStringToObject(response, "kernel", daemon->kernel_version);
+    cJSON_AddNumberToObject(response, "total", (double)batch.count);
+    cJSON_AddNumberToObject(response, "loaded", loaded);
+    cJSON_AddNumberToObject(response, "available", available);
+    cJSON_AddItemToObject(response, "modules", results);
+#ifdef MODULECHECK_INSTRUMENTATION
+    module_check_set_stats(previous);
+    cJSON_AddItemToObject(response, "stats", daemon_stats_json(&stats));
+#endif
+    
+    module_batch_free(&batch);
+    return response;
 }
 
 /*
- * check_module_by_modinfo()
- * 
- * Uses modinfo command to get detailed module information.
- * 
- * Why this is useful:
- * - Shows module aliases
- * - Shows dependencies
- * - Confirms module exists in system
- * 
- * modinfo output includes:
- * - filename: /lib/modules/.../module.ko
- * - alias: alternative names
- * - depends: required modules
- * - description: what the module does
+ * Client sockets are non-blocking: answers are queued per client and sent
+ * as far as the socket takes them, the rest when poll() reports POLLOUT.
+ * A client that keeps sending requests without reading the answers is
+ * dropped once its queue is over DAEMON_MAX_OUTPUT, instead of blocking
+ * the loop that serves everyone.
  */
-int check_module_by_modinfo(const char *module_name, Module *mod) {
-    char cmd[MAX_CMD];
-    FILE *fp;
-    char line[512];
-    
-    snprintf(cmd, sizeof(cmd), "modinfo %s 2>/dev/null", module_name);
-    fp = popen(cmd, "r");
-    
-    if (fp == NULL) {
-        return 0;
+static int daemon_flush(DaemonClient *client) {
+    size_t sent_total = 0;
+    while (sent_total < client->output_length) {
+        ssize_t sent = send(client->fd, client->output + sent_total, client->output_length - sent_total,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return 0;
+        }
+        sent_total += (size_t)sent;
     }
-    
-    int found = 0;
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "filename:", 9) == 0) {
-            found = 1;
-            // Extract filename
-            char *filename = line + 9;
-            while (*filename == ' ' || *filename == '\t') filename++;
-            
-            strncpy(mod->path, filename, MAX_PATH - 1);
-            mod->path[strcspn(mod->path, "\n")] = 0;
+    memmove(client->output, client->output + sent_total, client->output_length - sent_total);
+    client->output_length -= sent_total;
+    return 1;
+}
+
+static int daemon_queue(DaemonClient *client, const char *data, size_t length) {
+    if (client->output_length > DAEMON_MAX_OUTPUT) {
+        return 0;  // still hasn't read what it asked for before
+    }
+    if (client->output_capacity - client->output_length < length) {
+        size_t capacity = client->output_capacity ? client->output_capacity : 8192;
+        while (capacity - client->output_length < length) {
+            capacity *= 2;
         }
+        char *output = realloc(client->output, capacity);
+        if (output == NULL) {
+            return 0;
+        }
+        client->output = output;
+        client->output_capacity = capacity;
     }
-    
-    int status = pclose(fp);
-    return found && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    memcpy(client->output + client->output_length, data, length);
+    client->output_length += length;
+    return 1;
 }
 
-/*
- * find_module()
- * 
- * Main search function - tries multiple strategies to find a module.
- * 
- * Search strategy:
- * 1. Check if loaded (is_module_loaded)
- * 2. Check if built-in (is_module_builtin)
- * 3. Search by primary name
- * 4. Try all aliases
- * 5. Use modinfo for confirmation
- * 6. Find .ko file location
- * 
- * Module naming complexity:
- * - v4l2loopback: exact match required
- * - videodev: core v4l2 module
- * - snd_hda_intel: sound card (underscores vs hyphens)
- */
-int find_module(Module *mod, const char *kernel_version) {
-    // Initialize
-    mod->loaded = 0;
-    mod->available = 0;
-    mod->builtin = 0;
-    mod->found_as[0] = '\0';
-    mod->path[0] = '\0';
+static void daemon_drop_client(DaemonClient *client) {
+    close(client->fd);
+    free(client->buffer);
+    free(client->output);
+}
+
+// Read what a client sent and answer every complete line; returns 0 to drop the client
+static int daemon_serve_client(ModuleDaemon *daemon, DaemonClient *client) {
+    if (client->capacity - client->length < 4096) {
+        size_t capacity = client->capacity ? client->capacity * 2 : 8192;
+        if (capacity > DAEMON_MAX_REQUEST) {
+            const char *error = "{\"error\":\"request too large\"}\n";
+            if (daemon_queue(client, error, strlen(error))) {
+                daemon_flush(client);  // best effort, the client is dropped either way
+            }
+            return 0;
+        }
+        char *buffer = realloc(client->buffer, capacity);
+        if (buffer == NULL) {
+            return 0;
+        }
+        client->buffer = buffer;
+        client->capacity = capacity;
+    }
     
-    /*
-     * STRATEGY 1: Check if currently loaded
-     * Start with primary name
-     */
-    if (is_module_loaded(mod->name)) {
-        mod->loaded = 1;
-        mod->available = 1;
-        strncpy(mod->found_as, mod->name, sizeof(mod->found_as) - 1);
-        
-        // Try to get module file path
-        check_module_by_modinfo(mod->name, mod);
-        return 1;
+    ssize_t received = recv(client->fd, client->buffer + client->length, client->capacity - client->length, 0);
+    if (received <= 0) {
+        return received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK);
     }
+    client->length += (size_t)received;
     
-    /*
-     * STRATEGY 2: Try all aliases
-     * Module might be loaded under different name
-     */
-    for (int i = 0; i < mod->alias_count; i++) {
-        if (is_module_loaded(mod->aliases[i])) {
-            mod->loaded = 1;
-            mod->available = 1;
-            strncpy(mod->found_as, mod->aliases[i], sizeof(mod->found_as) - 1);
+    size_t start = 0;
+    char *newline;
+    while ((newline = memchr(client->buffer + start, '\n', client->length - start)) != NULL) {
+        size_t line_length = (size_t)(newline - (client->buffer + start));
+        if (line_length > 0) {
+            cJSON *response = daemon_handle_request(daemon, client->buffer + start, line_length);
+            char *text = response != NULL ? cJSON_PrintUnformatted(response) : NULL;
+            cJSON_Delete(response);
+            if (text == NULL) {
+                return 0;
+            }
             
-            check_module_by_modinfo(mod->aliases[i], mod);
-            return 1;
+            size_t text_length = strlen(text);
+            text[text_length] = '\n';  // replaces the terminator; length is passed explicitly
+            int ok = daemon_queue(client, text, text_length + 1);
+            free(text);
+            if (!ok) {
+                return 0;
+            }
         }
+        start += line_length + 1;
     }
     
-    /*
-     * STRATEGY 3: Check if built into kernel
-     * Built-in modules are always "available"
-     */
-    if (is_module_builtin(mod->name, kernel_version)) {
-        mod->builtin = 1;
-        mod->available = 1;
-        mod->loaded = 1; // Built-in = always loaded
-        strncpy(mod->found_as, mod->name, sizeof(mod->found_as) - 1);
-        strcpy(mod->path, "[built-in]");
-        return 1;
+    memmove(client->buffer, client->buffer + start, client->length - start);
+    client->length -= start;
+    return daemon_flush(client);
+}
+
+// Subscribe to kernel uevents; returns -1 where that isn't allowed
+static int daemon_open_uevents(void) {
+    struct sockaddr_nl address;
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        return -1;
     }
     
-    // Check aliases for built-in
-    for (int i = 0; i < mod->alias_count; i++) {
-        if (is_module_builtin(mod->aliases[i], kernel_version)) {
-            mod->builtin = 1;
-            mod->available = 1;
-            mod->loaded = 1;
-            strncpy(mod->found_as, mod->aliases[i], sizeof(mod->found_as) - 1);
-            strcpy(mod->path, "[built-in]");
-            return 1;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1;  // kernel broadcast group
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Drain pending uevents; a module (un)load ("add@/module/<name>", "remove@/module/<name>") invalidates the running index
+static void daemon_read_uevents(ModuleDaemon *daemon) {
+    char message[8192];
+    ssize_t received;
+    
+    while ((received = recv(daemon->uevent_fd, message, sizeof(message) - 1, MSG_DONTWAIT)) > 0) {
+        message[received] = '\0';
+        const char *at = strchr(message, '@');
+        if (at != NULL && strncmp(at + 1, "/module/", strlen("/module/")) == 0) {
+            daemon->running_stale = 1;
         }
     }
+    if (received < 0 && errno == ENOBUFS) {
+        // Events were dropped, so assume the worst
+        daemon->running_stale = 1;
+    }
+}
+
+static int daemon_listen(const char *socket_path) {
+    struct sockaddr_un address;
+    struct stat st;
     
-    /*
-     * STRATEGY 4: Search for module file (not loaded but available)
-     * Check primary name first
-     */
-    if (find_module_file(mod->name, kernel_version, mod->path)) {
-        mod->available = 1;
-        strncpy(mod->found_as, mod->name, sizeof(mod->found_as) - 1);
-        return 1;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
     }
     
-    // Try aliases
-    for (int i = 0; i < mod->alias_count; i++) {
-        if (find_module_file(mod->aliases[i], kernel_version, mod->path)) {
-            mod->available = 1;
-            strncpy(mod->found_as, mod->aliases[i], sizeof(mod->found_as) - 1);
-            return 1;
+    // Replace a stale socket from an earlier run, but never a regular file
+    if (lstat(socket_path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "Not a socket: %s\n", socket_path);
+            return -1;
         }
+        unlink(socket_path);
     }
     
-    /*
-     * STRATEGY 5: Use modinfo as final check
-     * Sometimes modules exist but are in non-standard locations
-     */
-    if (check_module_by_modinfo(mod->name, mod)) {
-        mod->available = 1;
-        strncpy(mod->found_as, mod->name, sizeof(mod->found_as) - 1);
-        return 1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
     }
     
-    for (int i = 0; i < mod->alias_count; i++) {
-        if (check_module_by_modinfo(mod->aliases[i], mod)) {
-            mod->available = 1;
-            strncpy(mod->found_as, mod->aliases[i], sizeof(mod->found_as) - 1);
-            return 1;
-        }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 16) != 0) {
+        perror(socket_path);
+        close(fd);
+        return -1;
     }
-    
-    return 0;
+    return fd;
 }
 
-/*
- * check_modules_from_json()
- * 
- * Parses JSON and checks multiple modules.
- * 
- * JSON format:
- * {
- *   "modules": [
- *     {
- *       "name": "v4l2loopback",
- *       "aliases": []
- *     },
- *     {
- *       "name": "videodev",
- *       "aliases": ["v4l2_core"]
- *     }
- *   ]
- * }
- * 
- * Flexible format also supported:
- * {
- *   "modules": ["v4l2loopback", "videodev"]
- * }
- */
-int check_modules_from_json(const char *json_str) {
-    cJSON *root = cJSON_Parse(json_str);
-    if (root == NULL) {
-        fprintf(stderr, "Error parsing JSON: %s\n", cJSON_GetErrorPtr());
-        return -1;
-    }
+int module_daemon_run(const char *socket_path) {
+    ModuleDaemon daemon;
+    DaemonClient clients[DAEMON_MAX_CLIENTS];
+    struct pollfd fds[2 + DAEMON_MAX_CLIENTS];
+    size_t client_count = 0;
     
-    // Get kernel version
-    char kernel_version[256];
-    if (!get_kernel_version(kernel_version, sizeof(kernel_version))) {
+    memset(&daemon, 0, sizeof(daemon));
+    if (!get_kernel_version(daemon.kernel_version, sizeof(daemon.kernel_version))) {
         fprintf(stderr, "Failed to get kernel version\n");
-        cJSON_Delete(root);
         return -1;
     }
     
-    printf("Kernel version: %s\n", kernel_version);
-    
-    cJSON *modules = cJSON_GetObjectItem(root, "modules");
-    if (modules == NULL || !cJSON_IsArray(modules)) {
-        fprintf(stderr, "No modules array found in JSON\n");
-        cJSON_Delete(root);
+    int listen_fd = daemon_listen(socket_path);
+    if (listen_fd < 0) {
         return -1;
     }
     
-    int total = cJSON_GetArraySize(modules);
-    int loaded_count = 0;
-    int available_count = 0;
+    daemon.uevent_fd = daemon_open_uevents();
+    daemon_refresh_files(&daemon, 1);
+    daemon_refresh_running(&daemon);
+    modprobe_rules_load(&daemon.rules);
     
-    printf("Checking %d modules...\n\n", total);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = daemon_signal;  // no SA_RESTART, so poll() returns
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
     
-    for (int i = 0; i < total; i++) {
-        cJSON *item = cJSON_GetArrayItem(modules, i);
-        Module mod;
-        memset(&mod, 0, sizeof(Module));
+    fprintf(stderr, "modulecheck: serving %s for kernel %s (%zu module files, uevents %s)\n",
+            socket_path, daemon.kernel_version, daemon.files.count,
+            daemon.uevent_fd >= 0 ? "on" : "off, live sysfs lookups");
+    
+    while (!daemon_stop) {
+        nfds_t nfds = 0;
+        fds[nfds].fd = listen_fd;
+        fds[nfds++].events = POLLIN;
+        fds[nfds].fd = daemon.uevent_fd;  // poll() skips negative descriptors
+        fds[nfds++].events = POLLIN;
+        for (size_t i = 0; i < client_count; i++) {
+            fds[nfds].fd = clients[i].fd;
+            fds[nfds++].events = POLLIN | (clients[i].output_length > 0 ? POLLOUT : 0);
+        }
         
-        // Handle both string and object formats
-        if (cJSON_IsString(item)) {
-            // Simple string format
-            const char *name = cJSON_GetStringValue(item);
-            if (name == NULL) continue;
-            
-            strncpy(mod.name, name, sizeof(mod.name) - 1);
-            mod.alias_count = 0;
-        } else if (cJSON_IsObject(item)) {
-            // Object format with aliases
-            cJSON *name_obj = cJSON_GetObjectItem(item, "name");
-            if (name_obj == NULL || !cJSON_IsString(name_obj)) continue;
-            
-            const char *name = cJSON_GetStringValue(name_obj);
-            strncpy(mod.name, name, sizeof(mod.name) - 1);
-            
-            // Get aliases
-            cJSON *aliases = cJSON_GetObjectItem(item, "aliases");
-            if (aliases != NULL && cJSON_IsArray(aliases)) {
-                int alias_count = cJSON_GetArraySize(aliases);
-                mod.alias_count = (alias_count < MAX_ALIASES) ? alias_count : MAX_ALIASES;
-                
-                for (int j = 0; j < mod.alias_count; j++) {
-                    cJSON *alias = cJSON_GetArrayItem(aliases, j);
-                    if (cJSON_IsString(alias)) {
-                        const char *alias_name = cJSON_GetStringValue(alias);
-                        strncpy(mod.aliases[j], alias_name, sizeof(mod.aliases[j]) - 1);
-                    }
-                }
-            } else {
-                mod.alias_count = 0;
-            }
-        } else {
+        int ready = poll(fds, nfds, 1000);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        
+        // Package updates rewrite modules.dep; one stat per file per second catches them
+        if (time(NULL) != daemon.files_checked) {
+            daemon_refresh_files(&daemon, 0);
+        }
+        if (ready == 0) {
             continue;
         }
         
-        // Check the module
-        printf("[%d/%d] %s: ", i + 1, total, mod.name);
+        if (fds[1].revents & POLLIN) {
+            daemon_read_uevents(&daemon);
+        }
         
-        if (find_module(&mod, kernel_version)) {
-            if (mod.loaded) {
-                printf("✓ LOADED");
-                loaded_count++;
-                available_count++;
-                
-                if (mod.builtin) {
-                    printf(" (built-in)");
-                } else if (strcmp(mod.found_as, mod.name) != 0) {
-                    printf(" as '%s'", mod.found_as);
-                }
-                
-                if (strlen(mod.path) > 0) {
-                    printf("\n  %s", mod.path);
-                }
-                printf("\n");
-            } else if (mod.available) {
-                printf("○ AVAILABLE (not loaded)\n");
-                available_count++;
-                
-                if (strlen(mod.path) > 0) {
-                    printf("  %s\n", mod.path);
-                }
+        // Clients first (their slots match fds[2 + i]), then accept new ones
+        for (size_t i = client_count; i-- > 0;) {
+            short revents = fds[2 + i].revents;
+            if (revents == 0) {
+                continue;
+            }
+            int ok = !(revents & (POLLERR | POLLNVAL));
+            if (ok && (revents & POLLOUT)) {
+                ok = daemon_flush(&clients[i]);
+            }
+            if (ok && (revents & POLLIN)) {
+                ok = daemon_serve_client(&daemon, &clients[i]);
+            } else if (ok && (revents & POLLHUP)) {
+                ok = 0;
+            }
+            if (!ok) {
+                daemon_drop_client(&clients[i]);
+                clients[i] = clients[--client_count];
+            }
+        }
+        
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0 && client_count == DAEMON_MAX_CLIENTS) {
+                close(fd);
+            } else if (fd >= 0) {
+                memset(&clients[client_count], 0, sizeof(DaemonClient));
+                clients[client_count++].fd = fd;
             }
-        } else {
-            printf("✗ NOT FOUND\n");
         }
     }
     
-    printf("\n========================================\n");
-    printf("Summary:\n");
-    printf("  Loaded: %d/%d\n", loaded_count, total);
-    printf("  Available: %d/%d\n", available_count, total);
-    printf("========================================\n");
-    
-    cJSON_Delete(root);
-    
-    // Return 0 if all modules are at least available
-    return (available_count == total) ? 0 : 1;
+    for (size_t i = 0; i < client_count; i++) {
+        daemon_drop_client(&clients[i]);
+    }
+    close(listen_fd);
+    unlink(socket_path);
+    if (daemon.uevent_fd >= 0) {
+        close(daemon.uevent_fd);
+    }
+    kernel_index_free(&daemon.files);
+    kernel_index_free(&daemon.running);
+    daemon_free_aliases(&daemon);
+    modprobe_rules_free(&daemon.rules);
+    return 0;
 }
 
+#ifndef MODULECHECK_NO_MAIN
 int main(int argc, char *argv[]) {
     const char *json_example = 
         "{"
@@ -599,10 +5080,96 @@ int main(int argc, char *argv[]) {
         "  ]"
         "}";
     
-    if (argc > 1) {
-        FILE *fp = fopen(argv[1], "r");
+    // --root <dir>: check the system below dir instead of / (before any other option)
+    if (argc > 1 && strcmp(argv[1], "--root") == 0) {
+        if (argc < 3 || !module_check_set_root(argv[2])) {
+            fprintf(stderr, "Usage: %s --root <dir> [options] [config.json]\n", argv[0]);
+            return 1;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    
+    // --daemon: answer queries on a Unix socket until SIGINT/SIGTERM
+    if (argc > 1 && strcmp(argv[1], "--daemon") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s --daemon <socket-path>\n", argv[0]);
+            return 1;
+        }
+        return module_daemon_run(argv[2]) == 0 ? 0 : 1;
+    }
+    
+    // --modinfo: print the .modinfo of a module file, compressed or not
+    if (argc > 1 && strcmp(argv[1], "--modinfo") == 0) {
+        ModuleInfo info;
+        if (argc < 3 || !module_info_read(argv[2], &info)) {
+            fprintf(stderr, "Cannot read module info: %s\n", argc < 3 ? "(no file)" : argv[2]);
+            return 1;
+        }
+        printf("%-16s%s\n", "filename:", argv[2]);
+        for (const char *entry = info.data; entry < info.data + info.length; entry += strlen(entry) + 1) {
+            const char *value = strchr(entry, '=');
+            if (value != NULL) {
+                printf("%.*s:%*s%s\n", (int)(value - entry), entry, (int)(15 - (value - entry) > 0 ? 15 - (value - entry) : 1), "", value + 1);
+            }
+        }
+        module_info_free(&info);
+        return 0;
+    }
+    
+    // --state: print what /sys/module says about a loaded or built-in module
+    if (argc > 1 && strcmp(argv[1], "--state") == 0) {
+        ModuleState state;
+        if (argc < 3 || module_state_read(argv[2], &state) != 1) {
+            fprintf(stderr, "No /sys/module entry: %s\n", argc < 3 ? "(no module)" : argv[2]);
+            return 1;
+        }
+        printf("%-16s%s\n", "module:", argv[2]);
+        printf("%-16s%s\n", "state:", state.state == MODULE_SYSFS_LOADED ? "loaded" : "built-in");
+        if (state.refcnt >= 0) {
+            printf("%-16s%ld\n", "refcnt:", state.refcnt);
+        }
+        if (state.state == MODULE_SYSFS_LOADED) {
+            printf("%-16s%s\n", "taint:", state.taint);
+        }
+        for (const char *h = module_state_holder(&state, NULL); h != NULL; h = module_state_holder(&state, h)) {
+            printf("%-16s%s\n", "holder:", h);
+        }
+        for (const char *entry = state.parameters; entry != NULL && entry < state.parameters + state.parameters_length;
+             entry += strlen(entry) + 1) {
+            printf("%-16s%s\n", "parm:", entry);
+        }
+        module_state_free(&state);
+        return 0;
+    }
+    
+    // --all-kernels: audit every kernel in /lib/modules instead of checking the running one
+    int all_kernels = 0;
+    int arg = 1;
+    if (argc > 1 && strcmp(argv[1], "--all-kernels") == 0) {
+        all_kernels = 1;
+        arg = 2;
+    }
+    
+    // A config file ("-" for stdin) is checked entry by entry as it is read
+    if (argc > arg && !all_kernels) {
+        FILE *fp = strcmp(argv[arg], "-") == 0 ? stdin : fopen(argv[arg], "r");
+        if (fp == NULL) {
+            fprintf(stderr, "Cannot open file: %s\n", argv[arg]);
+            return 1;
+        }
+        int result = check_modules_from_stream(fp);
+        if (fp != stdin) {
+            fclose(fp);
+        }
+        return result;
+    }
+    
+    if (argc > arg) {
+        FILE *fp = fopen(argv[arg], "r");
         if (fp == NULL) {
-            fprintf(stderr, "Cannot open file: %s\n", argv[1]);
+            fprintf(stderr, "Cannot open file: %s\n", argv[arg]);
             return 1;
         }
         
@@ -621,11 +5188,12 @@ int main(int argc, char *argv[]) {
         json_str[read_size] = '\0';
         fclose(fp);
         
-        int result = check_modules_from_json(json_str);
+        int result = audit_modules_from_json(json_str);
         free(json_str);
         
         return result;
     } else {
-        return check_modules_from_json(json_example);
+        return all_kernels ? audit_modules_from_json(json_example) : check_modules_from_json(json_example);
     }
-}
\ No newline at end of file
+}
+#endif
@@ -32,7 +32,7 @@
  *   const char *json = "{\"modules\": [{\"name\": \"v4l2loopback\", \"aliases\": []}]}";
  *   int result = check_modules_from_json(json);
  * 
- * Thread Safety: NOT thread-safe (uses system(), popen())
+ * Thread Safety: NOT thread-safe (may run modinfo)
  */
 
 #ifndef MODULECHECK_H
@@ -40,6 +40,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 /*
  * Version information
@@ -124,7 +125,15 @@
  * - loaded=0, available=1: Module exists but not loaded
  * - loaded=0, available=0: Module not found
  * - builtin=1: Module is built-in (implies loaded=1, available=1)
+ * 
+ * found_by is the MODULE_STRATEGY_* that answered, or -1 if none did.
  */
+#define MODULE_STRATEGY_LOADED  0 /* /proc/modules or /sys/module */
+#define MODULE_STRATEGY_BUILTIN 1 /* modules.builtin */
+#define MODULE_STRATEGY_FILE    2 /* module file under /lib/modules */
+#define MODULE_STRATEGY_MODINFO 3 /* modinfo or an alias resolved to a file */
+#define MODULE_STRATEGY_COUNT   4
+
 typedef struct {
     char name[MAX_MODULE_NAME];
     char aliases[MAX_ALIASES][MAX_MODULE_NAME];
@@ -134,8 +143,304 @@ typedef struct {
     int loaded;
     int available;
     int builtin;
+    int found_by;
 } Module;
 
+/*
+ * ============================================================================
+ * COMPACT REPRESENTATION
+ * ============================================================================
+ */
+
+/*
+ * ModuleStringTable
+ *
+ * Interned strings shared by every entry of a ModuleBatch.
+ *
+ * Strings are stored back to back (NUL terminated) in one growing buffer and
+ * identified by their offset into it. Interning the same string twice returns
+ * the same offset, so an ID comparison is a string comparison. Offset 0 is
+ * always the empty string and doubles as "none".
+ *
+ * Fields:
+ * - data/length/capacity: The string storage
+ * - slots/slot_count: Open addressing hash table of offsets (0 = empty slot)
+ * - string_count: Number of distinct strings stored
+ */
+typedef struct {
+    char *data;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t *slots;
+    uint32_t slot_count;
+    uint32_t string_count;
+} ModuleStringTable;
+
+#define MODULE_STRING_NONE 0            /* ID of the empty string */
+#define MODULE_STRING_INVALID UINT32_MAX /* interning failed (out of memory) */
+
+/*
+ * CompactModule
+ *
+ * A 20 byte stand-in for Module (about 7.2 KB) for checking thousands of
+ * modules at once. All strings live in the owning ModuleBatch:
+ *
+ * - name, found_as, path: Interned string IDs (MODULE_STRING_NONE if unset)
+ * - alias_first/alias_count: Range of interned alias IDs in batch->aliases,
+ *   so there is no fixed MAX_ALIASES limit
+ * - flags: MODULE_FLAG_* results, same meaning as Module's int fields;
+ *   bits 12-15 hold Module.found_by + 1, read with MODULE_FLAG_FOUND_BY()
+ */
+#define MODULE_FLAG_LOADED    0x1
+#define MODULE_FLAG_AVAILABLE 0x2
+#define MODULE_FLAG_BUILTIN   0x4
+#define MODULE_FLAG_BLACKLISTED 0x8  /* "blacklist" in modprobe.d: not autoloaded */
+#define MODULE_FLAG_INSTALL     0x10 /* "install" in modprobe.d: modprobe runs a command instead */
+#define MODULE_FLAG_DISABLED    0x20 /* the install command is true/false: can't be loaded */
+#define MODULE_FLAG_VIA_ALIAS   0x40 /* found_as came from a modprobe.d "alias" */
+#define MODULE_FLAG_STRATEGY_SHIFT 12
+#define MODULE_FLAG_FOUND_BY(flags) ((int)(((flags) >> MODULE_FLAG_STRATEGY_SHIFT) & 0xF) - 1)
+
+typedef struct {
+    uint32_t name;
+    uint32_t found_as;
+    uint32_t path;
+    uint32_t alias_first;
+    uint16_t alias_count;
+    uint16_t flags;
+} CompactModule;
+
+/*
+ * ModuleInfo
+ *
+ * The .modinfo section of a module file: "key=value" strings separated by
+ * NULs (license, description, author, alias, depends, vermagic, ...).
+ *
+ * - data/length: Section contents, NUL terminated as a whole
+ * - compression: MODULE_COMPRESSION_* detected from the file's magic bytes
+ * - bytes_decompressed: How much of the module image had to be produced
+ */
+#define MODULE_COMPRESSION_UNKNOWN -1
+#define MODULE_COMPRESSION_NONE 0
+#define MODULE_COMPRESSION_GZIP 1
+#define MODULE_COMPRESSION_XZ   2
+#define MODULE_COMPRESSION_ZSTD 3
+
+typedef struct {
+    char *data;
+    size_t length;
+    int compression;
+    size_t bytes_decompressed;
+} ModuleInfo;
+
+/*
+ * ModuleState
+ *
+ * The runtime state of a module in /sys/module/<name> (module_state_read()).
+ *
+ * - state: MODULE_SYSFS_LOADED or MODULE_SYSFS_BUILTIN once read
+ * - refcnt: Users of the module, -1 if it has no refcnt (built-in)
+ * - taint: The module's taint flags ("OE", ...), "" when untainted
+ * - parameters: "name=value" strings separated by NULs, NUL terminated as
+ *   a whole; write-only parameters are left out
+ * - holders: Names of the modules using this one, separated the same way
+ */
+typedef struct {
+    int state;
+    long refcnt;
+    char taint[32];
+    char *parameters;
+    size_t parameters_length;
+    char *holders;
+    size_t holders_length;
+} ModuleState;
+
+/*
+ * ModuleBinIndex
+ *
+ * One of depmod's binary prefix-trie indexes (modules.dep.bin, ...),
+ * mapped read-only. Values returned by lookups point into the mapping.
+ */
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    uint32_t root;
+} ModuleBinIndex;
+
+#define MODULE_INDEX_DEP     0 /* module name -> "kernel/.../name.ko.xz: deps" */
+#define MODULE_INDEX_ALIAS   1 /* alias (pci:..., fs-...) -> module name */
+#define MODULE_INDEX_SYMBOLS 2 /* "symbol:<name>" -> module name */
+#define MODULE_INDEX_BUILTIN 3 /* module name -> "" if built in */
+#define MODULE_INDEX_COUNT   4
+
+/*
+ * SymbolEntry / SymbolIndex
+ *
+ * Exported kernel symbols and the module providing each ("vmlinux" for the
+ * kernel image), from modules.symbols and Module.symvers, in a hash table.
+ *
+ * - symbol, module: IDs in the index's string table
+ * - flags: SYMBOL_FLAG_GPL_ONLY for EXPORT_SYMBOL_GPL (Module.symvers only)
+ * - sources: SYMBOL_SOURCE_* files that were found and loaded
+ */
+#define SYMBOL_FLAG_GPL_ONLY 0x1
+
+#define SYMBOL_SOURCE_MODULES_SYMBOLS 0x1
+#define SYMBOL_SOURCE_SYMVERS         0x2
+
+typedef struct {
+    uint32_t symbol;
+    uint32_t module;
+    uint32_t flags;
+} SymbolEntry;
+
+typedef struct {
+    char version[MAX_MODULE_NAME];
+    ModuleStringTable strings;
+    SymbolEntry *entries;
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;  /* entry index + 1, 0 = empty */
+    uint32_t slot_count;
+    int sources;
+} SymbolIndex;
+
+/*
+ * ModprobeRule / ModprobeRules
+ *
+ * The blacklist, install and alias directives of /etc/modprobe.d and
+ * friends, in the order modprobe reads them. Names are stored with
+ * underscores; for aliases the name is a wildcard pattern and value the
+ * target module, for install value is the command.
+ */
+#define MODPROBE_RULE_BLACKLIST 1
+#define MODPROBE_RULE_INSTALL   2
+#define MODPROBE_RULE_ALIAS     3
+
+typedef struct {
+    uint32_t name;
+    uint32_t value;
+    int type;
+} ModprobeRule;
+
+typedef struct {
+    ModuleStringTable strings;
+    ModprobeRule *rules;
+    size_t count;
+    size_t capacity;
+    size_t file_count;
+} ModprobeRules;
+
+/*
+ * ModuleCheckStats
+ *
+ * Counters filled in by builds with -DMODULECHECK_INSTRUMENTATION (see
+ * module_check_set_stats()); they stay zero otherwise.
+ *
+ * - strategy_calls/hits/seconds: Per MODULE_STRATEGY_*, how often it ran,
+ *   how often it found the module, and the wall time spent in it
+ * - subprocesses: uname/find/modinfo processes spawned
+ * - bytes_read: Bytes read from index files, pipes and module images
+ * - cache_hits/cache_misses: Lookups of the per-kernel index caches
+ * - modules_checked: Batch entries checked
+ */
+typedef struct {
+    unsigned long strategy_calls[MODULE_STRATEGY_COUNT];
+    unsigned long strategy_hits[MODULE_STRATEGY_COUNT];
+    double strategy_seconds[MODULE_STRATEGY_COUNT];
+    unsigned long subprocesses;
+    unsigned long long bytes_read;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+    unsigned long modules_checked;
+} ModuleCheckStats;
+
+/*
+ * ModuleCheckContext
+ *
+ * One kernel version's directories and indexes, kept open across queries
+ * (module_context_open()). Opaque.
+ */
+typedef struct ModuleCheckContext ModuleCheckContext;
+
+/*
+ * ModuleBatch
+ *
+ * Growable array of CompactModule entries with their shared string table and
+ * alias list. Initialize with module_batch_init(), release with
+ * module_batch_free(). The struct may be zero-initialized instead of calling
+ * module_batch_init().
+ */
+typedef struct {
+    ModuleStringTable strings;
+    uint32_t *aliases;
+    size_t alias_count;
+    size_t alias_capacity;
+    CompactModule *modules;
+    size_t count;
+    size_t capacity;
+    const ModprobeRules *rules;  /* optional, not owned; NULL ignores modprobe.d */
+    ModuleCheckStats *stats;     /* optional, not owned; totals of module_batch_check_one() */
+    ModuleCheckContext *context; /* optional, not owned; used for checks of its kernel version */
+} ModuleBatch;
+
+/*
+ * ============================================================================
+ * MULTI-KERNEL AUDIT
+ * ============================================================================
+ */
+
+/*
+ * KernelModuleEntry / KernelModuleIndex
+ *
+ * Every module one installed kernel ships, sorted by normalized name
+ * (underscores, as in /proc/modules) for binary search. Built once from
+ * /lib/modules/<version>/modules.builtin and modules.dep, or from a walk of
+ * the tree for *.ko* files when depmod hasn't been run.
+ *
+ * - name, path: IDs in the index's own string table ("[built-in]" as path
+ *   for built-in modules)
+ * - builtin: 1 if listed in modules.builtin (wins over a .ko of the same name)
+ * - compression: How the file is compressed (NONE for built-ins)
+ * - ready: 1 once the index was built, 0 if the kernel's tree was unreadable
+ */
+typedef struct {
+    uint32_t name;
+    uint32_t path;
+    uint32_t order;
+    uint8_t builtin;
+    uint8_t compression;  /* MODULE_COMPRESSION_* of the file, from its suffix */
+} KernelModuleEntry;
+
+typedef struct {
+    char version[MAX_MODULE_NAME];
+    ModuleStringTable strings;
+    KernelModuleEntry *entries;
+    size_t count;
+    size_t capacity;
+    int ready;
+} KernelModuleIndex;
+
+/*
+ * ModuleAudit
+ *
+ * Result of module_audit_run(): the installed kernels (sorted by version)
+ * and a module x kernel matrix of cells. A cell's entry is NULL if the
+ * module is missing from that kernel; found_as is the batch string ID of the
+ * name (primary or alias) that matched.
+ */
+typedef struct {
+    const KernelModuleEntry *entry;
+    uint32_t found_as;
+} ModuleAuditCell;
+
+typedef struct {
+    KernelModuleIndex *kernels;
+    size_t kernel_count;
+    size_t module_count;
+    ModuleAuditCell *cells;
+} ModuleAudit;
+
 /*
  * ============================================================================
  * CORE API FUNCTIONS
@@ -157,6 +462,9 @@ typedef struct {
  * 
  * Uses uname() system call to get kernel release string.
  * Example: "5.15.0-91-generic", "6.1.0-13-amd64"
+ * With a root prefix set, <root>/proc/sys/kernel/osrelease is read first;
+ * it fails (0) unless that is a plain release string (letters, digits and
+ * . - _ + ~), since the version becomes a path and a modinfo argument.
  * 
  * This is critical for finding module paths:
  * /lib/modules/<kernel-version>/kernel/...
@@ -172,6 +480,35 @@ typedef struct {
  */
 int get_kernel_version(char *version, size_t len);
 
+/*
+ * module_check_set_root() / module_check_root()
+ *
+ * Read every system path below `root` instead of /: /proc/modules,
+ * /proc/cmdline, /sys/module, /lib/modules, the modprobe.d directories and
+ * the kernel headers' Module.symvers. The modinfo fallback gets -b root.
+ * Meant for reproducible runs against a copied or synthetic tree (see
+ * bench_modulecheck.c); paths in results include the prefix.
+ *
+ * NULL, "" or "/" go back to the real root. Every cached index (kmod .bin
+ * files, symbols, families, the sysfs probe) is dropped, since it was read
+ * below the old root.
+ *
+ * Returns:
+ * - module_check_set_root(): 1 on success, 0 if root is too long (the
+ *   previous root stays)
+ * - module_check_root(): The current prefix, "" for the real root
+ *
+ * Thread safety: NOT thread-safe. Set it while no check is running in any
+ * thread (normally once, before the first one): the cached .bin mappings,
+ * symbol and family indexes are unmapped and freed here, and a check in
+ * flight may still be reading them. Open ModuleCheckContexts are not
+ * affected; they keep the root they were opened under.
+ *
+ * Command line: modulecheck --root <dir> [options] [config.json]
+ */
+int module_check_set_root(const char *root);
+const char *module_check_root(void);
+
 /*
  * find_module()
  * 
@@ -187,7 +524,7 @@ int get_kernel_version(char *version, size_t len);
  * 
  * Side effects:
  * - Fills mod structure with results (loaded, available, builtin, path, found_as)
- * - May execute shell commands (lsmod, modinfo, find)
+ * - May execute shell commands (modinfo, find)
  * - Reads /proc/modules and /lib/modules files
  * 
  * Search strategy (in order):
@@ -197,7 +534,11 @@ int get_kernel_version(char *version, size_t len);
  * 4. Search for .ko files in kernel module directories
  * 5. Use modinfo as final verification
  * 
- * Thread safety: NOT thread-safe (uses system(), popen())
+ * The name or an alias may be a family pattern ("snd_*", "v4l2*"): it is
+ * found if any module it matches is, found_as names that module, and the
+ * modinfo step is skipped. See module_name_is_pattern().
+ * 
+ * Thread safety: NOT thread-safe (may run modinfo)
  * Performance: Moderate (50-200ms typically)
  * 
  * Example:
@@ -219,6 +560,117 @@ int get_kernel_version(char *version, size_t len);
  */
 int find_module(Module *mod, const char *kernel_version);
 
+/*
+ * module_context_open() / module_context_close()
+ *
+ * A context for repeated queries about one kernel version. It holds
+ * directory fds for /lib/modules/<kernel_version>, /proc and /sys/module
+ * (below the root prefix at the time it was opened), and builds the module
+ * index of the version (modules.builtin + modules.dep, see
+ * KernelModuleIndex) on the first query that needs it. Queries then cost a
+ * binary search plus an fstatat()/openat() relative to those fds: no path
+ * is formatted from the root down and no index file is read again.
+ *
+ * Parameters:
+ * - kernel_version: Version to query, NULL for the running kernel
+ *
+ * Returns:
+ * - module_context_open(): The context, or NULL if out of memory or the
+ *   running kernel's version can't be determined. A version without a
+ *   /lib/modules directory still gets a context (nothing is available in
+ *   it). Only a context for the running kernel sees loaded modules, and
+ *   built-ins through /sys/module; for any other version nothing is loaded
+ * - module_context_kernel_version(): The version the context is for
+ *
+ * Thread safety: A context is NOT thread-safe; use one per thread.
+ *
+ * Example:
+ *   ModuleCheckContext *context = module_context_open(NULL);
+ *   for (int i = 0; i < count; i++) {
+ *       if (module_context_find(context, &mods[i])) {
+ *           printf("%s: %s\n", mods[i].name, mods[i].path);
+ *       }
+ *   }
+ *   module_context_close(context);
+ */
+ModuleCheckContext *module_context_open(const char *kernel_version);
+void module_context_close(ModuleCheckContext *context);
+const char *module_context_kernel_version(const ModuleCheckContext *context);
+
+/*
+ * module_context_find() / module_context_is_loaded() /
+ * module_context_is_builtin() / module_context_find_file()
+ *
+ * find_module(), is_module_loaded(), is_module_builtin() and
+ * find_module_file() through a context, with the same results except that
+ * module_context_find_file() doesn't fall back to running modinfo
+ * (module_context_find() still does as its last strategy).
+ *
+ * Batches use a context through ModuleBatch.context; check_modules_from_json()
+ * and check_modules_from_stream() open one for the run.
+ */
+int module_context_find(ModuleCheckContext *context, Module *mod);
+int module_context_is_loaded(ModuleCheckContext *context, const char *module_name);
+int module_context_is_builtin(ModuleCheckContext *context, const char *module_name);
+int module_context_find_file(ModuleCheckContext *context, const char *module_name, char *result_path);
+
+/*
+ * find_symbol_module()
+ * 
+ * Which module exports a kernel symbol, and is that module there?
+ * 
+ * Parameters:
+ * - symbol: Exported symbol name (e.g. "snd_card_new")
+ * - kernel_version: Kernel version string
+ * - mod: Receives the provider; for MODULE_SYMBOL_MODULE it is filled by
+ *   find_module() (loaded, available, path, ...)
+ * - gpl_only: If not NULL, set to 1 for EXPORT_SYMBOL_GPL symbols (only
+ *   known when Module.symvers is installed)
+ * 
+ * Returns:
+ * - MODULE_SYMBOL_MODULE: Exported by module mod->name
+ * - MODULE_SYMBOL_KERNEL: Exported by the kernel image (always available)
+ * - MODULE_SYMBOL_UNKNOWN: No index lists the symbol
+ * 
+ * Sources, in order:
+ * 1. /lib/modules/<kernel>/modules.symbols.bin (module symbols)
+ * 2. A hash index of Module.symvers (from the kernel headers: build/,
+ *    /usr/src/kernels/<kernel>, /usr/src/linux-headers-<kernel>) and,
+ *    without the .bin, modules.symbols. Built on first use and kept for
+ *    the last kernel version asked about.
+ * 
+ * Thread safety: Safe (the hash index is locked)
+ * Performance: One lookup after the first call; no processes
+ * 
+ * Example:
+ *   Module provider;
+ *   if (find_symbol_module("snd_card_new", kernel, &provider, NULL) == MODULE_SYMBOL_MODULE) {
+ *       printf("snd_card_new comes from %s (%s)\n", provider.name,
+ *              provider.available ? "available" : "missing");
+ *   }
+ */
+#define MODULE_SYMBOL_UNKNOWN 0
+#define MODULE_SYMBOL_KERNEL  1
+#define MODULE_SYMBOL_MODULE  2
+
+int find_symbol_module(const char *symbol, const char *kernel_version, Module *mod, int *gpl_only);
+
+/*
+ * symbol_index_load() / symbol_index_lookup() / symbol_index_string() / symbol_index_free()
+ * 
+ * The hash index behind find_symbol_module(), for callers resolving many
+ * symbols of one kernel themselves. skip_modules_symbols leaves out
+ * modules.symbols (e.g. when modules.symbols.bin answers for it).
+ * 
+ * Returns:
+ * - symbol_index_load(): Number of symbols, or -1 if out of memory
+ * - symbol_index_lookup(): The entry, or NULL
+ */
+int symbol_index_load(SymbolIndex *index, const char *kernel_version, int skip_modules_symbols);
+const SymbolEntry *symbol_index_lookup(const SymbolIndex *index, const char *symbol);
+const char *symbol_index_string(const SymbolIndex *index, uint32_t id);
+void symbol_index_free(SymbolIndex *index);
+
 /*
  * check_modules_from_json()
  * 
@@ -249,9 +701,31 @@ int find_module(Module *mod, const char *kernel_version);
  *     ]
  *   }
  * 
+ * Optional "symbols" (with either format): kernel symbols that must be
+ * exported by the kernel or an available module (find_symbol_module()):
+ *   {
+ *     "modules": ["snd_hda_intel"],
+ *     "symbols": ["snd_card_new", "video_register_device"]
+ *   }
+ * 
+ * Optional "expect" (object format): the state a loaded module must be in,
+ * checked against /sys/module (module_state_read()). Every key is optional;
+ * true/false match Y/N, an array matches a comma separated array parameter
+ * ([] an empty one),
+ * "holders" is the complete set and "" means untainted:
+ *   {
+ *     "name": "v4l2loopback",
+ *     "expect": {
+ *       "parameters": {"devices": 4, "exclusive_caps": true},
+ *       "refcnt": 0,
+ *       "holders": [],
+ *       "taint": ""
+ *     }
+ *   }
+ * 
  * Returns:
- * -  0: All modules available (loaded or loadable)
- * -  1: Some modules not found
+ * -  0: All modules available (loaded or loadable), every expected state met
+ * -  1: Some modules not found, or an expected state not met
  * - -1: Error (invalid JSON, missing modules array)
  * 
  * Side effects:
@@ -274,6 +748,14 @@ int find_module(Module *mod, const char *kernel_version);
  *     Available: 2/2
  *   ========================================
  * 
+ * With "expect", one line per expected value follows the module's status:
+ *   [1/1] v4l2loopback: ✓ LOADED
+ *     /lib/modules/5.15.0-91-generic/updates/dkms/v4l2loopback.ko
+ *     ✓ parameter devices: 4
+ *     ✗ parameter exclusive_caps: N (expected true)
+ *     ✓ refcnt: 0
+ * and the summary gains a "State: passed/expected" line.
+ * 
  * Thread safety: NOT thread-safe
  * Memory: Allocates temporary buffers (freed before return)
  * 
@@ -293,6 +775,515 @@ int find_module(Module *mod, const char *kernel_version);
  */
 int check_modules_from_json(const char *json_str);
 
+/*
+ * check_modules_from_stream()
+ * 
+ * check_modules_from_json() for a config read from fp (a file, a pipe or
+ * stdin), without loading it first. Each element of "modules" is parsed,
+ * checked and reported as soon as its closing bracket has been read, and
+ * stdout is flushed after it, so the first result shows up while a large
+ * generated manifest is still being written or read. Memory holds one
+ * entry at a time, plus the "symbols" list (resolved after the modules).
+ * 
+ * Returns: Same as check_modules_from_json(). A syntax error stops the run
+ * (-1, no summary) after the entries before it were reported.
+ * 
+ * A config that can be rewound (a file, or stdin redirected from one) is
+ * first scanned once to count its modules, without parsing them, so the
+ * output is exactly that of check_modules_from_json().
+ * 
+ * Output format: As check_modules_from_json(); from a pipe the total isn't
+ * known up front:
+ *   Kernel version: 5.15.0-91-generic
+ *   Checking modules...
+ *   
+ *   [1] v4l2loopback: ✓ LOADED
+ *   ...
+ * 
+ * Command line: modulecheck config.json, or modulecheck - < config.json
+ */
+int check_modules_from_stream(FILE *fp);
+
+/*
+ * ============================================================================
+ * BATCH API (COMPACT ENTRIES)
+ * ============================================================================
+ */
+
+/*
+ * module_batch_init() / module_batch_free()
+ *
+ * Prepare an empty batch, and release everything a batch owns (the batch
+ * struct itself is not freed and can be reused after module_batch_init()).
+ */
+void module_batch_init(ModuleBatch *batch);
+void module_batch_free(ModuleBatch *batch);
+
+/*
+ * module_strings_intern()
+ *
+ * Adds a string to a string table, or finds it if it is already there.
+ *
+ * Returns:
+ * - The string's ID (offset into table->data)
+ * - MODULE_STRING_INVALID: Out of memory
+ */
+uint32_t module_strings_intern(ModuleStringTable *table, const char *string);
+
+/*
+ * module_batch_string()
+ *
+ * Resolves an interned ID of the batch (name, found_as, path or alias) back
+ * to the string. The pointer is valid until the next string is added.
+ */
+const char *module_batch_string(const ModuleBatch *batch, uint32_t id);
+
+/*
+ * module_batch_add()
+ *
+ * Appends a module to check, with any number of aliases.
+ *
+ * Returns:
+ * - Index of the new entry in batch->modules
+ * - -1: Out of memory
+ *
+ * Example:
+ *   ModuleBatch batch;
+ *   module_batch_init(&batch);
+ *   const char *aliases[] = {"v4l2_core"};
+ *   module_batch_add(&batch, "videodev", aliases, 1);
+ *   module_batch_add(&batch, "v4l2loopback", NULL, 0);
+ */
+long module_batch_add(ModuleBatch *batch, const char *name, const char *const *aliases, size_t alias_count);
+
+/*
+ * module_batch_check_one() / module_batch_check()
+ *
+ * Run the find_module() search for one entry, or for all entries, and store
+ * the results (flags, found_as, path) in the compact entries.
+ *
+ * With batch->rules set, a name that isn't found is also tried as a
+ * modprobe.d alias (MODULE_FLAG_VIA_ALIAS), and the blacklist/install
+ * verdict for the matched (or, if nothing matched, the primary) name is
+ * added to flags. A DISABLED module still counts as found here; callers
+ * decide whether a file modprobe refuses to load is good enough.
+ *
+ * With batch->stats set (and instrumentation compiled in), each check also
+ * adds its counters there; the answering strategy is kept in the flags.
+ *
+ * Returns:
+ * - module_batch_check_one(): 1 if found (loaded or available), 0 if not
+ * - module_batch_check(): Number of entries found
+ *
+ * Example:
+ *   char kernel[256];
+ *   get_kernel_version(kernel, sizeof(kernel));
+ *   size_t found = module_batch_check(&batch, kernel);
+ *   for (size_t i = 0; i < batch.count; i++) {
+ *       const CompactModule *m = &batch.modules[i];
+ *       printf("%s: %s\n", module_batch_string(&batch, m->name),
+ *              (m->flags & MODULE_FLAG_LOADED) ? "loaded" : "not loaded");
+ *   }
+ *   module_batch_free(&batch);
+ */
+int module_batch_check_one(ModuleBatch *batch, size_t index, const char *kernel_version);
+size_t module_batch_check(ModuleBatch *batch, const char *kernel_version);
+
+/*
+ * ============================================================================
+ * INSTRUMENTATION
+ * ============================================================================
+ */
+
+/*
+ * module_check_set_stats()
+ *
+ * Direct the counters of every check made by the calling thread into
+ * `stats` (NULL stops counting). The counters are added to, never reset,
+ * so one struct can cover a single module or a whole run.
+ *
+ * Counting only happens in builds with -DMODULECHECK_INSTRUMENTATION;
+ * otherwise the hooks compile away and this does nothing.
+ *
+ * Returns:
+ * - The previously set stats (to restore later), NULL if none or if
+ *   instrumentation isn't compiled in
+ *
+ * Example:
+ *   ModuleCheckStats stats = {0};
+ *   ModuleCheckStats *previous = module_check_set_stats(&stats);
+ *   find_module(&mod, kernel);
+ *   module_check_set_stats(previous);
+ *   printf("found by %s, %lu processes\n",
+ *          module_strategy_name(mod.found_by), stats.subprocesses);
+ *
+ * Thread safety:
+ * - The setting is per thread; each thread needs its own stats struct
+ */
+ModuleCheckStats *module_check_set_stats(ModuleCheckStats *stats);
+
+/*
+ * module_check_stats_add()
+ *
+ * Add every counter of `stats` to `total`, e.g. to combine per-thread stats.
+ */
+void module_check_stats_add(ModuleCheckStats *total, const ModuleCheckStats *stats);
+
+/*
+ * module_strategy_name()
+ *
+ * "loaded", "builtin", "file" or "modinfo" for a MODULE_STRATEGY_*, "none"
+ * for anything else (such as found_by == -1).
+ */
+const char *module_strategy_name(int strategy);
+
+/*
+ * ============================================================================
+ * MODULE FILES
+ * ============================================================================
+ */
+
+/*
+ * module_compression_from_path()
+ *
+ * Returns MODULE_COMPRESSION_NONE/GZIP/XZ/ZSTD for a path ending in .ko,
+ * .ko.gz, .ko.xz or .ko.zst, MODULE_COMPRESSION_UNKNOWN for anything else.
+ */
+int module_compression_from_path(const char *path);
+
+/*
+ * module_info_read() / module_info_get() / module_info_free()
+ *
+ * Reads the .modinfo section of a module file without running modinfo.
+ * Compressed modules are decompressed as a stream, only until the ELF
+ * section headers and .modinfo have been seen, in memory. The format is
+ * taken from the magic bytes, not the name.
+ *
+ * Decompression support is chosen at build time:
+ *   -DMODULECHECK_WITH_ZLIB -lz       gzip
+ *   -DMODULECHECK_WITH_LZMA -llzma    xz
+ *   -DMODULECHECK_WITH_ZSTD -lzstd    zstd
+ * Uncompressed modules are always supported.
+ *
+ * Returns:
+ * - module_info_read(): 1 on success; 0 if the file is missing, no ELF
+ *   module, corrupt, or compressed in a format this build can't read
+ * - module_info_get(): The value of the first entry with that key after
+ *   `previous` (NULL to start at the beginning), or NULL. Keys like alias
+ *   occur many times.
+ *
+ * Example:
+ *   ModuleInfo info;
+ *   if (module_info_read("/lib/modules/6.1.0/kernel/fs/fuse/fuse.ko.xz", &info)) {
+ *       printf("license: %s\n", module_info_get(&info, "license", NULL));
+ *       for (const char *a = module_info_get(&info, "alias", NULL); a != NULL;
+ *            a = module_info_get(&info, "alias", a)) {
+ *           printf("alias: %s\n", a);
+ *       }
+ *       module_info_free(&info);
+ *   }
+ *
+ * Command line: modulecheck --modinfo <file>
+ */
+int module_info_read(const char *path, ModuleInfo *info);
+const char *module_info_get(const ModuleInfo *info, const char *key, const char *previous);
+void module_info_free(ModuleInfo *info);
+
+/*
+ * ============================================================================
+ * RUNNING MODULE STATE
+ * ============================================================================
+ */
+
+/*
+ * module_state_read() / module_state_parameter() / module_state_holder() /
+ * module_state_free()
+ *
+ * Reads what the running kernel reports about a module in
+ * /sys/module/<name>: its parameters, refcnt, holders and taint, in one
+ * pass of openat() calls below the module's directory. The /sys/module
+ * directory fd is opened on first use and kept.
+ *
+ * Returns:
+ * - module_state_read(): 1 if the module has a /sys/module entry (state
+ *   filled in, release with module_state_free()); 0 if not, with
+ *   state->state telling MODULE_SYSFS_ABSENT from MODULE_SYSFS_UNAVAILABLE;
+ *   -1 if out of memory
+ * - module_state_parameter(): The current value of a parameter, or NULL if
+ *   the module has no such (readable) parameter
+ * - module_state_holder(): The holder after `previous` (NULL to start), or
+ *   NULL after the last one
+ *
+ * Example:
+ *   ModuleState state;
+ *   if (module_state_read("v4l2loopback", &state) == 1) {
+ *       const char *devices = module_state_parameter(&state, "devices");
+ *       printf("devices=%s refcnt=%ld\n", devices ? devices : "?", state.refcnt);
+ *       for (const char *h = module_state_holder(&state, NULL); h != NULL;
+ *            h = module_state_holder(&state, h)) {
+ *           printf("used by %s\n", h);
+ *       }
+ *       module_state_free(&state);
+ *   }
+ *
+ * Thread safety: Safe
+ *
+ * Command line: modulecheck --state <module>
+ */
+int module_state_read(const char *module_name, ModuleState *state);
+const char *module_state_parameter(const ModuleState *state, const char *name);
+const char *module_state_holder(const ModuleState *state, const char *previous);
+void module_state_free(ModuleState *state);
+
+/*
+ * ============================================================================
+ * KMOD INDEXES
+ * ============================================================================
+ */
+
+/*
+ * module_index_lookup()
+ *
+ * Looks a key up in one of the depmod indexes of a kernel: the .bin trie
+ * when depmod wrote one (mapped on first use and kept for the 8 most
+ * recently used kernel versions), otherwise a scan of the text file.
+ *
+ * Parameters:
+ * - which: MODULE_INDEX_DEP, _ALIAS, _SYMBOLS or _BUILTIN
+ * - key: Module name ('-' or '_'), alias, or "symbol:<name>"
+ * - value/size: Receives the value (see MODULE_INDEX_*)
+ *
+ * Returns:
+ * - 1: Found
+ * - 0: Not found, or neither file exists
+ *
+ * Alias lookups match the stored wildcard patterns (fnmatch) and return
+ * the first match.
+ *
+ * Thread safety: Safe (the mapping cache is locked)
+ * Performance: O(key length) with the .bin file; a linear scan without
+ *
+ * Example:
+ *   char module[MAX_MODULE_NAME];
+ *   if (module_index_lookup(kernel, MODULE_INDEX_ALIAS, "fs-fuse", module, sizeof(module))) {
+ *       printf("fs-fuse is provided by %s\n", module);
+ *   }
+ */
+int module_index_lookup(const char *kernel_version, int which, const char *key, char *value, size_t size);
+
+/*
+ * module_bin_index_open() / module_bin_index_close()
+ * module_bin_index_lookup() / module_bin_index_match()
+ *
+ * Direct access to a single .bin file: map and validate it (magic and
+ * major version), unmap it, find the first value of an exact key, or the
+ * first value of a stored pattern that matches key (for modules.alias.bin).
+ * Returned strings live until module_bin_index_close(). Every offset is
+ * bounds checked, so a corrupt file yields "not found", never a crash.
+ *
+ * Returns:
+ * - module_bin_index_open(): 1 on success, 0 if missing or not an index
+ * - lookup/match: The value, or NULL
+ */
+int module_bin_index_open(ModuleBinIndex *index, const char *path);
+void module_bin_index_close(ModuleBinIndex *index);
+const char *module_bin_index_lookup(const ModuleBinIndex *index, const char *key);
+const char *module_bin_index_match(const ModuleBinIndex *index, const char *key);
+
+/*
+ * ============================================================================
+ * MODPROBE CONFIGURATION
+ * ============================================================================
+ */
+
+/*
+ * modprobe_rules_load() / modprobe_rules_free()
+ *
+ * Reads every *.conf in /run/modprobe.d, /etc/modprobe.d,
+ * /usr/local/lib/modprobe.d, /usr/lib/modprobe.d and /lib/modprobe.d (a
+ * file name in an earlier directory hides the same name in later ones; the
+ * files are then read in name order) plus modprobe.blacklist= from
+ * /proc/cmdline. options, remove and softdep lines are ignored.
+ *
+ * Returns:
+ * - Number of config files read (0 if there are none)
+ * - -1: Out of memory (rules is left empty)
+ *
+ * Example:
+ *   ModprobeRules rules;
+ *   modprobe_rules_load(&rules);
+ *   batch.rules = &rules;
+ *   module_batch_check(&batch, kernel);
+ *   ...
+ *   module_batch_free(&batch);
+ *   modprobe_rules_free(&rules);
+ */
+int modprobe_rules_load(ModprobeRules *rules);
+void modprobe_rules_free(ModprobeRules *rules);
+
+/*
+ * modprobe_is_blacklisted() / modprobe_install_command() / modprobe_resolve_alias()
+ *
+ * Single lookups ('-' and '_' are equivalent; the first matching rule wins,
+ * like in modprobe).
+ *
+ * Returns:
+ * - modprobe_is_blacklisted(): 1 if a blacklist line names the module
+ * - modprobe_install_command(): The install command, or NULL
+ * - modprobe_resolve_alias(): The module an alias (wildcards allowed)
+ *   resolves to, or NULL
+ * Strings point into rules and live until modprobe_rules_free().
+ */
+int modprobe_is_blacklisted(const ModprobeRules *rules, const char *module_name);
+const char *modprobe_install_command(const ModprobeRules *rules, const char *module_name);
+const char *modprobe_resolve_alias(const ModprobeRules *rules, const char *name);
+
+/*
+ * ============================================================================
+ * MULTI-KERNEL AUDIT API
+ * ============================================================================
+ */
+
+/*
+ * audit_modules_from_json()
+ *
+ * Like check_modules_from_json(), but for every kernel installed under
+ * /lib/modules instead of the running one. Nothing is loaded in the other
+ * kernels, so a module counts as present if it is built in or ships as a
+ * .ko file. Prints one line per module and kernel, then a per-kernel
+ * summary listing what is missing.
+ *
+ * Returns:
+ * - MODULECHECK_SUCCESS: Every module is present in every kernel
+ * - MODULECHECK_MISSING_MODS: Some kernel lacks some module
+ * - MODULECHECK_ERROR: Invalid JSON or /lib/modules unreadable
+ *
+ * Command line: modulecheck --all-kernels [config.json]
+ */
+int audit_modules_from_json(const char *json_str);
+
+/*
+ * kernel_index_build() / kernel_index_free() / kernel_index_lookup()
+ *
+ * Build the index of one kernel version, release it, and look a module up
+ * (hyphens and underscores are equivalent). kernel_index_string() resolves
+ * an entry's name or path ID.
+ *
+ * Returns:
+ * - kernel_index_build(): 1 on success, 0 if the tree is missing or out of
+ *   memory
+ * - kernel_index_lookup(): The entry, or NULL if the kernel lacks the module
+ *
+ * Thread safety: Building different indexes concurrently is safe; an index
+ * must not be looked up while it is being built.
+ * Performance: One read of modules.dep per kernel, then O(log n) per lookup
+ */
+int kernel_index_build(KernelModuleIndex *index, const char *kernel_version);
+void kernel_index_free(KernelModuleIndex *index);
+const KernelModuleEntry *kernel_index_lookup(const KernelModuleIndex *index, const char *module_name);
+const char *kernel_index_string(const KernelModuleIndex *index, uint32_t id);
+
+/*
+ * module_name_is_pattern() / kernel_index_match()
+ *
+ * A module name containing '*', '?' or '[' is a family pattern (fnmatch()
+ * syntax), matched against normalized names: "snd-hda-*" is "snd_hda_*".
+ *
+ * kernel_index_match() returns the first entry matching the pattern after
+ * `previous` (NULL to start), in name order. The literal prefix before the
+ * first wildcard is binary searched, so "snd_*" only looks at the snd_
+ * entries; a pattern starting with a wildcard scans the whole index.
+ *
+ * Returns:
+ * - module_name_is_pattern(): 1 if name has wildcards, 0 for a plain name
+ * - kernel_index_match(): The next matching entry, or NULL
+ *
+ * Example:
+ *   const KernelModuleEntry *e = NULL;
+ *   while ((e = kernel_index_match(&index, "snd_hda_codec_*", e)) != NULL) {
+ *       printf("%s\n", kernel_index_string(&index, e->name));
+ *   }
+ */
+int module_name_is_pattern(const char *name);
+const KernelModuleEntry *kernel_index_match(const KernelModuleIndex *index, const char *pattern,
+                                            const KernelModuleEntry *previous);
+
+/*
+ * module_audit_run() / module_audit_cell() / module_audit_free()
+ *
+ * Enumerate /lib/modules, index every kernel (one thread per kernel) and
+ * check every entry of the batch against each, primary name first, then
+ * aliases. The batch itself is not modified.
+ *
+ * Returns:
+ * - module_audit_run(): 1 on success (zero kernels is a success), 0 if
+ *   /lib/modules can't be read or out of memory
+ * - module_audit_cell(): The cell for batch entry `module` and
+ *   audit->kernels[kernel]
+ *
+ * Example:
+ *   ModuleAudit audit;
+ *   if (module_audit_run(&audit, &batch)) {
+ *       for (size_t k = 0; k < audit.kernel_count; k++) {
+ *           const ModuleAuditCell *cell = module_audit_cell(&audit, 0, k);
+ *           printf("%s: %s\n", audit.kernels[k].version,
+ *                  cell->entry ? "present" : "missing");
+ *       }
+ *       module_audit_free(&audit);
+ *   }
+ */
+int module_audit_run(ModuleAudit *audit, const ModuleBatch *batch);
+const ModuleAuditCell *module_audit_cell(const ModuleAudit *audit, size_t module, size_t kernel);
+void module_audit_free(ModuleAudit *audit);
+
+/*
+ * ============================================================================
+ * DAEMON MODE
+ * ============================================================================
+ */
+
+/*
+ * module_daemon_run()
+ *
+ * Serves module queries on a Unix domain socket until SIGINT or SIGTERM,
+ * keeping the running kernel's module indexes in memory instead of paying
+ * for a process, uname and file scans on every check.
+ *
+ * Parameters:
+ * - socket_path: Where to create the socket (a stale socket is replaced,
+ *   any other existing file is an error); removed again on exit
+ *
+ * Returns:
+ * - 0: Stopped by a signal
+ * - -1: Could not start (socket path in use, no kernel version, ...)
+ *
+ * Protocol: one JSON object per line in each direction, any number of
+ * requests per connection.
+ *   -> {"modules": [...]}            same format as check_modules_from_json()
+ *   <- {"kernel":"6.1.0-13-amd64","total":2,"loaded":1,"available":2,
+ *       "modules":[{"name":"videodev","status":"builtin","found_as":"videodev",
+ *                   "path":"[built-in]"},
+ *                  {"name":"v4l2loopback","status":"available",
+ *                   "found_as":"v4l2loopback","path":"/lib/modules/..."}]}
+ *   status is "loaded", "builtin", "available", "disabled" (modprobe.d
+ *   install true/false) or "missing"; "blacklisted":true and
+ *   "install":"<command>" are added when modprobe.d says so
+ *   -> {"command":"ping"}            kernel, query count, index size
+ *   -> {"command":"reload"}          rebuild both indexes now
+ *   <- {"error":"..."}               for anything else
+ *
+ * Freshness:
+ * - modules.dep/modules.builtin: rebuilt when their mtime (or that of
+ *   /lib/modules/<kver>) changes, checked once per second
+ * - Loaded modules: rebuilt after a module uevent from the kernel; if the
+ *   uevent socket can't be opened, every query asks sysfs directly
+ * modinfo is never run, so modules outside /lib/modules aren't found.
+ *
+ * Command line: modulecheck --daemon /run/modulecheck.sock
+ * Query from a shell: echo '{"modules":["fuse"]}' | socat - UNIX-CONNECT:/run/modulecheck.sock
+ */
+int module_daemon_run(const char *socket_path);
+
 /*
  * ============================================================================
  * UTILITY FUNCTIONS
@@ -312,14 +1303,15 @@ int check_modules_from_json(const char *json_str);
  * - 0: Module is not loaded
  * 
  * Detection methods:
- * 1. Parse /proc/modules (most reliable)
- * 2. Use lsmod command (fallback)
+ * 0. /sys/module/<name>/initstate (one stat, used whenever sysfs is mounted)
+ * 1. Parse /proc/modules (fallback without sysfs)
+ * Never spawns a process.
  * 
  * Automatically normalizes names (converts - to _) to handle
  * both user-space and kernel-space naming conventions.
  * 
- * Thread safety: NOT thread-safe (uses system())
- * Performance: Fast (5-20ms)
+ * Thread safety: Safe (read-only file operations)
+ * Performance: Very fast with sysfs (one stat), otherwise fast (<1ms)
  * 
  * Example:
  *   if (is_module_loaded("v4l2loopback")) {
@@ -347,6 +1339,8 @@ int is_module_loaded(const char *module_name);
  * - Always "loaded"
  * - Don't appear in lsmod
  * - Listed in /lib/modules/<kernel>/modules.builtin
+ * - Have a /sys/module/<name> entry without initstate, if they have
+ *   parameters; checked first when kernel_version is the running kernel
  * 
  * Common built-in modules:
  * - Core filesystem drivers (ext4)
@@ -354,7 +1348,8 @@ int is_module_loaded(const char *module_name);
  * - Critical hardware support
  * 
  * Thread safety: Safe (read-only file operations)
- * Performance: Moderate (must parse modules.builtin file)
+ * Performance: Fast with modules.builtin.bin (a trie lookup in a mapped
+ * file); otherwise must parse modules.builtin
  * 
  * Example:
  *   char kernel[256];
@@ -366,6 +1361,36 @@ int is_module_loaded(const char *module_name);
  */
 int is_module_builtin(const char *module_name, const char *kernel_version);
 
+/*
+ * sysfs_module_state()
+ * 
+ * Looks a module up in /sys/module of the running kernel.
+ * 
+ * Parameters:
+ * - module_name: Name of module (hyphens are normalized to underscores)
+ * 
+ * Returns:
+ * - MODULE_SYSFS_LOADED: Loadable module, currently loaded
+ *   (/sys/module/<name>/initstate exists)
+ * - MODULE_SYSFS_BUILTIN: Built-in module (directory without initstate)
+ * - MODULE_SYSFS_ABSENT: No entry; not loaded, but could still be a built-in
+ *   module without parameters
+ * - MODULE_SYSFS_UNAVAILABLE: /sys/module doesn't exist (sysfs not mounted)
+ * 
+ * Thread safety: Safe
+ * Performance: One or two stat() calls, no parsing, no subprocess
+ * 
+ * Example:
+ *   if (sysfs_module_state("fuse") == MODULE_SYSFS_BUILTIN) {
+ *       printf("fuse is built in\n");
+ *   }
+ */
+#define MODULE_SYSFS_UNAVAILABLE -1
+#define MODULE_SYSFS_ABSENT 0
+#define MODULE_SYSFS_LOADED 1
+#define MODULE_SYSFS_BUILTIN 2
+int sysfs_module_state(const char *module_name);
+
 /*
  * find_module_file()
  * 
@@ -393,7 +1418,7 @@ int is_module_builtin(const char *module_name, const char *kernel_version);
  * The .ko file might be compressed (.ko.gz, .ko.xz, .ko.zst)
  * depending on distribution. This function handles all variants.
  * 
- * Thread safety: NOT thread-safe (uses popen())
+ * Thread safety: NOT thread-safe (may run modinfo)
  * Performance: Slow (100-500ms for filesystem search)
  * 
  * Example:
@@ -439,7 +1464,7 @@ int find_module_file(const char *module_name, const char *kernel_version, char *
  * - Finding dependencies
  * - Checking module metadata
  * 
- * Thread safety: NOT thread-safe (uses popen())
+ * Thread safety: NOT thread-safe (may run modinfo)
  * Performance: Moderate (50-150ms)
  * 
  * Example:
@@ -469,7 +1494,9 @@ int check_module_by_modinfo(const char *module_name, Module *mod);
  * ============================================================================
  * 
  * Compilation:
- *   gcc -o modulecheck modulecheck.c -lcjson -Wall -Wextra
+ *   gcc -o modulecheck modulecheck.c -lcjson -lpthread -Wall -Wextra
+ *   Add -DMODULECHECK_WITH_ZLIB -lz, -DMODULECHECK_WITH_LZMA -llzma and/or
+ *   -DMODULECHECK_WITH_ZSTD -lzstd to read compressed modules natively
  * 
  * Linking:
  *   Requires cJSON library: apt-get install libcjson-dev
@@ -508,6 +1535,14 @@ int check_module_by_modinfo(const char *module_name, Module *mod);
  *      ]
  *    }
  * 
+ * 5. Or, when any member will do, as one pattern entry:
+ *    {
+ *      "modules": [
+ *        {"name": "snd_hda_codec_*", "aliases": []},
+ *        "v4l2*"
+ *      ]
+ *    }
+ * 
  * Common Module Scenarios:
  * 
  * Video4Linux (V4L2):
@@ -533,12 +1568,14 @@ int check_module_by_modinfo(const char *module_name, Module *mod);
  * Thread Safety Summary:
  * - get_kernel_version(): Thread-safe
  * - is_module_builtin(): Thread-safe (read-only)
+ * - is_module_loaded(), sysfs_module_state(), module_state_read(): Thread-safe (read-only)
  * - All other functions: NOT thread-safe
  * 
  * For multi-threaded use, serialize calls with mutexes.
  * 
  * Performance Tips:
  * - Cache kernel version (doesn't change during runtime)
+ * - Query many modules of one kernel through a ModuleCheckContext
  * - Check loaded modules first (fastest)
  * - Batch checks with JSON format (more efficient output)
  * - Built-in check is faster than file search